@@ -0,0 +1,283 @@
+#include "Analysis.h"
+#include <algorithm>
+#include <cmath>
+
+// Frames waiting for the background thread before sample() blocks
+const size_t MAX_PENDING_FRAMES = 2;
+
+// The MSD is only fitted up to lags this many times shorter than the run, longer ones have too few independent windows
+const double MIN_LAG_WINDOWS = 10.0;
+
+MultipleTauCorrelator::MultipleTauCorrelator(Mode _mode, int _pointsPerLevel, int _averaging, int _levels) :
+    mode(_mode),
+    pointsPerLevel(std::max(2, _pointsPerLevel)),
+    averaging(std::max(2, std::min(_averaging, pointsPerLevel))),
+    levels(std::max(1, _levels)),
+    history((size_t)levels * pointsPerLevel),
+    historyStart(levels, 0),
+    historyCount(levels, 0),
+    sum((size_t)levels * pointsPerLevel, 0.0),
+    count((size_t)levels * pointsPerLevel, 0),
+    pending(levels, Sample { 0.0, 0.0, 0.0 }),
+    pendingCount(levels, 0)
+{}
+
+void MultipleTauCorrelator::add(Sample sample) {
+    add(sample, 0);
+}
+
+void MultipleTauCorrelator::add(Sample sample, int level) {
+    Sample *levelHistory = &history[(size_t)level * pointsPerLevel];
+    int &start = historyStart[level];
+    start = start == 0 ? pointsPerLevel - 1 : start - 1;
+    levelHistory[start] = sample;
+    historyCount[level] = std::min(historyCount[level] + 1, pointsPerLevel);
+
+    // Lags below pointsPerLevel / averaging are already covered more finely by the level below
+    int firstLag = level == 0 ? 0 : pointsPerLevel / averaging;
+    double *levelSum = &sum[(size_t)level * pointsPerLevel];
+    long long *levelCount = &count[(size_t)level * pointsPerLevel];
+    for (int lag = firstLag; lag < historyCount[level]; ++lag) {
+        int index = start + lag;
+        const Sample &older = levelHistory[index >= pointsPerLevel ? index - pointsPerLevel : index];
+        if (mode == DotProduct) {
+            levelSum[lag] += sample.x * older.x + sample.y * older.y + sample.z * older.z;
+        } else {
+            double dx = sample.x - older.x, dy = sample.y - older.y, dz = sample.z - older.z;
+            levelSum[lag] += dx * dx + dy * dy + dz * dz;
+        }
+        levelCount[lag]++;
+    }
+
+    if (level + 1 >= levels) return;
+    Sample &total = pending[level];
+    total.x += sample.x;
+    total.y += sample.y;
+    total.z += sample.z;
+    if (++pendingCount[level] == averaging) {
+        Sample average = { total.x / averaging, total.y / averaging, total.z / averaging };
+        total = { 0.0, 0.0, 0.0 };
+        pendingCount[level] = 0;
+        add(average, level + 1);
+    }
+}
+
+void MultipleTauCorrelator::result(std::vector<double> &lags, std::vector<double> &values) const {
+    lags.clear();
+    values.clear();
+    double lagScale = 1.0;
+    for (int level = 0; level < levels; ++level, lagScale *= averaging) {
+        int firstLag = level == 0 ? 0 : pointsPerLevel / averaging;
+        for (int lag = firstLag; lag < pointsPerLevel; ++lag) {
+            size_t index = (size_t)level * pointsPerLevel + lag;
+            if (count[index] == 0) continue;
+            lags.push_back(lag * lagScale);
+            values.push_back(sum[index] / count[index]);
+        }
+    }
+}
+
+// Least squares slope of the MSD over lags from a tenth to all of the longest well sampled one, / 6
+static double msdDiffusion(long long samples, const std::vector<double> &lags, const std::vector<double> &values) {
+    double longestLag = samples / MIN_LAG_WINDOWS;
+    double n = 0.0, sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+    for (size_t i = 0; i < lags.size(); ++i) {
+        if (lags[i] == 0.0 || lags[i] < 0.1 * longestLag || lags[i] > longestLag) continue;
+        n += 1.0;
+        sumX += lags[i];
+        sumY += values[i];
+        sumXX += lags[i] * lags[i];
+        sumXY += lags[i] * values[i];
+    }
+    double denominator = n * sumXX - sumX * sumX;
+    if (n < 2.0 || denominator <= 0.0) return 0.0;
+    return (n * sumXY - sumX * sumY) / denominator / (6.0 * DT);
+}
+
+double greenKuboDiffusion(const std::vector<double> &lags, const std::vector<double> &values) {
+    double integral = 0.0;
+    for (size_t i = 1; i < lags.size(); ++i) {
+        if (values[i] <= 0.0) {
+            if (values[i - 1] > 0.0) {
+                integral += 0.5 * values[i - 1] * values[i - 1] / (values[i - 1] - values[i]) * (lags[i] - lags[i - 1]);
+            }
+            break;
+        }
+        integral += 0.5 * (values[i] + values[i - 1]) * (lags[i] - lags[i - 1]);
+    }
+    return integral * DT / 3.0;
+}
+
+StreamingAnalysis::StreamingAnalysis(const ParticleSystem &particles, Vector3 _periodicLength, AnalysisOptions _options) :
+    options(_options),
+    periodicLength(_periodicLength),
+    trackedParticles(particles.cold.trackedParticles),
+    speedHistogram(std::max(1, options.speedBins), 0)
+{
+    std::vector<bool> isTracked(particles.count, false);
+    for (int id : trackedParticles) {
+        isTracked[id] = true;
+        Vector3 position = particles.position(particles.slotOfId[id]);
+        lastPosition.push_back(position);
+        unwrappedPosition.push_back({ position.x, position.y, position.z });
+        displacement.emplace_back(MultipleTauCorrelator::SquaredDifference, options.pointsPerLevel, options.averaging, options.levels);
+        velocity.emplace_back(MultipleTauCorrelator::DotProduct, options.pointsPerLevel, options.averaging, options.levels);
+    }
+    for (size_t id = 0; id < particles.count; ++id) {
+        if (isTracked[id]) continue;
+        bathParticles.push_back((int)id);
+        float inverseMass = particles.inverseMass[particles.slotOfId[id]];
+        bathMass.push_back(inverseMass > 0.0f ? 1.0f / inverseMass : 0.0f);
+    }
+    if (options.background) {
+        worker = std::thread(&StreamingAnalysis::workLoop, this);
+    }
+}
+
+StreamingAnalysis::~StreamingAnalysis() {
+    if (!worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    worker.join();
+}
+
+void StreamingAnalysis::fillFrame(const ParticleSystem &particles, Frame &frame) const {
+    frame.drift = { 0.0f, 0.0f, 0.0f };
+    if (periodicLength.x > 0.0f && options.removeDrift) {
+        double momentum[3] = { 0.0, 0.0, 0.0 };
+        double mass = 0.0;
+        for (size_t i = 0; i < particles.count; ++i) {
+            if (particles.inverseMass[i] <= 0.0f) continue;
+            double m = 1.0 / particles.inverseMass[i];
+            Vector3 v = particles.getVelocity(i);
+            momentum[0] += m * v.x;
+            momentum[1] += m * v.y;
+            momentum[2] += m * v.z;
+            mass += m;
+        }
+        if (mass > 0.0) {
+            frame.drift = { (float)(momentum[0] / mass), (float)(momentum[1] / mass), (float)(momentum[2] / mass) };
+        }
+    }
+
+    frame.trackedPositions.clear();
+    frame.trackedVelocities.clear();
+    for (int id : trackedParticles) {
+        int i = particles.slotOfId[id];
+        frame.trackedPositions.push_back(particles.position(i));
+        frame.trackedVelocities.push_back(Vector3Subtract(particles.getVelocity(i), frame.drift));
+    }
+    frame.bathSpeedSquared.resize(bathParticles.size());
+    for (size_t b = 0; b < bathParticles.size(); ++b) {
+        Vector3 v = Vector3Subtract(particles.getVelocity(particles.slotOfId[bathParticles[b]]), frame.drift);
+        frame.bathSpeedSquared[b] = v.x * v.x + v.y * v.y + v.z * v.z;
+    }
+}
+
+void StreamingAnalysis::sample(const ParticleSystem &particles) {
+    if (!worker.joinable()) {
+        Frame frame;
+        fillFrame(particles, frame);
+        process(frame);
+        return;
+    }
+
+    Frame frame;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return pending.size() < MAX_PENDING_FRAMES; });
+        if (!spare.empty()) {
+            frame = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+    fillFrame(particles, frame);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(frame));
+    }
+    changed.notify_all();
+}
+
+void StreamingAnalysis::workLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this] { return !pending.empty() || stopping; });
+        if (pending.empty()) return;
+        Frame frame = std::move(pending.front());
+        pending.pop_front();
+        busy = true;
+        lock.unlock();
+        process(frame);
+        lock.lock();
+        busy = false;
+        spare.push_back(std::move(frame));
+        changed.notify_all();
+    }
+}
+
+void StreamingAnalysis::process(const Frame &frame) {
+    for (size_t t = 0; t < trackedParticles.size(); ++t) {
+        // Unwrap by adding each step's displacement, taken to the nearest periodic image
+        Vector3 position = frame.trackedPositions[t];
+        Vector3 step = Vector3Subtract(position, lastPosition[t]);
+        if (periodicLength.x > 0.0f) {
+            step.x -= periodicLength.x * roundf(step.x / periodicLength.x);
+            step.y -= periodicLength.y * roundf(step.y / periodicLength.y);
+            step.z -= periodicLength.z * roundf(step.z / periodicLength.z);
+            step = Vector3Subtract(step, Vector3Scale(frame.drift, DT));
+        }
+        lastPosition[t] = position;
+        MultipleTauCorrelator::Sample &unwrapped = unwrappedPosition[t];
+        unwrapped.x += step.x;
+        unwrapped.y += step.y;
+        unwrapped.z += step.z;
+        displacement[t].add(unwrapped);
+
+        Vector3 v = frame.trackedVelocities[t];
+        velocity[t].add({ v.x, v.y, v.z });
+    }
+
+    double kineticEnergy = 0.0;
+    int movingParticles = 0;
+    int lastBin = (int)speedHistogram.size() - 1;
+    for (size_t b = 0; b < frame.bathSpeedSquared.size(); ++b) {
+        float speedSquared = frame.bathSpeedSquared[b];
+        int bin = (int)(sqrtf(speedSquared) / options.speedBinWidth);
+        speedHistogram[std::min(bin, lastBin)]++;
+        if (bathMass[b] > 0.0f) {
+            kineticEnergy += 0.5 * bathMass[b] * speedSquared;
+            movingParticles++;
+        }
+    }
+    temperature = movingParticles > 0 ? 2.0 / 3.0 * kineticEnergy / movingParticles : 0.0;
+    temperatureSum += temperature;
+    samples++;
+}
+
+AnalysisReport StreamingAnalysis::report() {
+    if (worker.joinable()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return pending.empty() && !busy; });
+    }
+
+    AnalysisReport report;
+    report.samples = samples;
+    report.speedHistogram = speedHistogram;
+    report.speedBinWidth = options.speedBinWidth;
+    report.temperature = temperature;
+    report.meanTemperature = samples > 0 ? temperatureSum / samples : 0.0;
+    for (size_t t = 0; t < trackedParticles.size(); ++t) {
+        TrackedAnalysis tracked;
+        tracked.particle = trackedParticles[t];
+        displacement[t].result(tracked.lags, tracked.meanSquaredDisplacement);
+        velocity[t].result(tracked.vacfLags, tracked.velocityAutocorrelation);
+        tracked.diffusionFromMsd = msdDiffusion(samples, tracked.lags, tracked.meanSquaredDisplacement);
+        tracked.diffusionFromVacf = greenKuboDiffusion(tracked.vacfLags, tracked.velocityAutocorrelation);
+        report.tracked.push_back(std::move(tracked));
+    }
+    return report;
+}
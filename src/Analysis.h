@@ -0,0 +1,141 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ParticleSystem.h"
+
+// Online estimators that are fed the particles once per step and use memory independent of run length.
+
+// Multiple-tau correlator (Ramirez, Sukumaran, Vorselaars and Likhtman, 2010) over 3-vector samples.
+// Level 0 keeps the last pointsPerLevel samples and correlates them at lags 0 .. pointsPerLevel - 1.
+// Every `averaging` samples of a level are averaged and passed up to the next, so level k covers lags
+// up to pointsPerLevel * averaging^k with the same amount of memory.
+struct MultipleTauCorrelator {
+    enum Mode {
+        DotProduct,        // <a(t) . a(t + lag)>, e.g. the velocity autocorrelation
+        SquaredDifference  // <|a(t + lag) - a(t)|^2>, e.g. the mean squared displacement of positions
+    };
+
+    struct Sample {
+        double x, y, z;
+    };
+
+    Mode mode;
+    int pointsPerLevel;
+    int averaging;
+    int levels;
+
+    std::vector<Sample> history;        // pointsPerLevel per level, newest at historyStart
+    std::vector<int> historyStart;
+    std::vector<int> historyCount;
+    std::vector<double> sum;            // pointsPerLevel per level, indexed by lag in units of the level
+    std::vector<long long> count;
+    std::vector<Sample> pending;        // running sum of the samples to be averaged into the next level
+    std::vector<int> pendingCount;
+
+    MultipleTauCorrelator(Mode _mode, int _pointsPerLevel = 16, int _averaging = 2, int _levels = 24);
+
+    void add(Sample sample);
+
+    // Lags in samples and the correlation at each, skipping lags without data yet
+    void result(std::vector<double> &lags, std::vector<double> &values) const;
+
+private:
+    void add(Sample sample, int level);
+};
+
+// Green-Kubo: D = 1/3 of the integral of the VACF, trapezoids up to its first zero crossing.
+// Past that it is mostly noise, which the widely spaced long lags would otherwise add up.
+double greenKuboDiffusion(const std::vector<double> &lags, const std::vector<double> &values);
+
+// Bin i of the speed histogram counts speeds in [i * binWidth, (i + 1) * binWidth), the last bin anything above
+struct AnalysisOptions {
+    int pointsPerLevel = 16;
+    int averaging = 2;
+    int levels = 24;
+    float speedBinWidth = 0.01f;
+    int speedBins = 100;
+    bool background = false;  // run the estimators on their own thread, sample() then only copies the velocities
+    // Measure against the centre of mass in a periodic box. Off for an implicit solvent, whose particles don't
+    // conserve momentum, so their own motion is the drift.
+    bool removeDrift = true;
+};
+
+struct TrackedAnalysis {
+    int particle;
+    std::vector<double> lags;  // in DT
+    std::vector<double> meanSquaredDisplacement;
+    std::vector<double> vacfLags;
+    std::vector<double> velocityAutocorrelation;
+    double diffusionFromMsd;   // slope of the MSD over the longer lags / 6
+    double diffusionFromVacf;  // Green-Kubo integral of the VACF / 3
+};
+
+struct AnalysisReport {
+    long long samples = 0;
+    std::vector<TrackedAnalysis> tracked;
+    std::vector<long long> speedHistogram;
+    float speedBinWidth = 0.0f;
+    double temperature = 0.0;         // of the bath at the last sample, 2/3 of the mean kinetic energy
+    double meanTemperature = 0.0;     // averaged over all samples
+};
+
+// Diffusion of the tracked particles (ParticleColdData::trackedParticles) and the state of the bath
+// (every other particle). Positions of tracked particles are unwrapped, so a periodic boundary is fine.
+// Momentum is conserved in a periodic box, so any drift of the whole system would show up as ballistic
+// motion; there all velocities and displacements are taken relative to the centre of mass (see removeDrift).
+class StreamingAnalysis {
+public:
+    StreamingAnalysis(const ParticleSystem &particles, Vector3 periodicLength, AnalysisOptions options = {});
+    ~StreamingAnalysis();
+
+    StreamingAnalysis(const StreamingAnalysis &) = delete;
+    StreamingAnalysis &operator=(const StreamingAnalysis &) = delete;
+
+    // Call once per step, after it
+    void sample(const ParticleSystem &particles);
+    // Waits for the background thread to catch up, then computes the estimates
+    AnalysisReport report();
+
+private:
+    struct Frame {
+        std::vector<Vector3> trackedPositions;
+        std::vector<Vector3> trackedVelocities;
+        std::vector<float> bathSpeedSquared;
+        Vector3 drift;  // centre of mass velocity subtracted from the others, zero unless periodic
+    };
+
+    void fillFrame(const ParticleSystem &particles, Frame &frame) const;
+    void process(const Frame &frame);
+    void workLoop();
+
+    AnalysisOptions options;
+    Vector3 periodicLength;
+    std::vector<int> trackedParticles;  // ids, so the analysis follows particles through reorders
+    std::vector<int> bathParticles;
+    std::vector<float> bathMass;  // 0 for immovable particles, which are left out of the temperature
+
+    // Estimator state, only touched by whichever thread runs process()
+    std::vector<Vector3> lastPosition;
+    std::vector<MultipleTauCorrelator::Sample> unwrappedPosition;
+    std::vector<MultipleTauCorrelator> displacement;
+    std::vector<MultipleTauCorrelator> velocity;
+    std::vector<long long> speedHistogram;
+    long long samples = 0;
+    double temperature = 0.0;
+    double temperatureSum = 0.0;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Frame> pending;
+    std::vector<Frame> spare;
+    bool busy = false;  // the worker is processing a frame it took off pending
+    bool stopping = false;
+    std::thread worker;
+};
+
+#endif // ANALYSIS_H
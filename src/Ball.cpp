@@ -43,10 +43,6 @@ void Ball3d::handleWallCollision(Wall &wall) {
     }
 }
 
-void Ball3d::draw() {
-    DrawSphere(position, radius, color);
-}
-
 void handleBallCollision(Ball3d &ball1, Ball3d &ball2) {
     float distance = Vector3Distance(ball1.position, ball2.position);
     if (distance > (ball1.radius + ball2.radius)) {
@@ -0,0 +1,71 @@
+#include "Boundary.h"
+#include <cmath>
+
+Vector3 Boundary::periodicLength() const {
+    if (type != BoundaryType::Periodic) {
+        return { 0.0f, 0.0f, 0.0f };
+    }
+    return Vector3Subtract(boxMax, boxMin);
+}
+
+void Boundary::apply(ParticleSystem &particles, size_t begin, size_t end) const {
+    ParticleKernelArrays arrays = kernelArrays(particles);
+    switch (type) {
+        case BoundaryType::Planes: wallKernel(arrays, planes.data(), (int)planes.size(), begin, end); break;
+        case BoundaryType::AxisAlignedBox: boxKernel(arrays, boxMin, boxMax, begin, end); break;
+        case BoundaryType::Periodic: periodicKernel(arrays, boxMin, boxMax, begin, end); break;
+    }
+}
+
+Boundary planeBoundary(const std::vector<Wall> &walls) {
+    Boundary boundary;
+    boundary.type = BoundaryType::Planes;
+    boundary.planes = wallPlanes(walls);
+    return boundary;
+}
+
+Boundary boundaryFromWalls(const std::vector<Wall> &walls) {
+    Boundary boundary = planeBoundary(walls);
+
+    // The rotations are in degrees, so an axis-aligned normal is only axis-aligned to within float rounding
+    const float tolerance = 1e-4f;
+    bool hasMin[3] = { false, false, false };
+    bool hasMax[3] = { false, false, false };
+    float minimum[3];
+    float maximum[3];
+    for (size_t w = 0; w < walls.size(); ++w) {
+        float normal[3] = { boundary.planes[w].normal.x, boundary.planes[w].normal.y, boundary.planes[w].normal.z };
+        float center[3] = { walls[w].centerPosition.x, walls[w].centerPosition.y, walls[w].centerPosition.z };
+        int axis = -1;
+        for (int a = 0; a < 3; ++a) {
+            if (fabsf(fabsf(normal[a]) - 1.0f) < tolerance) axis = a;
+        }
+        if (axis < 0) return boundary;
+
+        if (normal[axis] > 0.0f && !hasMin[axis]) {
+            hasMin[axis] = true;
+            minimum[axis] = center[axis];
+        } else if (normal[axis] < 0.0f && !hasMax[axis]) {
+            hasMax[axis] = true;
+            maximum[axis] = center[axis];
+        } else {
+            return boundary;
+        }
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        if (!hasMin[axis] || !hasMax[axis] || minimum[axis] >= maximum[axis]) return boundary;
+    }
+
+    boundary.type = BoundaryType::AxisAlignedBox;
+    boundary.boxMin = { minimum[0], minimum[1], minimum[2] };
+    boundary.boxMax = { maximum[0], maximum[1], maximum[2] };
+    return boundary;
+}
+
+Boundary periodicBoundary(Vector3 boxMin, Vector3 boxMax) {
+    Boundary boundary;
+    boundary.type = BoundaryType::Periodic;
+    boundary.boxMin = boxMin;
+    boundary.boxMax = boxMax;
+    return boundary;
+}
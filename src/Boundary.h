@@ -0,0 +1,36 @@
+#ifndef BOUNDARY_H
+#define BOUNDARY_H
+
+#include <vector>
+#include "Objects.h"
+#include "ParticleSystem.h"
+#include "SimdKernels.h"
+
+enum class BoundaryType {
+    Planes,          // any set of walls, one half-space each
+    AxisAlignedBox,  // six axis-aligned walls, handled with min/max compares
+    Periodic         // no walls, particles leaving one side come back in on the other
+};
+
+// What keeps the particles in the room, worked out once from the walls instead of on every query.
+// Planes are stored in half-space form n.p >= offset, with n the unit normal pointing into the room.
+struct Boundary {
+    BoundaryType type = BoundaryType::Planes;
+    std::vector<WallPlane> planes;
+    Vector3 boxMin = { 0.0f, 0.0f, 0.0f };  // AxisAlignedBox and Periodic only
+    Vector3 boxMax = { 0.0f, 0.0f, 0.0f };
+
+    // Size of the periodic box, zero when the boundary is not periodic
+    Vector3 periodicLength() const;
+
+    // Wall collisions for particles [begin, end), or wrapping them back into the box when periodic
+    void apply(ParticleSystem &particles, size_t begin, size_t end) const;
+};
+
+// Uses the axis-aligned box fast path when the walls are one min and one max plane per axis (as with cubeRoom),
+// otherwise the general planes
+Boundary boundaryFromWalls(const std::vector<Wall> &walls);
+Boundary planeBoundary(const std::vector<Wall> &walls);
+Boundary periodicBoundary(Vector3 boxMin, Vector3 boxMax);
+
+#endif // BOUNDARY_H
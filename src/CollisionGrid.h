@@ -2,50 +2,565 @@
 #define COLLISION_GRID_H
 
 #include "Objects.h"
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
 
-struct GridCell {
-    std::vector<int> ballIndices;
-    void clearBalls() {
-        ballIndices.clear();
-    }
+// Spreads the low 21 bits of value so there are two zero bits between each of them
+inline uint64_t spreadMortonBits(uint32_t value) {
+    uint64_t bits = value & 0x1fffff;
+    bits = (bits | bits << 32) & 0x1f00000000ffffULL;
+    bits = (bits | bits << 16) & 0x1f0000ff0000ffULL;
+    bits = (bits | bits << 8) & 0x100f00f00f00f00fULL;
+    bits = (bits | bits << 4) & 0x10c30c30c30c30c3ULL;
+    bits = (bits | bits << 2) & 0x1249249249249249ULL;
+    return bits;
+}
+
+// Position of the cell (x, y, z) along a Z-order curve, cells close in space get close codes
+inline uint64_t mortonCode(int x, int y, int z) {
+    return spreadMortonBits((uint32_t)x) | spreadMortonBits((uint32_t)y) << 1 | spreadMortonBits((uint32_t)z) << 2;
+}
+
+// How a CollisionGrid stores its cells
+enum class GridStorage {
+    Automatic,  // Hashed when a dense grid would have more than DENSE_CELLS_PER_BALL cells per ball
+    Dense,      // every cell of the box, indexed by its coordinates
+    Hashed      // only the occupied cells, looked up in a hash table by their coordinates
+};
+
+const double DENSE_CELLS_PER_BALL = 8.0;
+
+// Cell coordinates of a hashed grid are packed into 21 bits each, offset by this so they can be negative
+const int HASHED_COORDINATE_OFFSET = 1 << 20;
+const uint64_t EMPTY_CELL_KEY = ~0ULL;
+
+// Entry of a hashed grid's cell table
+struct HashedCell {
+    uint64_t key;
+    int cell;
 };
 
+// Uniform grid used as the broad phase for ball-ball collisions.
+// Balls are binned with a counting sort, so every cell is a contiguous run of sortedBallIndices
+// starting at cellStart[cell] with cellCount[cell] entries. Cells are at least one ball diameter wide,
+// so a ball can only touch balls in its own cell or one of the 26 cells around it.
+//
+// For parallel collision handling the non-empty cells are also listed by colour, (x % 3, y % 3, z % 3).
+// A cell's pairs only involve cells at most one away, so two cells of the same colour never share a ball
+// and can be handled at the same time. Going through the colours in order gives the same result
+// whatever the number of threads.
+//
+// A periodic grid wraps around on every axis, so cells on opposite faces are neighbours. It needs at least three
+// cells along each axis, a multiple of three so the colouring still works across the wrap. One cut down to a slab
+// of the box (see slabOfGrid) is boundedX: it only wraps y and z, and along x it is bounded like a room grid.
+//
+// A hashed grid numbers only the occupied cells, in the same order as a dense one, and finds a cell from
+// its coordinates through an open addressing table, so memory and rebuild time follow the number of balls
+// rather than the volume. Without periodic wrapping it is unbounded: balls outside the box get cells of their
+// own instead of piling into the border cells (up to HASHED_COORDINATE_OFFSET cells away).
 struct CollisionGrid {
     float cellSize;
     int numberCellsX;
     int numberCellsY;
     int numberCellsZ;
     Vector3 startingPosition;
-    std::vector<GridCell> cells;  // Use a flattened grid for memory efficiency
+    bool periodic = false;
+    bool boundedX = false;  // periodic grids only, see above
+    bool hashed = false;
+    std::vector<int> cellStart;  // numberCells() + 1 entries, the last one is the number of balls
+    std::vector<int> cellCount;
+    std::vector<int> ballCells;  // cell of each ball at the last rebuild
+    std::vector<int> sortedBallIndices;
+    std::vector<int> occupiedCells;  // non-empty cells grouped by colour, in index order within a colour
+    std::vector<int> colourStart;    // occupiedCells of colour c are [colourStart[c], colourStart[c + 1])
 
-    int getGridIndex(int x, int y, int z) {
+    // Hashed storage only
+    std::vector<uint64_t> cellKeys;   // packed coordinates of each cell
+    std::vector<uint64_t> ballKeys;   // cell of each ball until sortBallsByCell numbers the cells
+    std::vector<HashedCell> table;    // open addressing with linear probing, EMPTY_CELL_KEY in free slots
+
+    static constexpr int numberCellColours = 27;
+
+    // Cells that have an index: all of them when dense, the occupied ones when hashed
+    int numberCells() const {
+        if (hashed) return (int)cellKeys.size();
+        return numberCellsX * numberCellsY * numberCellsZ;
+    }
+
+    int getGridIndex(int x, int y, int z) const {
         return x + y * numberCellsX + z * numberCellsX * numberCellsY;
     }
 
-    void addBallToGrid(Ball3d &ball, int ballIndex) {
-        Vector3 ballGridPostion = Vector3Subtract(ball.position, startingPosition);
-        int cellIndex = getGridIndex(
-            floor(ballGridPostion.x / cellSize), 
-            floor(ballGridPostion.y / cellSize), 
-            floor(ballGridPostion.z / cellSize)
-        );
-        cells[cellIndex].ballIndices.push_back(ballIndex);
+    static uint64_t cellKey(int x, int y, int z) {
+        return (uint64_t)(x + HASHED_COORDINATE_OFFSET) | (uint64_t)(y + HASHED_COORDINATE_OFFSET) << 21
+               | (uint64_t)(z + HASHED_COORDINATE_OFFSET) << 42;
+    }
+
+    size_t tableSlot(uint64_t key) const {
+        // The row (y, z) is hashed and x added on, so the cells of a row sit in neighbouring slots and the x - 1, x, x + 1
+        // lookups of a neighbourhood share cache lines
+        return (size_t)(((key >> 21) * 0x9e3779b97f4a7c15ULL >> 32) + (key & 0x1fffff)) & (table.size() - 1);
+    }
+
+    // Index of the cell at these (wrapped) coordinates, -1 for an empty cell of a hashed grid
+    int cellAt(int x, int y, int z) const {
+        if (!hashed) return getGridIndex(x, y, z);
+        if (table.empty()) return -1;
+        uint64_t key = cellKey(x, y, z);
+        for (size_t slot = tableSlot(key);; slot = (slot + 1) & (table.size() - 1)) {
+            if (table[slot].key == key) return table[slot].cell;
+            if (table[slot].key == EMPTY_CELL_KEY) return -1;
+        }
+    }
+
+    void cellCoordinates(int cell, int &x, int &y, int &z) const {
+        if (hashed) {
+            x = (int)(cellKeys[cell] & 0x1fffff) - HASHED_COORDINATE_OFFSET;
+            y = (int)(cellKeys[cell] >> 21 & 0x1fffff) - HASHED_COORDINATE_OFFSET;
+            z = (int)(cellKeys[cell] >> 42 & 0x1fffff) - HASHED_COORDINATE_OFFSET;
+            return;
+        }
+        x = cell % numberCellsX;
+        y = (cell / numberCellsX) % numberCellsY;
+        z = cell / (numberCellsX * numberCellsY);
+    }
+
+    bool wrapsX() const { return periodic && !boundedX; }
+
+    // Balls that have drifted outside the grid are kept in the border cells, or wrapped around along an axis that
+    // wraps. A hashed grid has no border along an axis that does not wrap.
+    int cellCoordinate(float offset, int numberCellsAlongAxis, bool wraps) const {
+        if (hashed && !wraps) {
+            float coordinate = floorf(offset / cellSize);
+            return (int)std::clamp(coordinate, (float)-HASHED_COORDINATE_OFFSET, (float)(HASHED_COORDINATE_OFFSET - 1));
+        }
+        int coordinate = (int)floorf(offset / cellSize);
+        if (wraps) {
+            coordinate %= numberCellsAlongAxis;
+            return coordinate < 0 ? coordinate + numberCellsAlongAxis : coordinate;
+        }
+        return std::clamp(coordinate, 0, numberCellsAlongAxis - 1);
+    }
+
+    void cellCoordinatesOf(Vector3 position, int &x, int &y, int &z) const {
+        Vector3 gridPosition = Vector3Subtract(position, startingPosition);
+        x = cellCoordinate(gridPosition.x, numberCellsX, wrapsX());
+        y = cellCoordinate(gridPosition.y, numberCellsY, periodic);
+        z = cellCoordinate(gridPosition.z, numberCellsZ, periodic);
+    }
+
+    // Size of the box a periodic grid wraps around, zero along the axes it does not wrap
+    Vector3 periodicLength() const {
+        if (!periodic) return { 0.0f, 0.0f, 0.0f };
+        return { wrapsX() ? cellSize * numberCellsX : 0.0f, cellSize * numberCellsY, cellSize * numberCellsZ };
     }
-    
-    void clearCells() {
-        for (GridCell &cell : cells) {
-            cell.clearBalls();
+
+    // Morton code of the cell a position falls in, whether or not the cell is occupied
+    uint64_t mortonCodeOf(Vector3 position) const {
+        int x, y, z;
+        cellCoordinatesOf(position, x, y, z);
+        if (hashed) {
+            x += HASHED_COORDINATE_OFFSET;
+            y += HASHED_COORDINATE_OFFSET;
+            z += HASHED_COORDINATE_OFFSET;
+        }
+        return mortonCode(x, y, z);
+    }
+
+    // -1 when a hashed grid has no balls in the cell
+    int cellIndexOf(Vector3 position) const {
+        int x, y, z;
+        cellCoordinatesOf(position, x, y, z);
+        return cellAt(x, y, z);
+    }
+
+    // Makes room for nBalls balls, to be placed with assignCell or leaveOut before sortBallsByCell
+    void resizeBalls(int nBalls) {
+        ballCells.resize(nBalls);
+        if (hashed) ballKeys.resize(nBalls);
+    }
+
+    // Independent per ball so it can be split across threads
+    void assignCell(int i, Vector3 position) {
+        if (!hashed) {
+            ballCells[i] = cellIndexOf(position);
+            return;
+        }
+        int x, y, z;
+        cellCoordinatesOf(position, x, y, z);
+        ballKeys[i] = cellKey(x, y, z);
+    }
+
+    void leaveOut(int i) {
+        ballCells[i] = -1;
+        if (hashed) ballKeys[i] = EMPTY_CELL_KEY;
+    }
+
+    // Works out the cell of balls [begin, end), after resizeBalls
+    template <typename PositionOf>
+    void assignCells(int begin, int end, PositionOf positionOf) {
+        for (int i = begin; i < end; ++i) {
+            assignCell(i, positionOf(i));
+        }
+    }
+
+    // Numbers the cells in ballKeys, filling ballCells and the table. The table is kept at most half full.
+    void numberHashedCells() {
+        size_t capacity = 16;
+        while (capacity < 2 * cellKeys.size()) capacity *= 2;
+        cellKeys.clear();
+        table.assign(capacity, { EMPTY_CELL_KEY, -1 });
+        for (size_t i = 0; i < ballKeys.size(); ++i) {
+            uint64_t key = ballKeys[i];
+            if (key == EMPTY_CELL_KEY) {
+                ballCells[i] = -1;
+                continue;
+            }
+            size_t slot = tableSlot(key);
+            while (table[slot].key != key && table[slot].key != EMPTY_CELL_KEY) {
+                slot = (slot + 1) & (table.size() - 1);
+            }
+            if (table[slot].key == key) {
+                ballCells[i] = table[slot].cell;
+                continue;
+            }
+            ballCells[i] = (int)cellKeys.size();
+            table[slot] = { key, ballCells[i] };
+            cellKeys.push_back(key);
+            if (2 * cellKeys.size() > table.size()) growTable();
+        }
+
+        // Renumbered in key order, which is z, y, x order like a dense grid, so the cells of a row and the balls in
+        // them stay close in memory and pairs are resolved in the same order as with dense storage
+        std::vector<int> byKey(cellKeys.size());
+        std::iota(byKey.begin(), byKey.end(), 0);
+        std::sort(byKey.begin(), byKey.end(), [this](int a, int b) { return cellKeys[a] < cellKeys[b]; });
+        std::vector<int> renumbered(cellKeys.size());
+        for (size_t cell = 0; cell < byKey.size(); ++cell) {
+            renumbered[byKey[cell]] = (int)cell;
+        }
+        std::vector<uint64_t> sortedKeys(cellKeys.size());
+        for (size_t cell = 0; cell < byKey.size(); ++cell) {
+            sortedKeys[cell] = cellKeys[byKey[cell]];
+        }
+        cellKeys = std::move(sortedKeys);
+        for (HashedCell &entry : table) {
+            if (entry.cell >= 0) entry.cell = renumbered[entry.cell];
+        }
+        for (int &cell : ballCells) {
+            if (cell >= 0) cell = renumbered[cell];
         }
+        cellStart.resize(cellKeys.size() + 1);
+        cellCount.resize(cellKeys.size());
     }
 
-    CollisionGrid(float _cellSize, int nX, int nY, int nZ, Vector3 _startingPosition) :
+    void growTable() {
+        table.assign(2 * table.size(), { EMPTY_CELL_KEY, -1 });
+        for (size_t cell = 0; cell < cellKeys.size(); ++cell) {
+            size_t slot = tableSlot(cellKeys[cell]);
+            while (table[slot].key != EMPTY_CELL_KEY) {
+                slot = (slot + 1) & (table.size() - 1);
+            }
+            table[slot] = { cellKeys[cell], (int)cell };
+        }
+    }
+
+    // Counting sort of the balls by the cells in ballCells (ballKeys when hashed). Stable, so balls in a cell stay
+    // in index order. Balls with a negative cell are left out of the grid.
+    void sortBallsByCell() {
+        if (hashed) numberHashedCells();
+        int nBalls = (int)ballCells.size();
+        std::fill(cellCount.begin(), cellCount.end(), 0);
+
+        for (int i = 0; i < nBalls; ++i) {
+            if (ballCells[i] >= 0) cellCount[ballCells[i]]++;
+        }
+
+        int runningTotal = 0;
+        for (int cell = 0; cell < numberCells(); ++cell) {
+            cellStart[cell] = runningTotal;
+            runningTotal += cellCount[cell];
+        }
+        cellStart[numberCells()] = runningTotal;
+        sortedBallIndices.resize(runningTotal);
+
+        // cellStart is used as the insertion cursor here and restored below
+        for (int i = 0; i < nBalls; ++i) {
+            if (ballCells[i] >= 0) sortedBallIndices[cellStart[ballCells[i]]++] = i;
+        }
+        for (int cell = 0; cell < numberCells(); ++cell) {
+            cellStart[cell] -= cellCount[cell];
+        }
+
+        listOccupiedCellsByColour();
+    }
+
+    void listOccupiedCellsByColour() {
+        std::fill(colourStart.begin(), colourStart.end(), 0);
+        forEachCellWithColour([this](int cell, int colour) {
+            if (cellCount[cell] > 0) colourStart[colour + 1]++;
+        });
+        for (int colour = 0; colour < numberCellColours; ++colour) {
+            colourStart[colour + 1] += colourStart[colour];
+        }
+
+        occupiedCells.resize(colourStart[numberCellColours]);
+        int colourCursor[numberCellColours];
+        std::copy(colourStart.begin(), colourStart.end() - 1, colourCursor);
+        forEachCellWithColour([this, &colourCursor](int cell, int colour) {
+            if (cellCount[cell] > 0) occupiedCells[colourCursor[colour]++] = cell;
+        });
+    }
+
+    // Visits the cells in index order without dividing to find each one's colour (unless hashed)
+    template <typename CellFunction>
+    void forEachCellWithColour(CellFunction cellFunction) const {
+        if (hashed) {
+            for (int cell = 0; cell < numberCells(); ++cell) {
+                int x, y, z;
+                cellCoordinates(cell, x, y, z);
+                // Coordinates outside an unbounded grid's box can be negative
+                cellFunction(cell, (x % 3 + 3) % 3 + 3 * ((y % 3 + 3) % 3) + 9 * ((z % 3 + 3) % 3));
+            }
+            return;
+        }
+        int cell = 0;
+        for (int z = 0; z < numberCellsZ; ++z) {
+            for (int y = 0; y < numberCellsY; ++y) {
+                int rowColour = 3 * (y % 3) + 9 * (z % 3);
+                for (int x = 0; x < numberCellsX; ++x, ++cell) {
+                    cellFunction(cell, rowColour + x % 3);
+                }
+            }
+        }
+    }
+
+    // Counting sort of the balls into their cells, positionOf(i) gives the position of ball i
+    template <typename PositionOf>
+    void rebuild(int nBalls, PositionOf positionOf) {
+        resizeBalls(nBalls);
+        assignCells(0, nBalls, positionOf);
+        sortBallsByCell();
+    }
+
+    void rebuild(const std::vector<Ball3d> &balls) {
+        rebuild((int)balls.size(), [&balls](int i) { return balls[i].position; });
+    }
+
+    // Calls cellFunction(neighbour) for each of the 13 neighbours "ahead" of the cell, those after it in the
+    // order z, y, x. Pairing a cell with itself and these covers the 27 cell neighbourhood without visiting any pair
+    // of cells twice. Empty neighbours of a hashed grid are skipped.
+    template <typename CellFunction>
+    void forEachCellAhead(int cell, CellFunction cellFunction) const {
+        int x, y, z;
+        cellCoordinates(cell, x, y, z);
+
+        for (int dz = 0; dz <= 1; ++dz) {
+            for (int dy = (dz == 0 ? 0 : -1); dy <= 1; ++dy) {
+                for (int dx = (dz == 0 && dy == 0 ? 1 : -1); dx <= 1; ++dx) {
+                    int nx = x + dx;
+                    int ny = y + dy;
+                    int nz = z + dz;
+                    if (periodic) {
+                        if (wrapsX()) {
+                            nx = nx < 0 ? nx + numberCellsX : nx == numberCellsX ? 0 : nx;
+                        } else if (!hashed && (nx < 0 || nx >= numberCellsX)) {
+                            continue;
+                        }
+                        ny = ny < 0 ? ny + numberCellsY : ny == numberCellsY ? 0 : ny;
+                        nz = nz == numberCellsZ ? 0 : nz;
+                    } else if (hashed) {
+                        // Unbounded
+                    } else if (nx < 0 || nx >= numberCellsX || ny < 0 || ny >= numberCellsY || nz >= numberCellsZ) {
+                        continue;
+                    }
+                    int neighbour = cellAt(nx, ny, nz);
+                    if (neighbour >= 0) cellFunction(neighbour);
+                }
+            }
+        }
+    }
+
+    // Calls pairFunction(i, j) for every pair of balls with the first one in the given cell and the second one
+    // in the same cell or one of the cells ahead of it
+    template <typename PairFunction>
+    void forEachPairFromCell(PairFunction pairFunction, int cell) const {
+        int start = cellStart[cell];
+        int end = cellStart[cell + 1];
+        if (start == end) return;
+
+        for (int a = start; a < end; ++a) {
+            for (int b = a + 1; b < end; ++b) {
+                pairFunction(sortedBallIndices[a], sortedBallIndices[b]);
+            }
+        }
+
+        forEachCellAhead(cell, [this, &pairFunction, start, end](int neighbour) {
+            int neighbourStart = cellStart[neighbour];
+            int neighbourEnd = cellStart[neighbour + 1];
+            for (int a = start; a < end; ++a) {
+                for (int b = neighbourStart; b < neighbourEnd; ++b) {
+                    pairFunction(sortedBallIndices[a], sortedBallIndices[b]);
+                }
+            }
+        });
+    }
+
+    // Cells along one axis that overlap [low, high] (offsets from startingPosition) as first .. last.
+    // Along an axis that wraps these are not wrapped yet, see wrapCoordinate, and never cover the same cell twice.
+    void cellRange(float low, float high, int numberCellsAlongAxis, bool wraps, int &first, int &last) const {
+        if (!wraps) {
+            first = cellCoordinate(low, numberCellsAlongAxis, false);
+            last = cellCoordinate(high, numberCellsAlongAxis, false);
+            return;
+        }
+        first = (int)floorf(low / cellSize);
+        last = (int)floorf(high / cellSize);
+        if (last - first + 1 >= numberCellsAlongAxis) {
+            first = 0;
+            last = numberCellsAlongAxis - 1;
+        }
+    }
+
+    int wrapCoordinate(int coordinate, int numberCellsAlongAxis, bool wraps) const {
+        if (!wraps) return coordinate;
+        coordinate %= numberCellsAlongAxis;
+        return coordinate < 0 ? coordinate + numberCellsAlongAxis : coordinate;
+    }
+
+    // Calls ballFunction(i) once for every ball in a cell that overlaps the box [low, high]
+    template <typename BallFunction>
+    void forEachBallInBox(Vector3 low, Vector3 high, BallFunction ballFunction) const {
+        int firstX, lastX, firstY, lastY, firstZ, lastZ;
+        cellRange(low.x - startingPosition.x, high.x - startingPosition.x, numberCellsX, wrapsX(), firstX, lastX);
+        cellRange(low.y - startingPosition.y, high.y - startingPosition.y, numberCellsY, periodic, firstY, lastY);
+        cellRange(low.z - startingPosition.z, high.z - startingPosition.z, numberCellsZ, periodic, firstZ, lastZ);
+        for (int z = firstZ; z <= lastZ; ++z) {
+            int cellZ = wrapCoordinate(z, numberCellsZ, periodic);
+            for (int y = firstY; y <= lastY; ++y) {
+                int cellY = wrapCoordinate(y, numberCellsY, periodic);
+                for (int x = firstX; x <= lastX; ++x) {
+                    int cell = cellAt(wrapCoordinate(x, numberCellsX, wrapsX()), cellY, cellZ);
+                    if (cell < 0) continue;
+                    for (int a = cellStart[cell]; a < cellStart[cell + 1]; ++a) {
+                        ballFunction(sortedBallIndices[a]);
+                    }
+                }
+            }
+        }
+    }
+
+    // Calls pairFunction(i, j) once for every pair of balls in the same or adjacent cells
+    template <typename PairFunction>
+    void forEachNeighbourPair(PairFunction pairFunction) const {
+        for (int cell : occupiedCells) {
+            forEachPairFromCell(pairFunction, cell);
+        }
+    }
+
+    // Same as above, restricted to pairs whose first ball is in a cell in [cellBegin, cellEnd)
+    template <typename PairFunction>
+    void forEachNeighbourPair(PairFunction pairFunction, int cellBegin, int cellEnd) const {
+        for (int cell = cellBegin; cell < cellEnd; ++cell) {
+            forEachPairFromCell(pairFunction, cell);
+        }
+    }
+
+    // A hashed grid only allocates cells as balls land in them
+    CollisionGrid(float _cellSize, int nX, int nY, int nZ, Vector3 _startingPosition, bool _hashed = false) :
         cellSize(_cellSize),
         numberCellsX(nX),
         numberCellsY(nY),
         numberCellsZ(nZ),
         startingPosition(_startingPosition),
-        cells(numberCellsX * numberCellsY * numberCellsZ)
+        hashed(_hashed),
+        cellStart(_hashed ? 1 : numberCellsX * numberCellsY * numberCellsZ + 1),
+        cellCount(_hashed ? 0 : numberCellsX * numberCellsY * numberCellsZ),
+        colourStart(numberCellColours + 1)
     {}
 };
 
+// One level of a grid hierarchy for strongly mixed radii. A single grid needs cells as wide as the largest ball,
+// which crowds many small balls into every cell. Instead the small balls get a fine grid and each larger size
+// class gets its own coarser level holding only the balls of that class.
+// Pairs within a level are found as usual; a ball meets the smaller balls of the levels below by looking up
+// the cells its bounding box (grown by their largest radius) overlaps.
+struct GridLevel {
+    float minRadius;  // balls in this level have minRadius < radius <= maxRadius
+    float maxRadius;
+    CollisionGrid grid;  // cells one diameter of maxRadius wide, indices into members
+    std::vector<int> members;  // balls binned in this level at the last rebuild
+};
+
+inline float largestRadius(const std::vector<Ball3d> &balls) {
+    float radius = 0.0f;
+    for (const Ball3d &ball : balls) {
+        radius = std::max(radius, ball.radius);
+    }
+    return radius;
+}
+
+// Dense grids smaller than this are cheap enough to keep whatever the number of balls
+const double DENSE_CELLS_ALWAYS = 1 << 20;
+
+// Resolves GridStorage::Automatic for a grid of numberCells cells holding numberBalls balls
+inline bool useHashedStorage(GridStorage storage, double numberCells, size_t numberBalls) {
+    if (storage != GridStorage::Automatic) return storage == GridStorage::Hashed;
+    return numberCells > DENSE_CELLS_ALWAYS && numberCells > DENSE_CELLS_PER_BALL * numberBalls;
+}
+
+// Grid covering a room laid out like cubeRoom (bottom wall centered at the origin).
+// Cells are one diameter of the largest ball wide.
+inline CollisionGrid gridForRoom(Vector3 roomDimensions, float maxRadius, GridStorage storage = GridStorage::Dense,
+                                 size_t numberBalls = 0) {
+    float cellSize = std::max(2.0f * maxRadius, 1e-3f);
+    int nX = std::max(1, (int)ceilf(roomDimensions.x / cellSize));
+    int nY = std::max(1, (int)ceilf(roomDimensions.y / cellSize));
+    int nZ = std::max(1, (int)ceilf(roomDimensions.z / cellSize));
+    bool hashed = useHashedStorage(storage, (double)nX * nY * nZ, numberBalls);
+    return CollisionGrid(cellSize, nX, nY, nZ, { -0.5f * roomDimensions.x, 0.0f, -0.5f * roomDimensions.z }, hashed);
+}
+
+// Periodic grid over the box [boxMin, boxMax), which must be a cube. Cells are at least one diameter wide and the
+// number along each axis is rounded down to a multiple of three.
+inline CollisionGrid periodicGrid(Vector3 boxMin, Vector3 boxMax, float maxRadius, GridStorage storage = GridStorage::Dense,
+                                  size_t numberBalls = 0) {
+    Vector3 length = Vector3Subtract(boxMax, boxMin);
+    if (length.x != length.y || length.x != length.z) {
+        throw std::invalid_argument("periodic grid needs a cubic box");
+    }
+    int numberCellsAlongAxis = (int)(length.x / std::max(2.0f * maxRadius, 1e-3f)) / 3 * 3;
+    if (numberCellsAlongAxis < 3) {
+        throw std::invalid_argument("periodic box must be at least three ball diameters wide");
+    }
+    if (numberCellsAlongAxis >= HASHED_COORDINATE_OFFSET) {
+        throw std::invalid_argument("periodic box is too many ball diameters wide");
+    }
+    bool hashed = useHashedStorage(storage, pow((double)numberCellsAlongAxis, 3.0), numberBalls);
+    CollisionGrid grid(length.x / numberCellsAlongAxis, numberCellsAlongAxis, numberCellsAlongAxis, numberCellsAlongAxis,
+                       boxMin, hashed);
+    grid.periodic = true;
+    return grid;
+}
+
+// The part of grid between x = xBegin and xEnd, with the same cells and a border cell either side. A periodic grid
+// stays periodic along y and z but becomes boundedX.
+inline CollisionGrid slabOfGrid(const CollisionGrid &grid, float xBegin, float xEnd) {
+    int nX = std::max(1, (int)ceilf((xEnd - xBegin) / grid.cellSize)) + 2;
+    Vector3 start = { xBegin - grid.cellSize, grid.startingPosition.y, grid.startingPosition.z };
+    CollisionGrid slab(grid.cellSize, nX, grid.numberCellsY, grid.numberCellsZ, start, grid.hashed);
+    slab.periodic = grid.periodic;
+    slab.boundedX = grid.periodic;
+    return slab;
+}
+
+inline void handleBallCollisions(std::vector<Ball3d> &balls, CollisionGrid &grid) {
+    grid.rebuild(balls);
+    grid.forEachNeighbourPair([&balls](int i, int j) {
+        handleBallCollision(balls[i], balls[j]);
+    });
+}
+
 #endif // COLLISION_GRID_H
@@ -0,0 +1,129 @@
+#include "Ensemble.h"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include "Simulation.h"
+
+// Sums values and their squares in the order they are added, so the result does not depend on the threads
+struct RunningEstimate {
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    int count = 0;
+
+    void add(double value) {
+        sum += value;
+        sumSquares += value * value;
+        count++;
+    }
+
+    EnsembleEstimate estimate() const {
+        EnsembleEstimate result;
+        if (count == 0) return result;
+        result.mean = sum / count;
+        if (count > 1) {
+            double variance = std::max(0.0, (sumSquares - count * result.mean * result.mean) / (count - 1));
+            result.standardError = sqrt(variance / count);
+        }
+        return result;
+    }
+};
+
+static std::vector<EnsembleEstimate> combineSeries(const std::vector<RunningEstimate> &series) {
+    std::vector<EnsembleEstimate> result(series.size());
+    for (size_t i = 0; i < series.size(); ++i) {
+        result[i] = series[i].estimate();
+    }
+    return result;
+}
+
+EnsembleReport combineReplicas(std::vector<AnalysisReport> reports) {
+    EnsembleReport ensemble;
+    ensemble.replicas = (int)reports.size();
+
+    size_t lagCount = SIZE_MAX;
+    size_t vacfLagCount = SIZE_MAX;
+    for (const AnalysisReport &report : reports) {
+        for (const TrackedAnalysis &tracked : report.tracked) {
+            lagCount = std::min(lagCount, tracked.lags.size());
+            vacfLagCount = std::min(vacfLagCount, tracked.vacfLags.size());
+            if (ensemble.lags.empty()) ensemble.lags = tracked.lags;
+            if (ensemble.vacfLags.empty()) ensemble.vacfLags = tracked.vacfLags;
+        }
+    }
+    if (lagCount == SIZE_MAX) lagCount = 0;
+    if (vacfLagCount == SIZE_MAX) vacfLagCount = 0;
+    ensemble.lags.resize(lagCount);
+    ensemble.vacfLags.resize(vacfLagCount);
+
+    std::vector<RunningEstimate> displacement(lagCount);
+    std::vector<RunningEstimate> velocity(vacfLagCount);
+    RunningEstimate fromMsd, fromVacf, temperature;
+    for (const AnalysisReport &report : reports) {
+        temperature.add(report.meanTemperature);
+        for (const TrackedAnalysis &tracked : report.tracked) {
+            for (size_t lag = 0; lag < lagCount; ++lag) {
+                displacement[lag].add(tracked.meanSquaredDisplacement[lag]);
+            }
+            for (size_t lag = 0; lag < vacfLagCount; ++lag) {
+                velocity[lag].add(tracked.velocityAutocorrelation[lag]);
+            }
+            fromMsd.add(tracked.diffusionFromMsd);
+            fromVacf.add(tracked.diffusionFromVacf);
+        }
+    }
+    ensemble.samples = fromMsd.count;
+    ensemble.meanSquaredDisplacement = combineSeries(displacement);
+    ensemble.velocityAutocorrelation = combineSeries(velocity);
+    ensemble.diffusionFromMsd = fromMsd.estimate();
+    ensemble.diffusionFromVacf = fromVacf.estimate();
+    ensemble.meanTemperature = temperature.estimate();
+    ensemble.replicaReports = std::move(reports);
+    return ensemble;
+}
+
+static AnalysisReport runReplica(const EnsembleOptions &options, uint64_t seed) {
+    Simulation simulation = createScenario(options.scenario, options.roomSize, options.numberBalls, seed);
+    if (options.boundary == BoundaryType::Planes) {
+        simulation.useWalls(true);
+    } else if (options.boundary == BoundaryType::Periodic) {
+        simulation.makePeriodic();
+    }
+    if (options.neighbourSkin != 0.0f) {
+        simulation.setNeighbourSkin(options.neighbourSkin);
+    }
+    simulation.reorderEvery = options.reorderEvery;
+
+    AnalysisOptions analysisOptions = options.analysis;
+    analysisOptions.background = false;
+    StreamingAnalysis analysis(simulation.particles, simulation.grid.periodicLength(), analysisOptions);
+    for (long long i = 0; i < options.steps; ++i) {
+        simulation.step();
+        analysis.sample(simulation.particles);
+    }
+    return analysis.report();
+}
+
+EnsembleReport runEnsemble(const EnsembleOptions &options, ThreadPool *pool) {
+    if (options.replicas <= 0) {
+        throw std::invalid_argument("an ensemble needs at least one replica");
+    }
+    if (!isScenarioName(options.scenario) || options.scenario == "three") {
+        throw std::invalid_argument("only the brownian and gas scenarios can be run as an ensemble");
+    }
+
+    // The pool's threads can't throw across parallelFor, so each replica keeps its error for afterwards
+    std::vector<AnalysisReport> reports(options.replicas);
+    std::vector<std::exception_ptr> errors(options.replicas);
+    parallelFor(pool, options.replicas, [&](int r) {
+        try {
+            reports[r] = runReplica(options, options.firstSeed + (uint64_t)r);
+        } catch (...) {
+            errors[r] = std::current_exception();
+        }
+    });
+    for (const std::exception_ptr &error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+    return combineReplicas(std::move(reports));
+}
@@ -0,0 +1,56 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Analysis.h"
+#include "Boundary.h"
+#include "ThreadPool.h"
+
+// Many independent replicas of a generated scenario, differing only in their seed, to put error bars on what a
+// single run can only estimate once. A replica of a few hundred balls can't keep a machine busy on its own, so
+// rather than splitting each step across threads, every replica runs start to finish on one thread and the
+// replicas are spread over the pool.
+struct EnsembleOptions {
+    std::string scenario = "brownian";  // "brownian" or "gas", "three" has no seed
+    float roomSize = 20.0f;
+    int numberBalls = 300;
+    int replicas = 100;
+    uint64_t firstSeed = 1;  // replica r is seeded with firstSeed + r
+    long long steps = 1000;
+    BoundaryType boundary = BoundaryType::AxisAlignedBox;
+    float neighbourSkin = 0.0f;
+    int reorderEvery = 0;
+    AnalysisOptions analysis;  // background is ignored, the replicas already keep every thread busy
+};
+
+// Mean over the samples and its standard error, the sample standard deviation / sqrt(samples)
+struct EnsembleEstimate {
+    double mean = 0.0;
+    double standardError = 0.0;
+};
+
+// Every tracked ball of every replica counts as one sample
+struct EnsembleReport {
+    int replicas = 0;
+    int samples = 0;
+    std::vector<double> lags;  // in DT
+    std::vector<EnsembleEstimate> meanSquaredDisplacement;
+    std::vector<double> vacfLags;
+    std::vector<EnsembleEstimate> velocityAutocorrelation;
+    EnsembleEstimate diffusionFromMsd;
+    EnsembleEstimate diffusionFromVacf;
+    EnsembleEstimate meanTemperature;  // of the bath, one sample per replica
+    std::vector<AnalysisReport> replicaReports;  // in replica order
+};
+
+// Runs options.replicas replicas for options.steps steps each with a StreamingAnalysis, then combines them.
+// The result does not depend on the pool. Throws std::invalid_argument for a scenario that can't be replicated
+// and rethrows the first error of any replica.
+EnsembleReport runEnsemble(const EnsembleOptions &options, ThreadPool *pool = nullptr);
+
+// The combining step of runEnsemble, for reports of runs made elsewhere. Series are cut to the shortest one.
+EnsembleReport combineReplicas(std::vector<AnalysisReport> reports);
+
+#endif // ENSEMBLE_H
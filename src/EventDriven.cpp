@@ -0,0 +1,361 @@
+#include "EventDriven.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+const double NEVER = std::numeric_limits<double>::infinity();
+
+EventDrivenSimulation::EventDrivenSimulation(const ParticleSystem &particles, const std::vector<Wall> &room, Vector3 roomDimensions) {
+    if (particles.acceleration.x != 0.0f || particles.acceleration.y != 0.0f || particles.acceleration.z != 0.0f) {
+        throw std::invalid_argument("the event driven engine only has straight flights, not an acceleration");
+    }
+    count = particles.count;
+    position.resize(3 * count);
+    velocity.resize(3 * count);
+    localTime.assign(count, 0.0);
+    radius.resize(count);
+    inverseMass.resize(count);
+    collisionCount.assign(count, 0);
+
+    for (size_t i = 0; i < count; ++i) {
+        Vector3 p = particles.position(i);
+        Vector3 v = particles.getVelocity(i);
+        position[3 * i] = p.x;
+        position[3 * i + 1] = p.y;
+        position[3 * i + 2] = p.z;
+        velocity[3 * i] = v.x / DT;
+        velocity[3 * i + 1] = v.y / DT;
+        velocity[3 * i + 2] = v.z / DT;
+        radius[i] = particles.radius[i];
+        inverseMass[i] = particles.inverseMass[i];
+    }
+
+    for (const WallPlane &plane : wallPlanes(room)) {
+        planes.push_back({ { plane.normal.x, plane.normal.y, plane.normal.z }, plane.offset });
+    }
+
+    // Same layout as gridForRoom, but with a whole number of cells per axis that are at least one diameter wide.
+    // In dilute systems the cells are widened to hold about one particle each, since crossing into a new cell
+    // is an event too and would otherwise outnumber the collisions.
+    double volumePerParticle = (double)roomDimensions.x * roomDimensions.y * roomDimensions.z / std::max((size_t)1, count);
+    double diameter = std::max({ 2.0 * particles.largestRadius(), cbrt(volumePerParticle), 1e-3 });
+    double dimensions[3] = { roomDimensions.x, roomDimensions.y, roomDimensions.z };
+    gridStart[0] = -0.5 * roomDimensions.x;
+    gridStart[1] = 0.0;
+    gridStart[2] = -0.5 * roomDimensions.z;
+    for (int axis = 0; axis < 3; ++axis) {
+        numberCells[axis] = std::max(1, (int)floor(dimensions[axis] / diameter));
+        cellWidth[axis] = dimensions[axis] / numberCells[axis];
+    }
+    cellParticles.resize((size_t)numberCells[0] * numberCells[1] * numberCells[2]);
+    particleCell.assign(count, -1);
+    particleSlot.assign(count, -1);
+
+    for (size_t i = 0; i < count; ++i) {
+        int coordinates[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            coordinates[axis] = cellCoordinate(axis, position[3 * i + axis]);
+        }
+        moveToCell((int)i, cellIndex(coordinates));
+    }
+    for (size_t i = 0; i < count; ++i) {
+        predictAll((int)i);
+    }
+}
+
+int EventDrivenSimulation::cellCoordinate(int axis, double value) const {
+    int coordinate = (int)floor((value - gridStart[axis]) / cellWidth[axis]);
+    return std::clamp(coordinate, 0, numberCells[axis] - 1);
+}
+
+int EventDrivenSimulation::cellIndex(const int coordinates[3]) const {
+    return coordinates[0] + numberCells[0] * (coordinates[1] + numberCells[1] * coordinates[2]);
+}
+
+void EventDrivenSimulation::cellCoordinates(int cell, int coordinates[3]) const {
+    coordinates[0] = cell % numberCells[0];
+    coordinates[1] = (cell / numberCells[0]) % numberCells[1];
+    coordinates[2] = cell / (numberCells[0] * numberCells[1]);
+}
+
+void EventDrivenSimulation::moveToCell(int i, int cell) {
+    int oldCell = particleCell[i];
+    if (oldCell >= 0) {
+        // swap with the last particle of the old cell
+        std::vector<int> &oldList = cellParticles[oldCell];
+        int last = oldList.back();
+        oldList[particleSlot[i]] = last;
+        particleSlot[last] = particleSlot[i];
+        oldList.pop_back();
+    }
+    particleCell[i] = cell;
+    particleSlot[i] = (int)cellParticles[cell].size();
+    cellParticles[cell].push_back(i);
+}
+
+void EventDrivenSimulation::bringToTime(int i, double time) {
+    double elapsed = time - localTime[i];
+    for (int axis = 0; axis < 3; ++axis) {
+        position[3 * i + axis] += velocity[3 * i + axis] * elapsed;
+    }
+    localTime[i] = time;
+}
+
+Vector3 EventDrivenSimulation::positionAt(int i, double time) const {
+    double elapsed = time - localTime[i];
+    return {
+        (float)(position[3 * i] + velocity[3 * i] * elapsed),
+        (float)(position[3 * i + 1] + velocity[3 * i + 1] * elapsed),
+        (float)(position[3 * i + 2] + velocity[3 * i + 2] * elapsed)
+    };
+}
+
+Vector3 EventDrivenSimulation::getVelocity(int i) const {
+    return { (float)velocity[3 * i], (float)velocity[3 * i + 1], (float)velocity[3 * i + 2] };
+}
+
+double EventDrivenSimulation::kineticEnergy() const {
+    double energy = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        if (inverseMass[i] == 0.0) continue;
+        double speedSquared = velocity[3 * i] * velocity[3 * i] + velocity[3 * i + 1] * velocity[3 * i + 1] + velocity[3 * i + 2] * velocity[3 * i + 2];
+        energy += 0.5 * speedSquared / inverseMass[i];
+    }
+    return energy;
+}
+
+// Earliest time at or after currentTime when the two spheres touch while approaching, NEVER if they don't
+double EventDrivenSimulation::pairCollisionTime(int i, int j) const {
+    double separation[3];
+    double relativeVelocity[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        double positionI = position[3 * i + axis] + velocity[3 * i + axis] * (currentTime - localTime[i]);
+        double positionJ = position[3 * j + axis] + velocity[3 * j + axis] * (currentTime - localTime[j]);
+        separation[axis] = positionI - positionJ;
+        relativeVelocity[axis] = velocity[3 * i + axis] - velocity[3 * j + axis];
+    }
+
+    double b = separation[0] * relativeVelocity[0] + separation[1] * relativeVelocity[1] + separation[2] * relativeVelocity[2];
+    if (b >= 0.0) return NEVER;  // moving apart
+
+    double contactDistance = radius[i] + radius[j];
+    double a = relativeVelocity[0] * relativeVelocity[0] + relativeVelocity[1] * relativeVelocity[1] + relativeVelocity[2] * relativeVelocity[2];
+    double c = separation[0] * separation[0] + separation[1] * separation[1] + separation[2] * separation[2] - contactDistance * contactDistance;
+    if (c <= 0.0) return currentTime;  // already touching and approaching
+
+    double discriminant = b * b - a * c;
+    if (discriminant < 0.0) return NEVER;
+    // Smaller root of a t^2 + 2 b t + c, written to avoid cancellation
+    return currentTime + c / (-b + sqrt(discriminant));
+}
+
+void EventDrivenSimulation::predictPair(int i, int j) {
+    double time = pairCollisionTime(i, j);
+    if (time != NEVER) {
+        events.push({ time, ParticleCollision, i, j, collisionCount[i], collisionCount[j] });
+    }
+}
+
+void EventDrivenSimulation::predictWall(int i) {
+    double bestTime = NEVER;
+    int bestWall = -1;
+    for (size_t w = 0; w < planes.size(); ++w) {
+        const Plane &plane = planes[w];
+        double normalVelocity = 0.0;
+        double signedDistance = -plane.offset;
+        for (int axis = 0; axis < 3; ++axis) {
+            double p = position[3 * i + axis] + velocity[3 * i + axis] * (currentTime - localTime[i]);
+            signedDistance += plane.normal[axis] * p;
+            normalVelocity += plane.normal[axis] * velocity[3 * i + axis];
+        }
+        if (normalVelocity >= 0.0) continue;  // moving away from the wall
+
+        double time = currentTime + std::max(0.0, (signedDistance - radius[i]) / -normalVelocity);
+        if (time < bestTime) {
+            bestTime = time;
+            bestWall = (int)w;
+        }
+    }
+    if (bestWall >= 0) {
+        events.push({ bestTime, WallCollision, i, bestWall, collisionCount[i], 0 });
+    }
+}
+
+void EventDrivenSimulation::predictCellCrossing(int i) {
+    int coordinates[3];
+    cellCoordinates(particleCell[i], coordinates);
+
+    double bestTime = NEVER;
+    int bestDirection = -1;
+    for (int axis = 0; axis < 3; ++axis) {
+        double v = velocity[3 * i + axis];
+        double p = position[3 * i + axis] + v * (currentTime - localTime[i]);
+        double time = NEVER;
+        int direction = -1;
+        if (v > 0.0 && coordinates[axis] + 1 < numberCells[axis]) {
+            double boundary = gridStart[axis] + (coordinates[axis] + 1) * cellWidth[axis];
+            time = currentTime + std::max(0.0, (boundary - p) / v);
+            direction = 2 * axis + 1;
+        } else if (v < 0.0 && coordinates[axis] > 0) {
+            double boundary = gridStart[axis] + coordinates[axis] * cellWidth[axis];
+            time = currentTime + std::max(0.0, (boundary - p) / v);
+            direction = 2 * axis;
+        }
+        if (time < bestTime) {
+            bestTime = time;
+            bestDirection = direction;
+        }
+    }
+    if (bestDirection >= 0) {
+        events.push({ bestTime, CellCrossing, i, bestDirection, collisionCount[i], 0 });
+    }
+}
+
+void EventDrivenSimulation::predictWithCell(int i, int cell) {
+    for (int j : cellParticles[cell]) {
+        if (j != i) {
+            predictPair(i, j);
+        }
+    }
+}
+
+void EventDrivenSimulation::predictAll(int i) {
+    predictWall(i);
+    predictCellCrossing(i);
+
+    int coordinates[3];
+    cellCoordinates(particleCell[i], coordinates);
+    for (int dz = -1; dz <= 1; ++dz) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                int neighbour[3] = { coordinates[0] + dx, coordinates[1] + dy, coordinates[2] + dz };
+                if (neighbour[0] < 0 || neighbour[0] >= numberCells[0] ||
+                    neighbour[1] < 0 || neighbour[1] >= numberCells[1] ||
+                    neighbour[2] < 0 || neighbour[2] >= numberCells[2]) continue;
+                predictWithCell(i, cellIndex(neighbour));
+            }
+        }
+    }
+}
+
+// Drops every stale event, the queue otherwise grows with each collision
+void EventDrivenSimulation::rebuildEventQueue() {
+    events = decltype(events)();
+    for (size_t i = 0; i < count; ++i) {
+        predictAll((int)i);
+    }
+}
+
+void EventDrivenSimulation::resolveParticleCollision(int i, int j) {
+    bringToTime(i, currentTime);
+    bringToTime(j, currentTime);
+
+    double normal[3];
+    double distance = 0.0;
+    for (int axis = 0; axis < 3; ++axis) {
+        normal[axis] = position[3 * i + axis] - position[3 * j + axis];  // points towards particle i
+        distance += normal[axis] * normal[axis];
+    }
+    distance = sqrt(distance);
+
+    double inverseMassSum = inverseMass[i] + inverseMass[j];
+    if (distance > 0.0 && inverseMassSum > 0.0) {
+        double approachSpeed = 0.0;
+        for (int axis = 0; axis < 3; ++axis) {
+            normal[axis] /= distance;
+            approachSpeed += normal[axis] * (velocity[3 * i + axis] - velocity[3 * j + axis]);
+        }
+        if (approachSpeed < 0.0) {
+            double impulse = 2.0 * approachSpeed / inverseMassSum;
+            for (int axis = 0; axis < 3; ++axis) {
+                velocity[3 * i + axis] -= normal[axis] * impulse * inverseMass[i];
+                velocity[3 * j + axis] += normal[axis] * impulse * inverseMass[j];
+            }
+        }
+    }
+
+    collisionCount[i]++;
+    collisionCount[j]++;
+    particleCollisions++;
+    predictAll(i);
+    predictAll(j);
+}
+
+void EventDrivenSimulation::resolveWallCollision(int i, int wall) {
+    bringToTime(i, currentTime);
+    const Plane &plane = planes[wall];
+    double normalVelocity = plane.normal[0] * velocity[3 * i] + plane.normal[1] * velocity[3 * i + 1] + plane.normal[2] * velocity[3 * i + 2];
+    if (normalVelocity < 0.0) {
+        for (int axis = 0; axis < 3; ++axis) {
+            velocity[3 * i + axis] -= 2.0 * normalVelocity * plane.normal[axis];
+        }
+    }
+
+    collisionCount[i]++;
+    wallCollisions++;
+    predictAll(i);
+}
+
+void EventDrivenSimulation::resolveCellCrossing(int i, int direction) {
+    int axis = direction / 2;
+    int step = (direction & 1) ? 1 : -1;
+
+    int coordinates[3];
+    cellCoordinates(particleCell[i], coordinates);
+    coordinates[axis] += step;
+    moveToCell(i, cellIndex(coordinates));
+    cellCrossings++;
+
+    // Existing predictions stay valid, only the cells that just came into range need checking
+    predictCellCrossing(i);
+    int neighbour[3];
+    neighbour[axis] = coordinates[axis] + step;
+    if (neighbour[axis] < 0 || neighbour[axis] >= numberCells[axis]) return;
+    int axisA = (axis + 1) % 3;
+    int axisB = (axis + 2) % 3;
+    for (int a = -1; a <= 1; ++a) {
+        for (int b = -1; b <= 1; ++b) {
+            neighbour[axisA] = coordinates[axisA] + a;
+            neighbour[axisB] = coordinates[axisB] + b;
+            if (neighbour[axisA] < 0 || neighbour[axisA] >= numberCells[axisA] ||
+                neighbour[axisB] < 0 || neighbour[axisB] >= numberCells[axisB]) continue;
+            predictWithCell(i, cellIndex(neighbour));
+        }
+    }
+}
+
+void EventDrivenSimulation::advance(double duration) {
+    double targetTime = currentTime + duration;
+    while (!events.empty() && events.top().time <= targetTime) {
+        Event event = events.top();
+        events.pop();
+
+        if (event.countI != collisionCount[event.i]) continue;
+        if (event.type == ParticleCollision && event.countJ != collisionCount[event.j]) continue;
+
+        currentTime = std::max(currentTime, event.time);
+        switch (event.type) {
+            case ParticleCollision: resolveParticleCollision(event.i, event.j); break;
+            case WallCollision: resolveWallCollision(event.i, event.j); break;
+            case CellCrossing: resolveCellCrossing(event.i, event.j); break;
+        }
+
+        if (events.size() > 32 * count + 4096) {
+            rebuildEventQueue();
+        }
+    }
+
+    currentTime = targetTime;
+    for (size_t i = 0; i < count; ++i) {
+        bringToTime((int)i, currentTime);
+    }
+}
+
+void EventDrivenSimulation::writeTo(ParticleSystem &particles) const {
+    for (size_t i = 0; i < count; ++i) {
+        Vector3 p = positionAt((int)i, currentTime);
+        particles.setPosition(i, p);
+        particles.setVelocity(i, Vector3Scale(getVelocity((int)i), DT));
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef EVENT_DRIVEN_H
+#define EVENT_DRIVEN_H
+
+#include <queue>
+#include <vector>
+#include "ParticleSystem.h"
+
+// Event-driven molecular dynamics for hard spheres, an alternative to stepping every particle every DT.
+// Particles fly in straight lines between events, and every sphere-sphere or sphere-wall collision is
+// resolved at its exact time, so nothing overlaps or tunnels and energy is conserved to rounding.
+//
+// Events wait in a priority queue and are invalidated lazily: each one records the collision counts of its
+// particles when it was predicted and is dropped if either count has changed since.
+// Particles are kept in a grid of cells at least one diameter wide and only pairs in neighbouring cells are
+// predicted. Crossing into a new cell is itself an event, which predicts pairs with the newly adjacent cells.
+// State is in double precision, times and velocities use the same units as the stepped simulation
+// (DT and displacement per DT).
+struct EventDrivenSimulation {
+    enum EventType { ParticleCollision, WallCollision, CellCrossing };
+
+    struct Event {
+        double time;
+        EventType type;
+        int i;
+        int j;  // other particle, wall index, or for a cell crossing the axis * 2 + (1 if moving up)
+        unsigned int countI;
+        unsigned int countJ;
+
+        bool operator>(const Event &other) const {
+            if (time != other.time) return time > other.time;
+            if (type != other.type) return type > other.type;
+            if (i != other.i) return i > other.i;
+            return j > other.j;
+        }
+    };
+
+    struct Plane {
+        double normal[3];
+        double offset;
+    };
+
+    size_t count = 0;
+    double currentTime = 0.0;
+    std::vector<double> position;  // x, y, z per particle, valid at localTime
+    std::vector<double> velocity;
+    std::vector<double> localTime;
+    std::vector<double> radius;
+    std::vector<double> inverseMass;
+    std::vector<unsigned int> collisionCount;
+    std::vector<Plane> planes;
+
+    // Cell grid with per-cell particle lists
+    double cellWidth[3];
+    int numberCells[3];
+    double gridStart[3];
+    std::vector<int> particleCell;
+    std::vector<int> particleSlot;  // index of the particle in its cell's list
+    std::vector<std::vector<int>> cellParticles;
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+
+    long long particleCollisions = 0;
+    long long wallCollisions = 0;
+    long long cellCrossings = 0;
+
+    // Takes over the particles' positions and velocities and the room's walls (normals pointing inwards).
+    // Throws std::invalid_argument if the particles have an acceleration, which the straight flights can't follow.
+    EventDrivenSimulation(const ParticleSystem &particles, const std::vector<Wall> &room, Vector3 roomDimensions);
+
+    // Processes every event up to currentTime + duration and moves all particles to that time
+    void advance(double duration);
+
+    // Copies positions and velocities back, velocities become pastPosition = position - velocity * DT
+    void writeTo(ParticleSystem &particles) const;
+
+    Vector3 positionAt(int i, double time) const;
+    Vector3 getVelocity(int i) const;
+    double kineticEnergy() const;
+
+private:
+    int cellCoordinate(int axis, double value) const;
+    int cellIndex(const int coordinates[3]) const;
+    void cellCoordinates(int cell, int coordinates[3]) const;
+    void moveToCell(int i, int cell);
+    void bringToTime(int i, double time);
+
+    double pairCollisionTime(int i, int j) const;
+    void predictPair(int i, int j);
+    void predictWall(int i);
+    void predictCellCrossing(int i);
+    void predictWithCell(int i, int cell);
+    void predictAll(int i);
+    void rebuildEventQueue();
+
+    void resolveParticleCollision(int i, int j);
+    void resolveWallCollision(int i, int wall);
+    void resolveCellCrossing(int i, int direction);
+};
+
+#endif // EVENT_DRIVEN_H
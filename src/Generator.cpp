@@ -0,0 +1,233 @@
+#include "Generator.h"
+#include <algorithm>
+#include <stdexcept>
+
+// Random streams, one per kind of draw
+const uint64_t STREAM_JITTER = 0;
+const uint64_t STREAM_VELOCITY = 1;
+const uint64_t STREAM_COLOR = 2;
+
+// Lattice sites per task
+const size_t SITE_CHUNK_SIZE = 4096;
+
+// Each attempt at finding a lattice shrinks the spacing by this factor
+const double LATTICE_SHRINK = 0.98;
+const int LATTICE_ATTEMPTS = 400;
+
+const float JITTER_MARGIN = 0.999f;
+
+static uint64_t splitMix64(uint64_t z) {
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t CounterRandom::bits(uint64_t stream, uint64_t counter) const {
+    uint64_t key = splitMix64(seed ^ splitMix64(stream));
+    return splitMix64(key + counter * 0x9e3779b97f4a7c15ULL);
+}
+
+double CounterRandom::uniform(uint64_t stream, uint64_t counter) const {
+    return (double)(bits(stream, counter) >> 11) * 0x1.0p-53;
+}
+
+void CounterRandom::normalPair(uint64_t stream, uint64_t counter, double &first, double &second) const {
+    double length = sqrt(-2.0 * log(1.0 - uniform(stream, 2 * counter)));
+    double angle = 2.0 * PI * uniform(stream, 2 * counter + 1);
+    first = length * cos(angle);
+    second = length * sin(angle);
+}
+
+float roomSizeForPackingFraction(int count, float radius, float packingFraction, const std::vector<Ball3d> &placed) {
+    if (packingFraction <= 0.0f) {
+        throw std::invalid_argument("packing fraction must be positive");
+    }
+    double volume = count * 4.0 / 3.0 * PI * radius * radius * radius;
+    for (const Ball3d &ball : placed) {
+        volume += 4.0 / 3.0 * PI * ball.radius * ball.radius * ball.radius;
+    }
+    return (float)cbrt(volume / packingFraction);
+}
+
+// Cell-centred simple cubic lattice over the room, sites numbered x fastest
+struct Lattice {
+    int cells[3];
+    float spacing[3];
+    float jitter[3];  // a particle may move this far from its site along each axis
+    float clearance;  // distance from a site a placed ball has to keep to leave the site free
+    Vector3 firstSite;
+
+    size_t sites() const {
+        return (size_t)cells[0] * cells[1] * cells[2];
+    }
+
+    Vector3 site(size_t s) const {
+        size_t x = s % cells[0];
+        size_t y = (s / cells[0]) % cells[1];
+        size_t z = s / ((size_t)cells[0] * cells[1]);
+        return { firstSite.x + x * spacing[0], firstSite.y + y * spacing[1], firstSite.z + z * spacing[2] };
+    }
+};
+
+static Lattice latticeWithSpacing(Vector3 roomDimensions, float radius, double targetSpacing) {
+    float dimensions[3] = { roomDimensions.x, roomDimensions.y, roomDimensions.z };
+    Lattice lattice;
+    for (int axis = 0; axis < 3; ++axis) {
+        lattice.cells[axis] = std::max(1, (int)(dimensions[axis] / targetSpacing));
+        lattice.spacing[axis] = dimensions[axis] / lattice.cells[axis];
+        // Kept a little short of the cell edge so rounding can't leave particles touching the wall or a neighbour
+        lattice.jitter[axis] = (0.5f * lattice.spacing[axis] - radius) * JITTER_MARGIN;
+    }
+    lattice.clearance = sqrtf(lattice.jitter[0] * lattice.jitter[0] + lattice.jitter[1] * lattice.jitter[1]
+                              + lattice.jitter[2] * lattice.jitter[2]);
+    lattice.firstSite = { -0.5f * roomDimensions.x + 0.5f * lattice.spacing[0], 0.5f * lattice.spacing[1],
+                          -0.5f * roomDimensions.z + 0.5f * lattice.spacing[2] };
+    return lattice;
+}
+
+static bool isFree(const Lattice &lattice, Vector3 site, float radius, const std::vector<Ball3d> &placed) {
+    for (const Ball3d &ball : placed) {
+        if (Vector3Distance(site, ball.position) < radius + ball.radius + lattice.clearance) return false;
+    }
+    return true;
+}
+
+// Free sites in each chunk of SITE_CHUNK_SIZE sites
+static std::vector<size_t> countFreeSites(const Lattice &lattice, float radius, const std::vector<Ball3d> &placed,
+                                          ThreadPool *pool) {
+    size_t numberChunks = (lattice.sites() + SITE_CHUNK_SIZE - 1) / SITE_CHUNK_SIZE;
+    std::vector<size_t> freeSites(numberChunks, 0);
+    parallelForChunks(pool, lattice.sites(), SITE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        size_t free = 0;
+        for (size_t s = begin; s < end; ++s) {
+            if (isFree(lattice, lattice.site(s), radius, placed)) free++;
+        }
+        freeSites[begin / SITE_CHUNK_SIZE] = free;
+    });
+    return freeSites;
+}
+
+ParticleSystem generateParticles(Vector3 roomDimensions, const GeneratorOptions &options,
+                                 const std::vector<Ball3d> &placed, ThreadPool *pool) {
+    if (options.count < 0 || options.radius <= 0.0f || options.mass <= 0.0f) {
+        throw std::invalid_argument("particles need a non-negative count, a positive radius and a positive mass");
+    }
+    size_t count = (size_t)options.count;
+    float radius = options.radius;
+
+    // Coarsest lattice with enough free sites, starting from one site per particle
+    Lattice lattice;
+    std::vector<size_t> freeSites;
+    size_t totalFree = 0;
+    double spacing = cbrt((double)roomDimensions.x * roomDimensions.y * roomDimensions.z / std::max<size_t>(count, 1));
+    for (int attempt = 0; attempt < LATTICE_ATTEMPTS; ++attempt, spacing *= LATTICE_SHRINK) {
+        lattice = latticeWithSpacing(roomDimensions, radius, spacing);
+        if (lattice.jitter[0] < 0.0f || lattice.jitter[1] < 0.0f || lattice.jitter[2] < 0.0f) break;
+        if (lattice.sites() < count) continue;
+        freeSites = countFreeSites(lattice, radius, placed, pool);
+        totalFree = 0;
+        for (size_t free : freeSites) {
+            totalFree += free;
+        }
+        if (totalFree >= count) break;
+    }
+    if (totalFree < count) {
+        throw std::invalid_argument(std::to_string(count) + " particles of radius " + std::to_string(radius)
+                                    + " don't fit in the room");
+    }
+
+    ParticleSystem particles = particleSystemFromBalls(placed);
+    size_t first = particles.count;
+    particles.resize(first + count);
+    if (placed.empty()) {
+        particles.acceleration = { 0.0f, 0.0f, 0.0f };
+    }
+
+    // Free site f holds a particle when floor(f * count / totalFree) steps up, which spreads the spare sites evenly
+    std::vector<size_t> freeBefore(freeSites.size(), 0);
+    for (size_t c = 1; c < freeSites.size(); ++c) {
+        freeBefore[c] = freeBefore[c - 1] + freeSites[c - 1];
+    }
+    // Per chunk: the sum of the velocities and of their squares
+    std::vector<double> chunkSums(4 * freeSites.size(), 0.0);
+    CounterRandom random = { options.seed };
+    float speedScale = sqrtf(options.temperature / options.mass);
+    float inverseMass = 1.0f / options.mass;
+    auto drawVelocity = [&random, speedScale](uint64_t k) {
+        double x, y, z, unused;
+        random.normalPair(STREAM_VELOCITY, 2 * k, x, y);
+        random.normalPair(STREAM_VELOCITY, 2 * k + 1, z, unused);
+        return Vector3 { (float)x * speedScale, (float)y * speedScale, (float)z * speedScale };
+    };
+    parallelForChunks(pool, count > 0 ? lattice.sites() : 0, SITE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        size_t free = freeBefore[begin / SITE_CHUNK_SIZE];
+        double sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+        for (size_t s = begin; s < end; ++s) {
+            Vector3 site = lattice.site(s);
+            if (!isFree(lattice, site, radius, placed)) continue;
+            uint64_t k = free * count / totalFree;
+            bool used = (free + 1) * count / totalFree > k;
+            free++;
+            if (!used) continue;
+
+            Vector3 position = {
+                site.x + (float)(2.0 * random.uniform(STREAM_JITTER, 3 * k) - 1.0) * lattice.jitter[0],
+                site.y + (float)(2.0 * random.uniform(STREAM_JITTER, 3 * k + 1) - 1.0) * lattice.jitter[1],
+                site.z + (float)(2.0 * random.uniform(STREAM_JITTER, 3 * k + 2) - 1.0) * lattice.jitter[2]
+            };
+            Vector3 velocity = drawVelocity(k);
+            sums[0] += velocity.x;
+            sums[1] += velocity.y;
+            sums[2] += velocity.z;
+            sums[3] += Vector3DotProduct(velocity, velocity);
+
+            size_t slot = first + k;
+            particles.setPosition(slot, position);
+            particles.radius[slot] = radius;
+            particles.inverseMass[slot] = inverseMass;
+
+            unsigned char *channels[3] = { &particles.cold.colors[slot].r, &particles.cold.colors[slot].g,
+                                           &particles.cold.colors[slot].b };
+            const unsigned char base[3] = { options.color.r, options.color.g, options.color.b };
+            for (int c = 0; c < 3; ++c) {
+                double shift = (2.0 * random.uniform(STREAM_COLOR, 3 * k + c) - 1.0) * options.colorJitter;
+                *channels[c] = (unsigned char)std::clamp((int)lround(base[c] + shift), 0, 255);
+            }
+            particles.cold.colors[slot].a = options.color.a;
+        }
+        std::copy(sums, sums + 4, &chunkSums[4 * (begin / SITE_CHUNK_SIZE)]);
+    });
+    if (count == 0) return particles;
+
+    // Summed in chunk order so the totals do not depend on the threads
+    double sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (size_t c = 0; c < chunkSums.size(); ++c) {
+        sums[c % 4] += chunkSums[c];
+    }
+    double placedMomentum[3] = { 0.0, 0.0, 0.0 };
+    for (const Ball3d &ball : placed) {
+        Vector3 velocity = Vector3Subtract(ball.position, ball.pastPosition);
+        placedMomentum[0] += ball.mass * velocity.x;
+        placedMomentum[1] += ball.mass * velocity.y;
+        placedMomentum[2] += ball.mass * velocity.z;
+    }
+
+    // Velocities relative to the mean of the generated ones are scaled to the exact temperature, then all of them
+    // are shifted to cancel the momentum of the placed balls. The draws are redone rather than stored.
+    double mean[3] = { sums[0] / count, sums[1] / count, sums[2] / count };
+    double sumSquaresAboutMean = sums[3] - count * (mean[0] * mean[0] + mean[1] * mean[1] + mean[2] * mean[2]);
+    double target = 3.0 * count * options.temperature / options.mass;
+    float scale = sumSquaresAboutMean > 0.0 ? (float)sqrt(target / sumSquaresAboutMean) : 0.0f;
+    double generatedMass = count * (double)options.mass;
+    Vector3 generatedMean = { (float)mean[0], (float)mean[1], (float)mean[2] };
+    Vector3 shift = { (float)(placedMomentum[0] / generatedMass), (float)(placedMomentum[1] / generatedMass),
+                      (float)(placedMomentum[2] / generatedMass) };
+    parallelForChunks(pool, count, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            Vector3 velocity = Vector3Subtract(Vector3Scale(Vector3Subtract(drawVelocity(k), generatedMean), scale), shift);
+            particles.setPastPosition(first + k, Vector3Subtract(particles.position(first + k), Vector3Scale(velocity, DT)));
+        }
+    });
+    return particles;
+}
@@ -0,0 +1,45 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <cstdint>
+#include <vector>
+#include "Objects.h"
+#include "ParticleSystem.h"
+#include "ThreadPool.h"
+
+// Counter-based random numbers: draw `counter` of `stream` is the SplitMix64 output at that position for a key
+// made from seed and stream. Any draw can be made on its own, so particles generated in parallel or in a
+// different order come out the same.
+struct CounterRandom {
+    uint64_t seed;
+
+    uint64_t bits(uint64_t stream, uint64_t counter) const;
+    // Uniform in [0, 1)
+    double uniform(uint64_t stream, uint64_t counter) const;
+    // Two independent standard normals from the uniforms at 2 * counter and 2 * counter + 1 (Box-Muller)
+    void normalPair(uint64_t stream, uint64_t counter, double &first, double &second) const;
+};
+
+struct GeneratorOptions {
+    int count = 0;  // particles generated, exactly
+    float radius = 0.5f;
+    float mass = 1.0f;
+    float temperature = 0.03f;  // k_B T with k_B = 1, each velocity component has variance temperature / mass
+    Color color = { 0, 121, 241, 255 };  // raylib BLUE
+    int colorJitter = 0;  // each channel is moved randomly by up to this much
+    uint64_t seed = 1;
+};
+
+// Side of the cubic room that count balls of the given radius, plus the placed ones, fill to packingFraction
+float roomSizeForPackingFraction(int count, float radius, float packingFraction, const std::vector<Ball3d> &placed = {});
+
+// Fills a room laid out like cubeRoom. The placed balls come first (ids 0, 1, ...), e.g. a tracer, followed by
+// exactly options.count particles on the coarsest simple cubic lattice with enough sites clear of them.
+// Spare sites are spread evenly and each particle is moved randomly inside its lattice cell, so it can't reach
+// a neighbour or a wall. Velocities are Maxwell-Boltzmann, scaled to exactly options.temperature and shifted so the
+// total momentum, placed balls included, is zero.
+// The result only depends on the arguments, not on the pool. Throws std::invalid_argument if the particles don't fit.
+ParticleSystem generateParticles(Vector3 roomDimensions, const GeneratorOptions &options,
+                                 const std::vector<Ball3d> &placed = {}, ThreadPool *pool = nullptr);
+
+#endif // GENERATOR_H
@@ -0,0 +1,63 @@
+#include "Instrumentation.h"
+
+const char *stepPhaseName(int phase) {
+    switch (phase) {
+        case PhaseIntegrate: return "integrate";
+        case PhaseWalls: return "walls";
+        case PhaseGridRebuild: return "gridRebuild";
+        case PhaseBroad: return "broadPhase";
+        case PhaseNarrow: return "narrowPhase";
+        default: return "unknown";
+    }
+}
+
+double StepStats::stepSeconds() const {
+    double total = 0.0;
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        total += phaseSeconds[phase];
+    }
+    return total;
+}
+
+void writeStatsCsvHeader(std::ostream &out) {
+    out << "step";
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        out << "," << stepPhaseName(phase) << "Seconds";
+    }
+    out << ",pairTests,contacts,collisions,overlapCorrections,maxCellLoad,neighbourDisplacement,neighbourRebuild,neighbourPairs";
+    for (int bin = 0; bin < OCCUPANCY_BINS; ++bin) {
+        out << ",cells" << bin << (bin == OCCUPANCY_BINS - 1 ? "Plus" : "");
+    }
+    out << "\n";
+}
+
+void writeStatsCsv(std::ostream &out, long long step, const StepStats &stats) {
+    out << step;
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        out << "," << stats.phaseSeconds[phase];
+    }
+    out << "," << stats.collisions.pairTests << "," << stats.collisions.contacts << "," << stats.collisions.collisions
+        << "," << stats.collisions.overlapCorrections << "," << stats.maxCellLoad << "," << stats.neighbourDisplacement
+        << "," << stats.neighbourRebuild << "," << stats.neighbourPairs;
+    for (int bin = 0; bin < OCCUPANCY_BINS; ++bin) {
+        out << "," << stats.occupancy[bin];
+    }
+    out << "\n";
+}
+
+void writeStatsJson(std::ostream &out, long long step, const StepStats &stats) {
+    out << "{\"step\":" << step << ",\"phaseSeconds\":{";
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        out << (phase > 0 ? "," : "") << "\"" << stepPhaseName(phase) << "\":" << stats.phaseSeconds[phase];
+    }
+    out << "},\"pairTests\":" << stats.collisions.pairTests << ",\"contacts\":" << stats.collisions.contacts
+        << ",\"collisions\":" << stats.collisions.collisions
+        << ",\"overlapCorrections\":" << stats.collisions.overlapCorrections
+        << ",\"maxCellLoad\":" << stats.maxCellLoad << ",\"neighbourDisplacement\":" << stats.neighbourDisplacement
+        << ",\"neighbourRebuild\":" << (stats.neighbourRebuild ? "true" : "false")
+        << ",\"neighbourPairs\":" << stats.neighbourPairs << ",\"occupancy\":[";
+    for (int bin = 0; bin < OCCUPANCY_BINS; ++bin) {
+        out << (bin > 0 ? "," : "") << stats.occupancy[bin];
+    }
+    out << "]}\n";
+}
@@ -0,0 +1,101 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+// Timing and counters for the physics step, switched on with the DIFFUSION_INSTRUMENTATION CMake option.
+// When it is off every DIFFUSION_INSTRUMENT(...) statement and phase timer compiles to nothing and
+// StepStats just stays zero.
+#ifndef DIFFUSION_INSTRUMENTATION
+#define DIFFUSION_INSTRUMENTATION 0
+#endif
+
+#if DIFFUSION_INSTRUMENTATION
+#define DIFFUSION_INSTRUMENT(...) __VA_ARGS__
+#else
+#define DIFFUSION_INSTRUMENT(...)
+#endif
+
+constexpr bool instrumentationEnabled() {
+    return DIFFUSION_INSTRUMENTATION != 0;
+}
+
+enum StepPhase {
+    PhaseIntegrate,
+    PhaseWalls,
+    PhaseGridRebuild,  // including the periodic Morton reorder
+    PhaseBroad,   // finding candidate pairs and testing them for contact
+    PhaseNarrow,  // resolving the pairs that touch
+    PhaseCount
+};
+
+const char *stepPhaseName(int phase);
+
+// The narrow phase is timed on one contact in this many and scaled up
+const int NARROW_SAMPLE_EVERY = 64;
+
+// Filled in by the pair collision pass
+struct CollisionCounters {
+    long long pairTests = 0;
+    long long contacts = 0;            // pairs that were touching
+    long long collisions = 0;          // touching pairs that were approaching and exchanged momentum
+    long long overlapCorrections = 0;  // pairs pushed apart because they would still overlap after the step
+    double passSeconds = 0.0;          // summed over threads
+    double narrowSeconds = 0.0;        // estimated from sampled contacts, summed over threads, included in passSeconds
+
+    void add(const CollisionCounters &other) {
+        pairTests += other.pairTests;
+        contacts += other.contacts;
+        collisions += other.collisions;
+        overlapCorrections += other.overlapCorrections;
+        passSeconds += other.passSeconds;
+        narrowSeconds += other.narrowSeconds;
+    }
+};
+
+// Cells holding 0, 1, ... OCCUPANCY_BINS - 2 balls, the last bin is that many or more
+const int OCCUPANCY_BINS = 16;
+
+// Everything measured during the last step
+struct StepStats {
+    double phaseSeconds[PhaseCount] = {};
+    CollisionCounters collisions;
+    int occupancy[OCCUPANCY_BINS] = {};
+    int maxCellLoad = 0;
+    // Neighbour list mode only: the largest displacement since the lists were built, checked against half the skin,
+    // whether that (or a reorder) made this step rebuild them, and the number of listed pairs
+    float neighbourDisplacement = 0.0f;
+    bool neighbourRebuild = false;
+    long long neighbourPairs = 0;
+
+    double stepSeconds() const;
+};
+
+inline double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Adds the time from construction to destruction to target
+struct PhaseTimer {
+    double &target;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    ~PhaseTimer() {
+        target += secondsSince(start);
+    }
+};
+
+#if DIFFUSION_INSTRUMENTATION
+#define DIFFUSION_TIME_PHASE(stats, phase) PhaseTimer phaseTimer { (stats).phaseSeconds[phase] }
+#else
+#define DIFFUSION_TIME_PHASE(stats, phase)
+#endif
+
+// Sinks for the headless runner: one CSV row or one JSON object per line for each recorded step
+void writeStatsCsvHeader(std::ostream &out);
+void writeStatsCsv(std::ostream &out, long long step, const StepStats &stats);
+void writeStatsJson(std::ostream &out, long long step, const StepStats &stats);
+
+#endif // INSTRUMENTATION_H
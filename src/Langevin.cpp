@@ -0,0 +1,47 @@
+#include "Langevin.h"
+#include <cmath>
+#include <stdexcept>
+#include "Analysis.h"
+
+double LangevinBath::velocityRetention() const {
+    return exp(-friction * DT);
+}
+
+LangevinCalibration calibrateLangevin(const std::vector<double> &vacfLags, const std::vector<double> &vacf, float mass) {
+    if (vacfLags.empty() || vacfLags[0] != 0.0 || vacf[0] <= 0.0) {
+        throw std::invalid_argument("calibrating a Langevin bath needs the VACF at lag 0");
+    }
+    if (mass <= 0.0f) {
+        throw std::invalid_argument("calibrating a Langevin bath needs a particle with a mass");
+    }
+    LangevinCalibration calibration;
+    calibration.velocityVariance = vacf[0];
+    calibration.diffusion = greenKuboDiffusion(vacfLags, vacf);
+    calibration.bath.temperature = mass * calibration.velocityVariance / 3.0;
+
+    // D = <v^2> / 6 * (1 + c) / (1 - c) solved for c, which needs D above the <v^2> / 6 of a velocity that is
+    // forgotten within a single step
+    double ratio = 6.0 * calibration.diffusion / (calibration.velocityVariance * DT);
+    if (ratio <= 1.0) {
+        throw std::invalid_argument("the VACF decays within a step, too fast for a Langevin bath");
+    }
+    double retention = (ratio - 1.0) / (ratio + 1.0);
+    calibration.bath.friction = -log(retention) / DT;
+    return calibration;
+}
+
+void applyLangevinBath(const LangevinBath &bath, ParticleSystem &particles, std::mt19937_64 &random) {
+    double retention = bath.velocityRetention();
+    double kickScale = sqrt(bath.temperature * (1.0 - retention * retention));
+    std::normal_distribution<double> normal;
+    for (size_t i = 0; i < particles.count; ++i) {
+        if (particles.inverseMass[i] == 0.0f) continue;
+        double spread = kickScale * sqrt((double)particles.inverseMass[i]);
+        Vector3 velocity = particles.getVelocity(i);
+        particles.setVelocity(i, {
+            (float)(retention * velocity.x + spread * normal(random)),
+            (float)(retention * velocity.y + spread * normal(random)),
+            (float)(retention * velocity.z + spread * normal(random))
+        });
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef LANGEVIN_H
+#define LANGEVIN_H
+
+#include <random>
+#include <vector>
+#include "ParticleSystem.h"
+
+// Implicit solvent: instead of colliding with explicit bath particles, every velocity is damped and kicked each
+// step. The velocity of a free particle of mass M follows the exact discrete Ornstein-Uhlenbeck update
+//   v <- c v + sqrt(temperature / M * (1 - c^2)) * xi,   c = exp(-friction * DT)
+// with xi standard normal per component, so it keeps <v^2> = 3 temperature / M, its VACF decays as c^k after k
+// steps and it diffuses with D = temperature / (6 M) * (1 + c) / (1 - c).
+struct LangevinBath {
+    double friction = 0.0;     // rate per unit time (c = exp(-friction * DT)), 0 is off
+    double temperature = 0.0;  // k_B T with k_B = 1
+
+    bool enabled() const { return friction > 0.0; }
+    double velocityRetention() const;  // c
+};
+
+struct LangevinCalibration {
+    LangevinBath bath;
+    double velocityVariance = 0.0;  // <|v|^2>, the VACF at lag 0
+    double diffusion = 0.0;         // Green-Kubo integral of the VACF, which the bath reproduces
+};
+
+// Fits a bath to the velocity autocorrelation of a particle of the given mass measured with explicit solvent:
+// the temperature from equipartition of the VACF at lag 0, the friction so the bath's D matches the measured
+// Green-Kubo one. Throws std::invalid_argument if the VACF has no lag 0 or decays within one step.
+LangevinCalibration calibrateLangevin(const std::vector<double> &vacfLags, const std::vector<double> &vacf, float mass);
+
+// Damps and kicks every movable particle. Draws from random in slot order, so it runs on one thread.
+void applyLangevinBath(const LangevinBath &bath, ParticleSystem &particles, std::mt19937_64 &random);
+
+#endif // LANGEVIN_H
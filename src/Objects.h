@@ -1,9 +1,9 @@
 #ifndef OBJS_H
 #define OBJS_H
 
-#include "raylib.h"
+// Only raymath.h is needed here; it is header only and defines Vector3 itself when raylib.h is not included.
+// Include raylib.h before this header when drawing.
 #include "raymath.h"
-#include "rlgl.h"
 #include <vector>
 #include <cmath>
 #include <random>
@@ -11,6 +11,17 @@
 
 const float DT = 1.0f;
 
+// Same layout as raylib's Color so the viewer can use it directly
+#if !defined(RL_COLOR_TYPE)
+typedef struct Color {
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+    unsigned char a;
+} Color;
+#define RL_COLOR_TYPE
+#endif
+
 // The Wall object is represented by a subset of the XZ plane that is rotated (around the x-axis then y-axis) and translated
 struct Wall {
     Vector3 centerPosition;
@@ -24,11 +35,9 @@ struct Wall {
     void set_xAxisRotation(float newXRotation);
     void set_yAxisRotation(float newYRotation);
 
-    Vector3 normalVector();
-    Vector3 inplaneVector();
-    float distanceToWall(Vector3 point);
-
-    void draw();
+    Vector3 normalVector() const;
+    Vector3 inplaneVector() const;
+    float distanceToWall(Vector3 point) const;
 };
 
 struct Ball3d {
@@ -38,7 +47,7 @@ struct Ball3d {
     Vector3 acceleration = { 0.0f, 0.0f, 0.0f };
     float radius = 1.0f;
     int mass = 1;
-    Color color = BLUE;
+    Color color = { 0, 121, 241, 255 };  // raylib BLUE
     bool trackPositions = false;
     std::vector<Vector3> previousPositions = {};
 
@@ -46,8 +55,6 @@ struct Ball3d {
     void setVelocity(Vector3 newVelocity);
     void updatePosition();
     void handleWallCollision(Wall &wall);
-
-    void draw();
 };
 
 void handleBallCollision(Ball3d &ball1, Ball3d &ball2);
@@ -57,5 +64,8 @@ std::vector<Wall> cubeRoom(float wallLength);
 std::vector<Ball3d> threeBallsBouncing();
 std::vector<Ball3d> brownianMotion(Vector3 roomDimensions, Ball3d &smallBall, Ball3d &largeBall, int nSmallBalls);
 std::vector<Ball3d> generateBalls(Vector3 roomDimensions, float ballRadius, float velocityMagnitude, int numBalls);
+// Same, drawing the random directions and colours from gen so a given seed always gives the same balls
+std::vector<Ball3d> brownianMotion(Vector3 roomDimensions, Ball3d &smallBall, Ball3d &largeBall, int nSmallBalls, std::mt19937 &gen);
+std::vector<Ball3d> generateBalls(Vector3 roomDimensions, float ballRadius, float velocityMagnitude, int numBalls, std::mt19937 &gen);
 
 #endif // OBJS_H
@@ -0,0 +1,627 @@
+#include "ParticleSystem.h"
+#include <mutex>
+#include <numeric>
+
+void ParticleSystem::resize(size_t n) {
+    positionX.resize(n);
+    positionY.resize(n);
+    positionZ.resize(n);
+    pastPositionX.resize(n);
+    pastPositionY.resize(n);
+    pastPositionZ.resize(n);
+    radius.resize(n);
+    inverseMass.resize(n);
+    species.resize(n);
+    speciesTable = SpeciesTable();
+    cold.colors.resize(n);
+    ids.resize(n);
+    std::iota(ids.begin(), ids.end(), 0);
+    slotOfId = ids;
+    count = n;
+}
+
+SpeciesPair speciesPair(float radius1, float inverseMass1, float radius2, float inverseMass2) {
+    SpeciesPair pair;
+    pair.contactDistance = radius1 + radius2;
+    pair.contactDistanceSquared = pair.contactDistance * pair.contactDistance;
+    float inverseMassSum = inverseMass1 + inverseMass2;
+    pair.impulseShare[0] = inverseMassSum > 0.0f ? 2.0f * inverseMass1 / inverseMassSum : 0.0f;
+    pair.impulseShare[1] = inverseMassSum > 0.0f ? 2.0f * inverseMass2 / inverseMassSum : 0.0f;
+    // Point particles never overlap, so their shares are never used
+    pair.overlapShare[0] = pair.contactDistance > 0.0f ? radius1 / pair.contactDistance : 0.0f;
+    pair.overlapShare[1] = pair.contactDistance > 0.0f ? radius2 / pair.contactDistance : 0.0f;
+    return pair;
+}
+
+void ParticleSystem::assignSpecies() {
+    // Snapshots map the arrays they store and leave this one to be made here
+    if (species.size != count) species.resize(count);
+    speciesTable = SpeciesTable();
+    for (size_t i = 0; i < count; ++i) {
+        int kind = 0;
+        while (kind < speciesTable.count()
+               && (speciesTable.radius[kind] != radius[i] || speciesTable.inverseMass[kind] != inverseMass[i])) {
+            kind++;
+        }
+        if (kind == speciesTable.count()) {
+            if (kind == MAX_SPECIES) {
+                speciesTable = SpeciesTable();
+                return;
+            }
+            speciesTable.radius.push_back(radius[i]);
+            speciesTable.inverseMass.push_back(inverseMass[i]);
+        }
+        species[i] = (uint8_t)kind;
+    }
+    for (int a = 0; a < speciesTable.count(); ++a) {
+        for (int b = 0; b < speciesTable.count(); ++b) {
+            speciesTable.pairs.push_back(speciesPair(speciesTable.radius[a], speciesTable.inverseMass[a],
+                                                     speciesTable.radius[b], speciesTable.inverseMass[b]));
+        }
+    }
+}
+
+float ParticleSystem::largestRadius() const {
+    float largest = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        largest = std::max(largest, radius[i]);
+    }
+    return largest;
+}
+
+void ParticleSystem::recordTrackedPositions() {
+    for (size_t t = 0; t < cold.trackedParticles.size(); ++t) {
+        int i = slotOfId[cold.trackedParticles[t]];
+        Vector3 velocity = getVelocity(i);
+        Vector3 lastVelocity = cold.trackedLastVelocity[t];
+        if (velocity.x != lastVelocity.x || velocity.y != lastVelocity.y || velocity.z != lastVelocity.z) {
+            cold.trackedPositions[t].push(position(i));
+            cold.trackedLastVelocity[t] = velocity;
+        }
+    }
+}
+
+ParticleSystem particleSystemFromBalls(const std::vector<Ball3d> &balls) {
+    ParticleSystem particles;
+    particles.resize(balls.size());
+    for (size_t i = 0; i < balls.size(); ++i) {
+        const Ball3d &ball = balls[i];
+        particles.setPosition(i, ball.position);
+        particles.setPastPosition(i, ball.pastPosition);
+        particles.radius[i] = ball.radius;
+        particles.inverseMass[i] = ball.mass > 0 ? 1.0f / ball.mass : 0.0f;
+        particles.cold.colors[i] = ball.color;
+        if (ball.trackPositions) {
+            particles.cold.trackedParticles.push_back((int)i);
+            RingBuffer<Vector3> path(TRACKED_PATH_CAPACITY);
+            for (const Vector3 &point : ball.previousPositions) {
+                path.push(point);
+            }
+            particles.cold.trackedPositions.push_back(std::move(path));
+            particles.cold.trackedLastVelocity.push_back(Vector3Subtract(ball.position, ball.pastPosition));
+        }
+    }
+    // Ball3d stores an acceleration per ball but the physics only supports one shared by all particles
+    if (!balls.empty()) {
+        particles.acceleration = balls[0].acceleration;
+    }
+    return particles;
+}
+
+ParticleKernelArrays kernelArrays(ParticleSystem &particles) {
+    return {
+        particles.positionX.data, particles.positionY.data, particles.positionZ.data,
+        particles.pastPositionX.data, particles.pastPositionY.data, particles.pastPositionZ.data,
+        particles.radius.data
+    };
+}
+
+std::vector<WallPlane> wallPlanes(const std::vector<Wall> &walls) {
+    std::vector<WallPlane> planes;
+    for (const Wall &wall : walls) {
+        Vector3 normal = wall.normalVector();
+        planes.push_back({ normal, Vector3DotProduct(normal, wall.centerPosition) });
+    }
+    return planes;
+}
+
+void updatePositions(ParticleSystem &particles, size_t begin, size_t end) {
+    integrateKernel(kernelArrays(particles), Vector3Scale(particles.acceleration, DT * DT), begin, end);
+}
+
+void handleWallCollisions(ParticleSystem &particles, const std::vector<Wall> &walls, size_t begin, size_t end) {
+    // Plane equations are worked out once per call instead of once per particle
+    std::vector<WallPlane> planes = wallPlanes(walls);
+    wallKernel(kernelArrays(particles), planes.data(), (int)planes.size(), begin, end);
+}
+
+// Added to the second of two particles separated by separation (first - second) to bring it to the image nearest
+// the first. Particles are at most a step outside the box, so the image is at most one box length away.
+static inline Vector3 nearestImageShift(Vector3 separation, Vector3 periodicLength) {
+    return {
+        fabsf(separation.x) > 0.5f * periodicLength.x ? copysignf(periodicLength.x, separation.x) : 0.0f,
+        fabsf(separation.y) > 0.5f * periodicLength.y ? copysignf(periodicLength.y, separation.y) : 0.0f,
+        fabsf(separation.z) > 0.5f * periodicLength.z ? copysignf(periodicLength.z, separation.z) : 0.0f
+    };
+}
+
+// Whether a grid's periodicLength wraps any axis; the grid of a slab of a periodic box only wraps y and z
+static inline bool wrapsAround(Vector3 periodicLength) {
+    return periodicLength.x > 0.0f || periodicLength.y > 0.0f || periodicLength.z > 0.0f;
+}
+
+// Where collidePair gets the constants of a pair from. With one or two species they sit in registers for the whole
+// pass and only positions are read per particle; the table of a few more is a byte per particle and a small lookup.
+// Every source hands out the same values, so the results don't depend on which one a pass uses.
+struct PerParticleConstants {
+    const float *radius;
+    const float *inverseMass;
+
+    float contactDistanceSquared(int i, int j) const {
+        float distance = radius[i] + radius[j];
+        return distance * distance;
+    }
+    SpeciesPair pair(int i, int j) const { return speciesPair(radius[i], inverseMass[i], radius[j], inverseMass[j]); }
+};
+
+struct SingleSpeciesConstants {
+    SpeciesPair constants;
+
+    float contactDistanceSquared(int, int) const { return constants.contactDistanceSquared; }
+    const SpeciesPair &pair(int, int) const { return constants; }
+};
+
+struct TwoSpeciesConstants {
+    const uint8_t *species;
+    SpeciesPair constants[4];
+
+    float contactDistanceSquared(int i, int j) const { return pair(i, j).contactDistanceSquared; }
+    const SpeciesPair &pair(int i, int j) const { return constants[2 * species[i] + species[j]]; }
+};
+
+struct SpeciesTableConstants {
+    const uint8_t *species;
+    const SpeciesPair *pairs;
+    int count;
+
+    float contactDistanceSquared(int i, int j) const { return pair(i, j).contactDistanceSquared; }
+    const SpeciesPair &pair(int i, int j) const { return pairs[species[i] * count + species[j]]; }
+};
+
+// Calls pass with the constants source for the particles' species table
+template <typename Pass>
+static void withPairConstants(const ParticleSystem &particles, Pass pass) {
+    const SpeciesTable &table = particles.speciesTable;
+    if (table.count() == 1) {
+        pass(SingleSpeciesConstants { table.pairs[0] });
+    } else if (table.count() == 2) {
+        pass(TwoSpeciesConstants { particles.species.data, { table.pairs[0], table.pairs[1], table.pairs[2], table.pairs[3] } });
+    } else if (table.count() > 2) {
+        pass(SpeciesTableConstants { particles.species.data, table.pairs.data(), table.count() });
+    } else {
+        pass(PerParticleConstants { particles.radius.data, particles.inverseMass.data });
+    }
+}
+
+// The counters are only touched when instrumentation is compiled in
+template <typename PairConstants>
+static inline bool collidePair(ParticleSystem &particles, int i, int j, Vector3 periodicLength,
+                               const PairConstants &constants, [[maybe_unused]] CollisionCounters &counters) {
+    DIFFUSION_INSTRUMENT(counters.pairTests++;)
+    Vector3 position1 = particles.position(i);
+    Vector3 position2 = particles.position(j);
+    Vector3 imageShift = { 0.0f, 0.0f, 0.0f };
+    if (wrapsAround(periodicLength)) {
+        // Collide with the nearest periodic image of particle j
+        imageShift = nearestImageShift(Vector3Subtract(position1, position2), periodicLength);
+        position2 = Vector3Add(position2, imageShift);
+    }
+    Vector3 normalVector = Vector3Subtract(position1, position2);  // points towards particle i
+    float distanceSquared = Vector3DotProduct(normalVector, normalVector);
+    if (distanceSquared > constants.contactDistanceSquared(i, j) || distanceSquared == 0.0f) {
+        return false;  // No collision (or no direction to push them apart along)
+    }
+    // Reading the clock for every contact would cost more than resolving it, so only every NARROW_SAMPLE_EVERY-th is timed
+    DIFFUSION_INSTRUMENT(
+        bool timed = counters.contacts++ % NARROW_SAMPLE_EVERY == 0;
+        auto narrowStart = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    )
+
+    const SpeciesPair &pair = constants.pair(i, j);
+    float distance = sqrtf(distanceSquared);
+    Vector3 unitNormal = Vector3Scale(normalVector, 1.0f / distance);
+    Vector3 velocity1 = particles.getVelocity(i);
+    Vector3 velocity2 = particles.getVelocity(j);
+
+    // Elastic collision along the normal, skipped if the particles are already separating
+    float approachSpeed = Vector3DotProduct(unitNormal, velocity1) - Vector3DotProduct(unitNormal, velocity2);
+    if (approachSpeed < 0.0f && (pair.impulseShare[0] > 0.0f || pair.impulseShare[1] > 0.0f)) {
+        velocity1 = Vector3Add(velocity1, Vector3Scale(unitNormal, -approachSpeed * pair.impulseShare[0]));
+        velocity2 = Vector3Add(velocity2, Vector3Scale(unitNormal, approachSpeed * pair.impulseShare[1]));
+        DIFFUSION_INSTRUMENT(counters.collisions++;)
+    }
+
+    // Resolve overlap after collision
+    float distanceAfterCollision = Vector3Distance(Vector3Add(position1, Vector3Scale(velocity1, DT)),
+                                                   Vector3Add(position2, Vector3Scale(velocity2, DT)));
+    float overlapAfterCollision = pair.contactDistance - distanceAfterCollision;
+    if (overlapAfterCollision > 0.0f) {
+        position1 = Vector3Add(position1, Vector3Scale(unitNormal, overlapAfterCollision * pair.overlapShare[0]));
+        position2 = Vector3Add(position2, Vector3Scale(unitNormal, -1.0f * overlapAfterCollision * pair.overlapShare[1]));
+        DIFFUSION_INSTRUMENT(counters.overlapCorrections++;)
+    }
+
+    particles.setPosition(i, position1);
+    particles.setPosition(j, Vector3Subtract(position2, imageShift));
+    particles.setVelocity(i, velocity1);
+    particles.setVelocity(j, velocity2);
+    DIFFUSION_INSTRUMENT(if (timed) counters.narrowSeconds += NARROW_SAMPLE_EVERY * secondsSince(narrowStart);)
+    return true;
+}
+
+bool handleParticleCollision(ParticleSystem &particles, int i, int j, Vector3 periodicLength) {
+    CollisionCounters counters;
+    PerParticleConstants constants = { particles.radius.data, particles.inverseMass.data };
+    return collidePair(particles, i, j, periodicLength, constants, counters);
+}
+
+void handleParticleCollisions(ParticleSystem &particles, const CollisionGrid &grid, int cellBegin, int cellEnd) {
+    Vector3 periodicLength = grid.periodicLength();
+    CollisionCounters counters;
+    withPairConstants(particles, [&](const auto &constants) {
+        grid.forEachNeighbourPair([&](int i, int j) {
+            collidePair(particles, i, j, periodicLength, constants, counters);
+        }, cellBegin, cellEnd);
+    });
+}
+
+// Cells of one colour per task when the collision pass is split across threads
+const int CELLS_PER_TASK = 64;
+
+CollisionCounters handleParticleCollisions(ParticleSystem &particles, const CollisionGrid &grid, ThreadPool *pool) {
+    Vector3 periodicLength = grid.periodicLength();
+    CollisionCounters total;
+    [[maybe_unused]] std::mutex totalMutex;
+    withPairConstants(particles, [&](const auto &constants) {
+        for (int colour = 0; colour < CollisionGrid::numberCellColours; ++colour) {
+            int first = grid.colourStart[colour];
+            int numberCells = grid.colourStart[colour + 1] - first;
+            parallelForChunks(pool, numberCells, CELLS_PER_TASK, [&](size_t begin, size_t end) {
+                CollisionCounters counters;
+                DIFFUSION_INSTRUMENT(auto passStart = std::chrono::steady_clock::now();)
+                auto collide = [&particles, periodicLength, &constants, &counters](int i, int j) {
+                    collidePair(particles, i, j, periodicLength, constants, counters);
+                };
+                for (size_t c = begin; c < end; ++c) {
+                    grid.forEachPairFromCell(collide, grid.occupiedCells[first + c]);
+                }
+                DIFFUSION_INSTRUMENT(
+                    counters.passSeconds += secondsSince(passStart);
+                    std::lock_guard<std::mutex> lock(totalMutex);
+                    total.add(counters);
+                )
+            });
+        }
+    });
+    return total;
+}
+
+void rebuildGrid(CollisionGrid &grid, const ParticleSystem &particles, ThreadPool *pool) {
+    grid.resizeBalls((int)particles.count);
+    parallelForChunks(pool, particles.count, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        grid.assignCells((int)begin, (int)end, [&particles](int i) { return particles.position(i); });
+    });
+    grid.sortBallsByCell();
+}
+
+// Small enough to keep zero radius particles from making every other radius a separate class
+const float SMALLEST_CLASS_RADIUS = 5e-4f;
+
+static float smallestRadius(const ParticleSystem &particles) {
+    float smallest = particles.count > 0 ? particles.radius[0] : 0.0f;
+    for (size_t i = 1; i < particles.count; ++i) {
+        smallest = std::min(smallest, particles.radius[i]);
+    }
+    return std::max(smallest, SMALLEST_CLASS_RADIUS);
+}
+
+float fineGridRadius(const ParticleSystem &particles) {
+    float limit = LEVEL_RADIUS_RATIO * smallestRadius(particles);
+    float largest = 0.0f;
+    for (size_t i = 0; i < particles.count; ++i) {
+        if (particles.radius[i] <= limit) largest = std::max(largest, particles.radius[i]);
+    }
+    return largest;
+}
+
+std::vector<GridLevel> coarseGridLevels(const ParticleSystem &particles, const std::function<CollisionGrid(float)> &makeGrid) {
+    float smallest = smallestRadius(particles);
+    std::vector<float> largestInClass;
+    for (size_t i = 0; i < particles.count; ++i) {
+        size_t sizeClass = 0;
+        for (float limit = LEVEL_RADIUS_RATIO * smallest; particles.radius[i] > limit; limit *= LEVEL_RADIUS_RATIO) {
+            sizeClass++;
+        }
+        if (sizeClass == 0) continue;
+        if (largestInClass.size() <= sizeClass) largestInClass.resize(sizeClass + 1, 0.0f);
+        largestInClass[sizeClass] = std::max(largestInClass[sizeClass], particles.radius[i]);
+    }
+
+    std::vector<GridLevel> levels;
+    float minRadius = smallest;
+    for (size_t sizeClass = 1; sizeClass < largestInClass.size(); ++sizeClass) {
+        minRadius *= LEVEL_RADIUS_RATIO;
+        if (largestInClass[sizeClass] > 0.0f) {
+            levels.push_back({ minRadius, largestInClass[sizeClass], makeGrid(largestInClass[sizeClass]), {} });
+        }
+    }
+    return levels;
+}
+
+void rebuildGrid(CollisionGrid &grid, std::vector<GridLevel> &levels, const ParticleSystem &particles, ThreadPool *pool) {
+    if (levels.empty()) {
+        rebuildGrid(grid, particles, pool);
+        return;
+    }
+    float fineLimit = levels.front().minRadius;
+    grid.resizeBalls((int)particles.count);
+    parallelForChunks(pool, particles.count, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (particles.radius[i] <= fineLimit) {
+                grid.assignCell((int)i, particles.position(i));
+            } else {
+                grid.leaveOut((int)i);
+            }
+        }
+    });
+    grid.sortBallsByCell();
+
+    for (GridLevel &level : levels) {
+        level.members.clear();
+    }
+    for (size_t i = 0; i < particles.count; ++i) {
+        if (grid.ballCells[i] >= 0) continue;
+        for (GridLevel &level : levels) {
+            if (particles.radius[i] <= level.maxRadius) {
+                level.members.push_back((int)i);
+                break;
+            }
+        }
+    }
+    rebuildCoarseLevels(levels, particles);
+}
+
+// Pairs within each coarse level and of coarse particles with smaller ones, on the calling thread.
+// fineReachPadding grows the box looked up in the fine grid, for when it is older than the positions.
+static void handleCoarseLevelCollisions(ParticleSystem &particles, const CollisionGrid &grid,
+                                        const std::vector<GridLevel> &levels, float fineReachPadding,
+                                        [[maybe_unused]] CollisionCounters &total) {
+    Vector3 periodicLength = grid.periodicLength();
+    CollisionCounters counters;
+    DIFFUSION_INSTRUMENT(auto passStart = std::chrono::steady_clock::now();)
+    withPairConstants(particles, [&](const auto &constants) {
+        auto collide = [&particles, periodicLength, &constants, &counters](int i, int j) {
+            collidePair(particles, i, j, periodicLength, constants, counters);
+        };
+        // Fine particles are at most levels[0].minRadius
+        float fineRadius = levels.front().minRadius;
+        for (size_t l = 0; l < levels.size(); ++l) {
+            const GridLevel &level = levels[l];
+            level.grid.forEachNeighbourPair([&collide, &level](int a, int b) {
+                collide(level.members[a], level.members[b]);
+            });
+            for (int i : level.members) {
+                Vector3 position = particles.position(i);
+                float reach = particles.radius[i] + fineRadius + fineReachPadding;
+                Vector3 extent = { reach, reach, reach };
+                grid.forEachBallInBox(Vector3Subtract(position, extent), Vector3Add(position, extent),
+                                      [&collide, i](int j) { collide(i, j); });
+                for (size_t lower = 0; lower < l; ++lower) {
+                    const GridLevel &lowerLevel = levels[lower];
+                    reach = particles.radius[i] + lowerLevel.maxRadius;
+                    extent = { reach, reach, reach };
+                    lowerLevel.grid.forEachBallInBox(Vector3Subtract(position, extent), Vector3Add(position, extent),
+                                                     [&collide, &lowerLevel, i](int k) { collide(i, lowerLevel.members[k]); });
+                }
+            }
+        }
+    });
+    DIFFUSION_INSTRUMENT(
+        counters.passSeconds += secondsSince(passStart);
+        total.add(counters);
+    )
+}
+
+CollisionCounters handleParticleCollisions(ParticleSystem &particles, const CollisionGrid &grid,
+                                           const std::vector<GridLevel> &levels, ThreadPool *pool) {
+    CollisionCounters total = handleParticleCollisions(particles, grid, pool);
+    if (!levels.empty()) {
+        handleCoarseLevelCollisions(particles, grid, levels, 0.0f, total);
+    }
+    return total;
+}
+
+void buildNeighbourList(NeighbourList &list, const CollisionGrid &grid, const ParticleSystem &particles, ThreadPool *pool) {
+    size_t n = particles.count;
+    list.firstPartner.assign(n, 0);
+    list.partnerCount.assign(n, 0);
+    list.builtX.assign(particles.positionX.data, particles.positionX.data + n);
+    list.builtY.assign(particles.positionY.data, particles.positionY.data + n);
+    list.builtZ.assign(particles.positionZ.data, particles.positionZ.data + n);
+
+    // Positions and radii in grid order, so the candidates in a cell are read one after another
+    const std::vector<int> &sorted = grid.sortedBallIndices;
+    std::vector<float> sortedX(sorted.size()), sortedY(sorted.size()), sortedZ(sorted.size()), sortedRadius(sorted.size());
+    parallelForChunks(pool, sorted.size(), PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t a = begin; a < end; ++a) {
+            sortedX[a] = particles.positionX[sorted[a]];
+            sortedY[a] = particles.positionY[sorted[a]];
+            sortedZ[a] = particles.positionZ[sorted[a]];
+            sortedRadius[a] = particles.radius[sorted[a]];
+        }
+    });
+
+    // Each task lists the partners of the particles in its cells, then the tasks' lists are joined in order
+    Vector3 periodicLength = grid.periodicLength();
+    bool periodic = wrapsAround(periodicLength);
+    size_t numberCells = grid.occupiedCells.size();
+    std::vector<std::vector<int>> taskPartners((numberCells + CELLS_PER_TASK - 1) / CELLS_PER_TASK);
+    parallelForChunks(pool, numberCells, CELLS_PER_TASK, [&](size_t begin, size_t end) {
+        std::vector<int> &found = taskPartners[begin / CELLS_PER_TASK];
+        for (size_t c = begin; c < end; ++c) {
+            int cell = grid.occupiedCells[c];
+            int cellEnd = grid.cellStart[cell + 1];
+            int ahead[13];
+            int numberAhead = 0;
+            grid.forEachCellAhead(cell, [&ahead, &numberAhead](int neighbour) { ahead[numberAhead++] = neighbour; });
+
+            for (int a = grid.cellStart[cell]; a < cellEnd; ++a) {
+                Vector3 position = { sortedX[a], sortedY[a], sortedZ[a] };
+                float reach = sortedRadius[a] + list.skin;
+                size_t start = found.size();
+                auto considerRange = [&](int first, int last) {
+                    for (int b = first; b < last; ++b) {
+                        Vector3 separation = { position.x - sortedX[b], position.y - sortedY[b], position.z - sortedZ[b] };
+                        if (periodic) {
+                            separation = Vector3Subtract(separation, nearestImageShift(separation, periodicLength));
+                        }
+                        float cutoff = reach + sortedRadius[b];
+                        if (Vector3DotProduct(separation, separation) <= cutoff * cutoff) found.push_back(sorted[b]);
+                    }
+                };
+                considerRange(a + 1, cellEnd);
+                for (int k = 0; k < numberAhead; ++k) {
+                    considerRange(grid.cellStart[ahead[k]], grid.cellStart[ahead[k] + 1]);
+                }
+                list.firstPartner[sorted[a]] = (int)start;
+                list.partnerCount[sorted[a]] = (int)(found.size() - start);
+            }
+        }
+    });
+
+    std::vector<int> taskOffset(taskPartners.size() + 1, 0);
+    for (size_t t = 0; t < taskPartners.size(); ++t) {
+        taskOffset[t + 1] = taskOffset[t] + (int)taskPartners[t].size();
+    }
+    list.partners.resize(taskOffset.back());
+    parallelForChunks(pool, numberCells, CELLS_PER_TASK, [&](size_t begin, size_t end) {
+        size_t task = begin / CELLS_PER_TASK;
+        std::copy(taskPartners[task].begin(), taskPartners[task].end(), list.partners.begin() + taskOffset[task]);
+        for (size_t c = begin; c < end; ++c) {
+            int cell = grid.occupiedCells[c];
+            for (int a = grid.cellStart[cell]; a < grid.cellStart[cell + 1]; ++a) {
+                list.firstPartner[grid.sortedBallIndices[a]] += taskOffset[task];
+            }
+        }
+    });
+    list.valid = true;
+}
+
+float largestDisplacementSinceBuild(const NeighbourList &list, const ParticleSystem &particles, Vector3 periodicLength,
+                                    ThreadPool *pool) {
+    size_t numberChunks = (particles.count + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+    std::vector<float> chunkLargest(numberChunks, 0.0f);
+    parallelForChunks(pool, particles.count, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        float largest = 0.0f;
+        for (size_t i = begin; i < end; ++i) {
+            Vector3 displacement = { particles.positionX[i] - list.builtX[i], particles.positionY[i] - list.builtY[i],
+                                     particles.positionZ[i] - list.builtZ[i] };
+            if (wrapsAround(periodicLength)) {
+                displacement = Vector3Subtract(displacement, nearestImageShift(displacement, periodicLength));
+            }
+            largest = std::max(largest, Vector3DotProduct(displacement, displacement));
+        }
+        chunkLargest[begin / PARTICLE_CHUNK_SIZE] = largest;
+    });
+    float largest = 0.0f;
+    for (float chunk : chunkLargest) {
+        largest = std::max(largest, chunk);
+    }
+    return sqrtf(largest);
+}
+
+void rebuildCoarseLevels(std::vector<GridLevel> &levels, const ParticleSystem &particles) {
+    for (GridLevel &level : levels) {
+        level.grid.rebuild((int)level.members.size(), [&particles, &level](int k) {
+            return particles.position(level.members[k]);
+        });
+    }
+}
+
+CollisionCounters handleParticleCollisions(ParticleSystem &particles, const CollisionGrid &grid, const NeighbourList &list,
+                                           const std::vector<GridLevel> &levels, ThreadPool *pool) {
+    Vector3 periodicLength = grid.periodicLength();
+    CollisionCounters total;
+    [[maybe_unused]] std::mutex totalMutex;
+    withPairConstants(particles, [&](const auto &constants) {
+        for (int colour = 0; colour < CollisionGrid::numberCellColours; ++colour) {
+            int first = grid.colourStart[colour];
+            int numberCells = grid.colourStart[colour + 1] - first;
+            parallelForChunks(pool, numberCells, CELLS_PER_TASK, [&](size_t begin, size_t end) {
+                CollisionCounters counters;
+                DIFFUSION_INSTRUMENT(auto passStart = std::chrono::steady_clock::now();)
+                for (size_t c = begin; c < end; ++c) {
+                    int cell = grid.occupiedCells[first + c];
+                    for (int a = grid.cellStart[cell]; a < grid.cellStart[cell + 1]; ++a) {
+                        int i = grid.sortedBallIndices[a];
+                        const int *partner = list.partners.data() + list.firstPartner[i];
+                        for (int k = 0; k < list.partnerCount[i]; ++k) {
+                            collidePair(particles, i, partner[k], periodicLength, constants, counters);
+                        }
+                    }
+                }
+                DIFFUSION_INSTRUMENT(
+                    counters.passSeconds += secondsSince(passStart);
+                    std::lock_guard<std::mutex> lock(totalMutex);
+                    total.add(counters);
+                )
+            });
+        }
+    });
+    if (!levels.empty()) {
+        handleCoarseLevelCollisions(particles, grid, levels, 0.5f * list.skin, total);
+    }
+    return total;
+}
+
+// Moves the particle in slot order[k] to slot k in one attribute array
+template <typename T>
+static void permute(AlignedArray<T> &array, const std::vector<int> &order, ThreadPool *pool) {
+    AlignedArray<T> permuted(array.size);
+    parallelForChunks(pool, order.size(), PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            permuted[k] = array[order[k]];
+        }
+    });
+    array = std::move(permuted);
+}
+
+void reorderParticles(ParticleSystem &particles, const CollisionGrid &grid, ThreadPool *pool) {
+    size_t n = particles.count;
+    std::vector<uint64_t> codes(n);
+    parallelForChunks(pool, n, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            codes[i] = grid.mortonCodeOf(particles.position(i));
+        }
+    });
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&codes](int a, int b) { return codes[a] < codes[b]; });
+
+    permute(particles.positionX, order, pool);
+    permute(particles.positionY, order, pool);
+    permute(particles.positionZ, order, pool);
+    permute(particles.pastPositionX, order, pool);
+    permute(particles.pastPositionY, order, pool);
+    permute(particles.pastPositionZ, order, pool);
+    permute(particles.radius, order, pool);
+    permute(particles.inverseMass, order, pool);
+    permute(particles.species, order, pool);
+
+    std::vector<int> ids(n);
+    for (size_t k = 0; k < n; ++k) {
+        ids[k] = particles.ids[order[k]];
+        particles.slotOfId[ids[k]] = (int)k;
+    }
+    particles.ids = std::move(ids);
+}
@@ -0,0 +1,268 @@
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include "Objects.h"
+#include "CollisionGrid.h"
+#include "Instrumentation.h"
+#include "RingBuffer.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+
+// Particles per task when a particle loop is split across threads, a multiple of every SIMD width
+const size_t PARTICLE_CHUNK_SIZE = 4096;
+
+// Alignment of every particle array, one cache line (and wide enough for any SIMD load)
+const size_t PARTICLE_ALIGNMENT = 64;
+
+// Contiguous, cache line aligned storage for one particle attribute.
+// The capacity is padded to a whole number of cache lines so vector loads past the last particle stay in bounds.
+// Copies are deep; storage only keeps the allocation alive.
+template <typename T>
+struct AlignedArray {
+    T *data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<void> storage;
+
+    static size_t paddedCapacity(size_t n) {
+        size_t perLine = PARTICLE_ALIGNMENT / sizeof(T);
+        return (n + perLine - 1) / perLine * perLine;
+    }
+
+    // Keeps the first min(size, n) elements, new elements are zeroed
+    void resize(size_t n) {
+        size_t capacity = paddedCapacity(n);
+        T *newData = nullptr;
+        if (capacity > 0) {
+            newData = static_cast<T *>(::operator new(capacity * sizeof(T), std::align_val_t(PARTICLE_ALIGNMENT)));
+            memset(newData, 0, capacity * sizeof(T));
+            if (data != nullptr) {
+                memcpy(newData, data, (n < size ? n : size) * sizeof(T));
+            }
+        }
+        storage.reset(newData, [](void *pointer) {
+            ::operator delete(pointer, std::align_val_t(PARTICLE_ALIGNMENT));
+        });
+        data = newData;
+        size = n;
+    }
+
+    T &operator[](size_t i) { return data[i]; }
+    const T &operator[](size_t i) const { return data[i]; }
+
+    AlignedArray() = default;
+    explicit AlignedArray(size_t n) { resize(n); }
+    AlignedArray(const AlignedArray &other) { *this = other; }
+    AlignedArray &operator=(const AlignedArray &other) {
+        if (this != &other) {
+            AlignedArray copy;
+            copy.resize(other.size);
+            if (other.size > 0) {
+                memcpy(copy.data, other.data, other.size * sizeof(T));
+            }
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    AlignedArray(AlignedArray &&other) noexcept { *this = std::move(other); }
+    AlignedArray &operator=(AlignedArray &&other) noexcept {
+        data = other.data;
+        size = other.size;
+        storage = std::move(other.storage);
+        other.data = nullptr;
+        other.size = 0;
+        return *this;
+    }
+};
+
+// Points kept per tracked particle, older ones are dropped
+const size_t TRACKED_PATH_CAPACITY = 4096;
+
+// Per-particle data that the physics loop never reads, indexed by particle id (see ParticleSystem::ids)
+struct ParticleColdData {
+    std::vector<Color> colors;
+    std::vector<int> trackedParticles;  // ids
+    std::vector<RingBuffer<Vector3>> trackedPositions;  // one path per entry of trackedParticles
+    std::vector<Vector3> trackedLastVelocity;
+};
+
+// Constants of a collision between two kinds of particle, worked out once instead of on every contact
+struct SpeciesPair {
+    float contactDistance;  // sum of the radii
+    float contactDistanceSquared;
+    float impulseShare[2];  // 2 * inverse mass / sum of the inverse masses, for each particle; 0 if neither can move
+    float overlapShare[2];  // radius / contactDistance, for each particle
+};
+
+SpeciesPair speciesPair(float radius1, float inverseMass1, float radius2, float inverseMass2);
+
+// Kinds of particle told apart by ParticleSystem::assignSpecies before it gives up and leaves the table empty
+const int MAX_SPECIES = 16;
+
+// The distinct (radius, inverse mass) combinations of a ParticleSystem and the constants of every pair of them
+struct SpeciesTable {
+    std::vector<float> radius;
+    std::vector<float> inverseMass;
+    std::vector<SpeciesPair> pairs;  // species a against species b at a * count() + b
+
+    int count() const { return (int)radius.size(); }
+};
+
+// Structure-of-arrays store of every ball in the simulation.
+// The arrays read by the physics each step are split per component so kernels stream through them.
+// As with Ball3d the velocity is implicit: the displacement position - pastPosition over the last DT.
+//
+// The arrays are indexed by slot. reorderParticles moves particles between slots, so anything that follows a
+// particle over time refers to it by id, its slot when the system was created, and looks the slot up in slotOfId.
+struct ParticleSystem {
+    size_t count = 0;
+    AlignedArray<float> positionX;
+    AlignedArray<float> positionY;
+    AlignedArray<float> positionZ;
+    AlignedArray<float> pastPositionX;
+    AlignedArray<float> pastPositionY;
+    AlignedArray<float> pastPositionZ;
+    AlignedArray<float> radius;
+    AlignedArray<float> inverseMass;  // 0 for immovable particles
+    // Index into speciesTable, derived from radius and inverseMass, which stay what walls, grids, snapshots and
+    // the event driven engine read. Only the collision pass reads species instead, while the table is filled in.
+    // resize empties the table, so a refilled system falls back to radius and inverseMass until assignSpecies is
+    // called; only editing either for existing particles in place needs an explicit assignSpecies.
+    AlignedArray<uint8_t> species;
+    SpeciesTable speciesTable;
+    Vector3 acceleration = { 0.0f, 0.0f, 0.0f };  // shared by all particles
+    std::vector<int> ids;        // id of the particle in each slot
+    std::vector<int> slotOfId;
+    ParticleColdData cold;
+
+    // Slots and ids start out the same
+    void resize(size_t n);
+
+    // Sorts the particles into species by radius and inverse mass. With more than MAX_SPECIES of them the table
+    // is left empty and the collision pass reads the per-particle values.
+    void assignSpecies();
+
+    Vector3 position(size_t i) const {
+        return { positionX[i], positionY[i], positionZ[i] };
+    }
+    Vector3 pastPosition(size_t i) const {
+        return { pastPositionX[i], pastPositionY[i], pastPositionZ[i] };
+    }
+    Vector3 getVelocity(size_t i) const {
+        return { positionX[i] - pastPositionX[i], positionY[i] - pastPositionY[i], positionZ[i] - pastPositionZ[i] };
+    }
+    void setPosition(size_t i, Vector3 newPosition) {
+        positionX[i] = newPosition.x;
+        positionY[i] = newPosition.y;
+        positionZ[i] = newPosition.z;
+    }
+    void setPastPosition(size_t i, Vector3 newPastPosition) {
+        pastPositionX[i] = newPastPosition.x;
+        pastPositionY[i] = newPastPosition.y;
+        pastPositionZ[i] = newPastPosition.z;
+    }
+    void setVelocity(size_t i, Vector3 newVelocity) {
+        setPastPosition(i, Vector3Subtract(position(i), Vector3Scale(newVelocity, DT)));
+    }
+
+    float largestRadius() const;
+
+    // Appends the current position of every tracked particle whose velocity changed since the last call,
+    // so the stored path has a point at every collision (the last TRACKED_PATH_CAPACITY of them)
+    void recordTrackedPositions();
+};
+
+ParticleSystem particleSystemFromBalls(const std::vector<Ball3d> &balls);
+
+ParticleKernelArrays kernelArrays(ParticleSystem &particles);
+// Walls as planes with normals pointing into the room
+std::vector<WallPlane> wallPlanes(const std::vector<Wall> &walls);
+
+// Batch equivalents of Ball3d::updatePosition and Ball3d::handleWallCollision for particles [begin, end),
+// run with the SIMD kernels
+void updatePositions(ParticleSystem &particles, size_t begin, size_t end);
+void handleWallCollisions(ParticleSystem &particles, const std::vector<Wall> &walls, size_t begin, size_t end);
+
+// Batch equivalent of handleBallCollision, returns true if the particles were touching.
+// With a non-zero periodicLength (see CollisionGrid::periodicLength) particle i meets the nearest image of j.
+bool handleParticleCollision(ParticleSystem &particles, int i, int j, Vector3 periodicLength = { 0.0f, 0.0f, 0.0f });
+
+// Resolves every touching pair found by the grid whose first particle lies in a cell in [cellBegin, cellEnd).
+// The grid must have been rebuilt from the current positions.
+void handleParticleCollisions(ParticleSystem &particles, const CollisionGrid &grid, int cellBegin, int cellEnd);
+
+// Resolves every touching pair, one cell colour at a time with the cells of a colour spread over the pool.
+// The result is bit-identical for any number of threads, including no pool at all.
+// The counters are only filled in when instrumentation is compiled in.
+CollisionCounters handleParticleCollisions(ParticleSystem &particles, const CollisionGrid &grid, ThreadPool *pool);
+
+void rebuildGrid(CollisionGrid &grid, const ParticleSystem &particles, ThreadPool *pool = nullptr);
+
+// Radii up to this many times the smallest share the fine grid, each further doubling is a coarse level
+const float LEVEL_RADIUS_RATIO = 2.0f;
+
+// Largest radius of the particles that go in the fine grid, those up to LEVEL_RADIUS_RATIO times the smallest radius
+float fineGridRadius(const ParticleSystem &particles);
+
+// Coarse levels for the particles too large for the fine grid, in increasing radius, one per non-empty class
+// (smallest * ratio^c, smallest * ratio^(c + 1)]. Empty when the fine grid holds everything.
+// makeGrid(maxRadius) builds the grid of a level.
+std::vector<GridLevel> coarseGridLevels(const ParticleSystem &particles, const std::function<CollisionGrid(float)> &makeGrid);
+
+// rebuildGrid for a hierarchy: particles in a coarse level are left out of the fine grid and binned in their level
+void rebuildGrid(CollisionGrid &grid, std::vector<GridLevel> &levels, const ParticleSystem &particles, ThreadPool *pool = nullptr);
+
+// handleParticleCollisions for a hierarchy: the fine grid as above, then each coarse level in turn on the calling
+// thread, pairs within the level followed by its particles against the smaller ones in the fine grid and lower levels.
+// Coarse particles are expected to be few, for the fine pass is the only one spread over the pool.
+CollisionCounters handleParticleCollisions(ParticleSystem &particles, const CollisionGrid &grid,
+                                           const std::vector<GridLevel> &levels, ThreadPool *pool);
+
+// Verlet neighbour lists: every pair of fine grid particles closer than r1 + r2 + skin at the last build, grouped by
+// the first particle of the pair. Until some particle has moved skin / 2 from where it was then, no pair missing
+// from the lists can touch, so they stand in for the grid rebuild and the 27 cell scan for many steps.
+// The grid is left as it was at the build: its cells still give every particle a colour for the parallel pass,
+// since a particle's partners were all in the cells around its own.
+struct NeighbourList {
+    float skin = 0.0f;
+    std::vector<int> firstPartner;  // the partners of particle i are partners[firstPartner[i]] onwards
+    std::vector<int> partnerCount;
+    std::vector<int> partners;
+    std::vector<float> builtX;  // positions at the last build
+    std::vector<float> builtY;
+    std::vector<float> builtZ;
+    bool valid = false;  // cleared when the particles move between slots or are replaced
+
+    bool usable(const ParticleSystem &particles) const {
+        return valid && builtX.size() == particles.count;
+    }
+};
+
+// Fills the lists from grid, which must have been rebuilt from the current positions with cells at least
+// 2 * the largest fine radius + skin wide. The lists come out the same for any pool.
+void buildNeighbourList(NeighbourList &list, const CollisionGrid &grid, const ParticleSystem &particles, ThreadPool *pool = nullptr);
+
+// Largest distance any particle has moved since the lists were built, to the nearest image when periodic
+float largestDisplacementSinceBuild(const NeighbourList &list, const ParticleSystem &particles, Vector3 periodicLength,
+                                    ThreadPool *pool = nullptr);
+
+// Rebuilds only the coarse level grids, with the members they had at the last full rebuild
+void rebuildCoarseLevels(std::vector<GridLevel> &levels, const ParticleSystem &particles);
+
+// handleParticleCollisions for a hierarchy with the fine pairs taken from the lists. grid is the one the lists were
+// built from; coarse particles look fine ones up in it with their reach grown by half the skin, as far as any of
+// them can have moved since.
+CollisionCounters handleParticleCollisions(ParticleSystem &particles, const CollisionGrid &grid, const NeighbourList &list,
+                                           const std::vector<GridLevel> &levels, ThreadPool *pool);
+
+// Sorts the particles by the Morton code of their grid cell, keeping the current order within a cell, so
+// particles close in space are close in memory and the collision pass reads neighbouring cells from cache.
+// The grid only has to have the right layout; it needs a rebuild afterwards.
+void reorderParticles(ParticleSystem &particles, const CollisionGrid &grid, ThreadPool *pool = nullptr);
+
+#endif // PARTICLE_SYSTEM_H
@@ -0,0 +1,44 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <vector>
+
+// Fixed-capacity buffer that overwrites its oldest item when full, so memory stays bounded however long it runs.
+// Items are indexed oldest first and read in place.
+template <typename T>
+struct RingBuffer {
+    std::vector<T> items;
+    size_t first = 0;  // index of the oldest item in items
+    size_t count = 0;
+
+    size_t capacity() const { return items.size(); }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void push(const T &item) {
+        if (items.empty()) return;
+        size_t index = first + count;
+        if (index >= items.size()) index -= items.size();
+        items[index] = item;
+        if (count < items.size()) {
+            count++;
+        } else if (++first == items.size()) {
+            first = 0;
+        }
+    }
+
+    const T &operator[](size_t i) const {
+        size_t index = first + i;
+        return items[index >= items.size() ? index - items.size() : index];
+    }
+    const T &back() const { return (*this)[count - 1]; }
+
+    void clear() {
+        first = 0;
+        count = 0;
+    }
+
+    explicit RingBuffer(size_t capacity = 0) : items(capacity) {}
+};
+
+#endif // RING_BUFFER_H
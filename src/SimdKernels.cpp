@@ -0,0 +1,494 @@
+#include "SimdKernels.h"
+#include "Objects.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DIFFUSION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// Scalar kernels, also used for the remainder of a range that does not fill a vector
+//--------------------------------------------------------------------------------------
+
+static void integrateScalar(const ParticleKernelArrays &a, Vector3 accelerationStep, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        float velocityX = a.x[i] - a.pastX[i];
+        float velocityY = a.y[i] - a.pastY[i];
+        float velocityZ = a.z[i] - a.pastZ[i];
+        a.pastX[i] = a.x[i];
+        a.pastY[i] = a.y[i];
+        a.pastZ[i] = a.z[i];
+        a.x[i] = a.x[i] + (velocityX * DT + accelerationStep.x);
+        a.y[i] = a.y[i] + (velocityY * DT + accelerationStep.y);
+        a.z[i] = a.z[i] + (velocityZ * DT + accelerationStep.z);
+    }
+}
+
+static void wallScalar(const ParticleKernelArrays &a, const WallPlane *planes, int planeCount, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        float x = a.x[i], y = a.y[i], z = a.z[i];
+        float velocityX = x - a.pastX[i];
+        float velocityY = y - a.pastY[i];
+        float velocityZ = z - a.pastZ[i];
+        float radius = a.radius[i];
+        bool collided = false;
+
+        for (int w = 0; w < planeCount; ++w) {
+            Vector3 n = planes[w].normal;
+            float signedDistance = n.x * x + n.y * y + n.z * z - planes[w].offset;
+            if (signedDistance > radius) continue;
+            collided = true;
+
+            // Only reflect the normal component if the ball is moving towards the wall
+            float normalVelocity = n.x * velocityX + n.y * velocityY + n.z * velocityZ;
+            if (normalVelocity < 0.0f) {
+                float reflection = -2.0f * normalVelocity;
+                velocityX = velocityX + n.x * reflection;
+                velocityY = velocityY + n.y * reflection;
+                velocityZ = velocityZ + n.z * reflection;
+            }
+
+            // resolve overlap after collision
+            float nextX = x + velocityX * DT;
+            float nextY = y + velocityY * DT;
+            float nextZ = z + velocityZ * DT;
+            float overlap = radius - (n.x * nextX + n.y * nextY + n.z * nextZ - planes[w].offset);
+            if (overlap > 0.0f) {
+                x = x + n.x * overlap;
+                y = y + n.y * overlap;
+                z = z + n.z * overlap;
+            }
+        }
+
+        if (collided) {
+            a.x[i] = x;
+            a.y[i] = y;
+            a.z[i] = z;
+            a.pastX[i] = x - velocityX * DT;
+            a.pastY[i] = y - velocityY * DT;
+            a.pastZ[i] = z - velocityZ * DT;
+        }
+    }
+}
+
+// Axis-aligned box: each wall is a min/max compare along one axis. lower and upper are the box faces moved in by
+// the radius, and a ball collides when it reaches them, like wallScalar with axis-aligned normals.
+static inline bool reflectAxisScalar(float &position, float &velocity, float lower, float upper) {
+    bool collided = false;
+    if (position <= lower) {
+        collided = true;
+        if (velocity < 0.0f) velocity = -velocity;
+        float next = position + velocity * DT;
+        if (next < lower) position = position + (lower - next);
+    }
+    if (position >= upper) {
+        collided = true;
+        if (velocity > 0.0f) velocity = -velocity;
+        float next = position + velocity * DT;
+        if (next > upper) position = position - (next - upper);
+    }
+    return collided;
+}
+
+static void boxScalar(const ParticleKernelArrays &a, Vector3 boxMin, Vector3 boxMax, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        float x = a.x[i], y = a.y[i], z = a.z[i];
+        float velocityX = x - a.pastX[i];
+        float velocityY = y - a.pastY[i];
+        float velocityZ = z - a.pastZ[i];
+        float radius = a.radius[i];
+        bool collided = reflectAxisScalar(x, velocityX, boxMin.x + radius, boxMax.x - radius);
+        collided |= reflectAxisScalar(y, velocityY, boxMin.y + radius, boxMax.y - radius);
+        collided |= reflectAxisScalar(z, velocityZ, boxMin.z + radius, boxMax.z - radius);
+
+        if (collided) {
+            a.x[i] = x;
+            a.y[i] = y;
+            a.z[i] = z;
+            a.pastX[i] = x - velocityX * DT;
+            a.pastY[i] = y - velocityY * DT;
+            a.pastZ[i] = z - velocityZ * DT;
+        }
+    }
+}
+
+// Periodic box: particles that left through one face are moved back in through the opposite one.
+// The past position moves with them so the velocity is unchanged. A particle never moves a whole box per step.
+static inline void wrapAxis(float &position, float &pastPosition, float lower, float upper, float length) {
+    if (position < lower) {
+        position = position + length;
+        pastPosition = pastPosition + length;
+    } else if (position >= upper) {
+        position = position - length;
+        pastPosition = pastPosition - length;
+    }
+}
+
+static void periodicScalar(const ParticleKernelArrays &a, Vector3 boxMin, Vector3 boxMax, size_t begin, size_t end) {
+    Vector3 length = Vector3Subtract(boxMax, boxMin);
+    for (size_t i = begin; i < end; ++i) {
+        wrapAxis(a.x[i], a.pastX[i], boxMin.x, boxMax.x, length.x);
+        wrapAxis(a.y[i], a.pastY[i], boxMin.y, boxMax.y, length.y);
+        wrapAxis(a.z[i], a.pastZ[i], boxMin.z, boxMax.z, length.z);
+    }
+}
+
+#if defined(DIFFUSION_X86)
+
+// SSE2 kernels, 4 particles at a time
+//--------------------------------------------------------------------------------------
+
+static inline __m128 select128(__m128 mask, __m128 ifTrue, __m128 ifFalse) {
+    return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse));
+}
+
+static void integrateSSE2(const ParticleKernelArrays &a, Vector3 accelerationStep, size_t begin, size_t end) {
+    const __m128 dt = _mm_set1_ps(DT);
+    const __m128 accelerationX = _mm_set1_ps(accelerationStep.x);
+    const __m128 accelerationY = _mm_set1_ps(accelerationStep.y);
+    const __m128 accelerationZ = _mm_set1_ps(accelerationStep.z);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(a.x + i);
+        __m128 y = _mm_loadu_ps(a.y + i);
+        __m128 z = _mm_loadu_ps(a.z + i);
+        __m128 velocityX = _mm_sub_ps(x, _mm_loadu_ps(a.pastX + i));
+        __m128 velocityY = _mm_sub_ps(y, _mm_loadu_ps(a.pastY + i));
+        __m128 velocityZ = _mm_sub_ps(z, _mm_loadu_ps(a.pastZ + i));
+        _mm_storeu_ps(a.pastX + i, x);
+        _mm_storeu_ps(a.pastY + i, y);
+        _mm_storeu_ps(a.pastZ + i, z);
+        _mm_storeu_ps(a.x + i, _mm_add_ps(x, _mm_add_ps(_mm_mul_ps(velocityX, dt), accelerationX)));
+        _mm_storeu_ps(a.y + i, _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(velocityY, dt), accelerationY)));
+        _mm_storeu_ps(a.z + i, _mm_add_ps(z, _mm_add_ps(_mm_mul_ps(velocityZ, dt), accelerationZ)));
+    }
+    integrateScalar(a, accelerationStep, i, end);
+}
+
+static void wallSSE2(const ParticleKernelArrays &a, const WallPlane *planes, int planeCount, size_t begin, size_t end) {
+    const __m128 dt = _mm_set1_ps(DT);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 minusTwo = _mm_set1_ps(-2.0f);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(a.x + i);
+        __m128 y = _mm_loadu_ps(a.y + i);
+        __m128 z = _mm_loadu_ps(a.z + i);
+        __m128 pastX = _mm_loadu_ps(a.pastX + i);
+        __m128 pastY = _mm_loadu_ps(a.pastY + i);
+        __m128 pastZ = _mm_loadu_ps(a.pastZ + i);
+        __m128 velocityX = _mm_sub_ps(x, pastX);
+        __m128 velocityY = _mm_sub_ps(y, pastY);
+        __m128 velocityZ = _mm_sub_ps(z, pastZ);
+        __m128 radius = _mm_loadu_ps(a.radius + i);
+        __m128 collided = zero;
+
+        for (int w = 0; w < planeCount; ++w) {
+            __m128 nx = _mm_set1_ps(planes[w].normal.x);
+            __m128 ny = _mm_set1_ps(planes[w].normal.y);
+            __m128 nz = _mm_set1_ps(planes[w].normal.z);
+            __m128 offset = _mm_set1_ps(planes[w].offset);
+
+            __m128 signedDistance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_mul_ps(nz, z)), offset);
+            __m128 touching = _mm_cmple_ps(signedDistance, radius);
+            if (_mm_movemask_ps(touching) == 0) continue;
+            collided = _mm_or_ps(collided, touching);
+
+            __m128 normalVelocity = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, velocityX), _mm_mul_ps(ny, velocityY)), _mm_mul_ps(nz, velocityZ));
+            __m128 approaching = _mm_and_ps(touching, _mm_cmplt_ps(normalVelocity, zero));
+            __m128 reflection = _mm_mul_ps(minusTwo, normalVelocity);
+            velocityX = select128(approaching, _mm_add_ps(velocityX, _mm_mul_ps(nx, reflection)), velocityX);
+            velocityY = select128(approaching, _mm_add_ps(velocityY, _mm_mul_ps(ny, reflection)), velocityY);
+            velocityZ = select128(approaching, _mm_add_ps(velocityZ, _mm_mul_ps(nz, reflection)), velocityZ);
+
+            __m128 nextX = _mm_add_ps(x, _mm_mul_ps(velocityX, dt));
+            __m128 nextY = _mm_add_ps(y, _mm_mul_ps(velocityY, dt));
+            __m128 nextZ = _mm_add_ps(z, _mm_mul_ps(velocityZ, dt));
+            __m128 nextDistance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nextX), _mm_mul_ps(ny, nextY)), _mm_mul_ps(nz, nextZ)), offset);
+            __m128 overlap = _mm_sub_ps(radius, nextDistance);
+            __m128 push = _mm_and_ps(touching, _mm_cmpgt_ps(overlap, zero));
+            x = select128(push, _mm_add_ps(x, _mm_mul_ps(nx, overlap)), x);
+            y = select128(push, _mm_add_ps(y, _mm_mul_ps(ny, overlap)), y);
+            z = select128(push, _mm_add_ps(z, _mm_mul_ps(nz, overlap)), z);
+        }
+
+        if (_mm_movemask_ps(collided) == 0) continue;
+        _mm_storeu_ps(a.x + i, x);
+        _mm_storeu_ps(a.y + i, y);
+        _mm_storeu_ps(a.z + i, z);
+        _mm_storeu_ps(a.pastX + i, select128(collided, _mm_sub_ps(x, _mm_mul_ps(velocityX, dt)), pastX));
+        _mm_storeu_ps(a.pastY + i, select128(collided, _mm_sub_ps(y, _mm_mul_ps(velocityY, dt)), pastY));
+        _mm_storeu_ps(a.pastZ + i, select128(collided, _mm_sub_ps(z, _mm_mul_ps(velocityZ, dt)), pastZ));
+    }
+    wallScalar(a, planes, planeCount, i, end);
+}
+
+static inline __m128 reflectAxisSSE2(__m128 &position, __m128 &velocity, __m128 lower, __m128 upper) {
+    const __m128 dt = _mm_set1_ps(DT);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 belowLower = _mm_cmple_ps(position, lower);
+    velocity = select128(_mm_and_ps(belowLower, _mm_cmplt_ps(velocity, zero)), _mm_sub_ps(zero, velocity), velocity);
+    __m128 next = _mm_add_ps(position, _mm_mul_ps(velocity, dt));
+    position = select128(_mm_and_ps(belowLower, _mm_cmplt_ps(next, lower)), _mm_add_ps(position, _mm_sub_ps(lower, next)), position);
+
+    __m128 aboveUpper = _mm_cmpge_ps(position, upper);
+    velocity = select128(_mm_and_ps(aboveUpper, _mm_cmpgt_ps(velocity, zero)), _mm_sub_ps(zero, velocity), velocity);
+    next = _mm_add_ps(position, _mm_mul_ps(velocity, dt));
+    position = select128(_mm_and_ps(aboveUpper, _mm_cmpgt_ps(next, upper)), _mm_sub_ps(position, _mm_sub_ps(next, upper)), position);
+    return _mm_or_ps(belowLower, aboveUpper);
+}
+
+static void boxSSE2(const ParticleKernelArrays &a, Vector3 boxMin, Vector3 boxMax, size_t begin, size_t end) {
+    const __m128 dt = _mm_set1_ps(DT);
+    const __m128 minX = _mm_set1_ps(boxMin.x), minY = _mm_set1_ps(boxMin.y), minZ = _mm_set1_ps(boxMin.z);
+    const __m128 maxX = _mm_set1_ps(boxMax.x), maxY = _mm_set1_ps(boxMax.y), maxZ = _mm_set1_ps(boxMax.z);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(a.x + i);
+        __m128 y = _mm_loadu_ps(a.y + i);
+        __m128 z = _mm_loadu_ps(a.z + i);
+        __m128 pastX = _mm_loadu_ps(a.pastX + i);
+        __m128 pastY = _mm_loadu_ps(a.pastY + i);
+        __m128 pastZ = _mm_loadu_ps(a.pastZ + i);
+        __m128 velocityX = _mm_sub_ps(x, pastX);
+        __m128 velocityY = _mm_sub_ps(y, pastY);
+        __m128 velocityZ = _mm_sub_ps(z, pastZ);
+        __m128 radius = _mm_loadu_ps(a.radius + i);
+
+        __m128 collided = reflectAxisSSE2(x, velocityX, _mm_add_ps(minX, radius), _mm_sub_ps(maxX, radius));
+        collided = _mm_or_ps(collided, reflectAxisSSE2(y, velocityY, _mm_add_ps(minY, radius), _mm_sub_ps(maxY, radius)));
+        collided = _mm_or_ps(collided, reflectAxisSSE2(z, velocityZ, _mm_add_ps(minZ, radius), _mm_sub_ps(maxZ, radius)));
+
+        if (_mm_movemask_ps(collided) == 0) continue;
+        _mm_storeu_ps(a.x + i, x);
+        _mm_storeu_ps(a.y + i, y);
+        _mm_storeu_ps(a.z + i, z);
+        _mm_storeu_ps(a.pastX + i, select128(collided, _mm_sub_ps(x, _mm_mul_ps(velocityX, dt)), pastX));
+        _mm_storeu_ps(a.pastY + i, select128(collided, _mm_sub_ps(y, _mm_mul_ps(velocityY, dt)), pastY));
+        _mm_storeu_ps(a.pastZ + i, select128(collided, _mm_sub_ps(z, _mm_mul_ps(velocityZ, dt)), pastZ));
+    }
+    boxScalar(a, boxMin, boxMax, i, end);
+}
+
+// AVX2 kernels, 8 particles at a time
+//--------------------------------------------------------------------------------------
+
+AVX2_TARGET static void integrateAVX2(const ParticleKernelArrays &a, Vector3 accelerationStep, size_t begin, size_t end) {
+    const __m256 dt = _mm256_set1_ps(DT);
+    const __m256 accelerationX = _mm256_set1_ps(accelerationStep.x);
+    const __m256 accelerationY = _mm256_set1_ps(accelerationStep.y);
+    const __m256 accelerationZ = _mm256_set1_ps(accelerationStep.z);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(a.x + i);
+        __m256 y = _mm256_loadu_ps(a.y + i);
+        __m256 z = _mm256_loadu_ps(a.z + i);
+        __m256 velocityX = _mm256_sub_ps(x, _mm256_loadu_ps(a.pastX + i));
+        __m256 velocityY = _mm256_sub_ps(y, _mm256_loadu_ps(a.pastY + i));
+        __m256 velocityZ = _mm256_sub_ps(z, _mm256_loadu_ps(a.pastZ + i));
+        _mm256_storeu_ps(a.pastX + i, x);
+        _mm256_storeu_ps(a.pastY + i, y);
+        _mm256_storeu_ps(a.pastZ + i, z);
+        _mm256_storeu_ps(a.x + i, _mm256_add_ps(x, _mm256_add_ps(_mm256_mul_ps(velocityX, dt), accelerationX)));
+        _mm256_storeu_ps(a.y + i, _mm256_add_ps(y, _mm256_add_ps(_mm256_mul_ps(velocityY, dt), accelerationY)));
+        _mm256_storeu_ps(a.z + i, _mm256_add_ps(z, _mm256_add_ps(_mm256_mul_ps(velocityZ, dt), accelerationZ)));
+    }
+    integrateScalar(a, accelerationStep, i, end);
+}
+
+AVX2_TARGET static void wallAVX2(const ParticleKernelArrays &a, const WallPlane *planes, int planeCount, size_t begin, size_t end) {
+    const __m256 dt = _mm256_set1_ps(DT);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 minusTwo = _mm256_set1_ps(-2.0f);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(a.x + i);
+        __m256 y = _mm256_loadu_ps(a.y + i);
+        __m256 z = _mm256_loadu_ps(a.z + i);
+        __m256 pastX = _mm256_loadu_ps(a.pastX + i);
+        __m256 pastY = _mm256_loadu_ps(a.pastY + i);
+        __m256 pastZ = _mm256_loadu_ps(a.pastZ + i);
+        __m256 velocityX = _mm256_sub_ps(x, pastX);
+        __m256 velocityY = _mm256_sub_ps(y, pastY);
+        __m256 velocityZ = _mm256_sub_ps(z, pastZ);
+        __m256 radius = _mm256_loadu_ps(a.radius + i);
+        __m256 collided = zero;
+
+        for (int w = 0; w < planeCount; ++w) {
+            __m256 nx = _mm256_set1_ps(planes[w].normal.x);
+            __m256 ny = _mm256_set1_ps(planes[w].normal.y);
+            __m256 nz = _mm256_set1_ps(planes[w].normal.z);
+            __m256 offset = _mm256_set1_ps(planes[w].offset);
+
+            __m256 signedDistance = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, x), _mm256_mul_ps(ny, y)), _mm256_mul_ps(nz, z)), offset);
+            __m256 touching = _mm256_cmp_ps(signedDistance, radius, _CMP_LE_OQ);
+            if (_mm256_movemask_ps(touching) == 0) continue;
+            collided = _mm256_or_ps(collided, touching);
+
+            __m256 normalVelocity = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, velocityX), _mm256_mul_ps(ny, velocityY)), _mm256_mul_ps(nz, velocityZ));
+            __m256 approaching = _mm256_and_ps(touching, _mm256_cmp_ps(normalVelocity, zero, _CMP_LT_OQ));
+            __m256 reflection = _mm256_mul_ps(minusTwo, normalVelocity);
+            velocityX = _mm256_blendv_ps(velocityX, _mm256_add_ps(velocityX, _mm256_mul_ps(nx, reflection)), approaching);
+            velocityY = _mm256_blendv_ps(velocityY, _mm256_add_ps(velocityY, _mm256_mul_ps(ny, reflection)), approaching);
+            velocityZ = _mm256_blendv_ps(velocityZ, _mm256_add_ps(velocityZ, _mm256_mul_ps(nz, reflection)), approaching);
+
+            __m256 nextX = _mm256_add_ps(x, _mm256_mul_ps(velocityX, dt));
+            __m256 nextY = _mm256_add_ps(y, _mm256_mul_ps(velocityY, dt));
+            __m256 nextZ = _mm256_add_ps(z, _mm256_mul_ps(velocityZ, dt));
+            __m256 nextDistance = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nextX), _mm256_mul_ps(ny, nextY)), _mm256_mul_ps(nz, nextZ)), offset);
+            __m256 overlap = _mm256_sub_ps(radius, nextDistance);
+            __m256 push = _mm256_and_ps(touching, _mm256_cmp_ps(overlap, zero, _CMP_GT_OQ));
+            x = _mm256_blendv_ps(x, _mm256_add_ps(x, _mm256_mul_ps(nx, overlap)), push);
+            y = _mm256_blendv_ps(y, _mm256_add_ps(y, _mm256_mul_ps(ny, overlap)), push);
+            z = _mm256_blendv_ps(z, _mm256_add_ps(z, _mm256_mul_ps(nz, overlap)), push);
+        }
+
+        if (_mm256_movemask_ps(collided) == 0) continue;
+        _mm256_storeu_ps(a.x + i, x);
+        _mm256_storeu_ps(a.y + i, y);
+        _mm256_storeu_ps(a.z + i, z);
+        _mm256_storeu_ps(a.pastX + i, _mm256_blendv_ps(pastX, _mm256_sub_ps(x, _mm256_mul_ps(velocityX, dt)), collided));
+        _mm256_storeu_ps(a.pastY + i, _mm256_blendv_ps(pastY, _mm256_sub_ps(y, _mm256_mul_ps(velocityY, dt)), collided));
+        _mm256_storeu_ps(a.pastZ + i, _mm256_blendv_ps(pastZ, _mm256_sub_ps(z, _mm256_mul_ps(velocityZ, dt)), collided));
+    }
+    wallScalar(a, planes, planeCount, i, end);
+}
+
+AVX2_TARGET static inline __m256 reflectAxisAVX2(__m256 &position, __m256 &velocity, __m256 lower, __m256 upper) {
+    const __m256 dt = _mm256_set1_ps(DT);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 belowLower = _mm256_cmp_ps(position, lower, _CMP_LE_OQ);
+    velocity = _mm256_blendv_ps(velocity, _mm256_sub_ps(zero, velocity), _mm256_and_ps(belowLower, _mm256_cmp_ps(velocity, zero, _CMP_LT_OQ)));
+    __m256 next = _mm256_add_ps(position, _mm256_mul_ps(velocity, dt));
+    position = _mm256_blendv_ps(position, _mm256_add_ps(position, _mm256_sub_ps(lower, next)), _mm256_and_ps(belowLower, _mm256_cmp_ps(next, lower, _CMP_LT_OQ)));
+
+    __m256 aboveUpper = _mm256_cmp_ps(position, upper, _CMP_GE_OQ);
+    velocity = _mm256_blendv_ps(velocity, _mm256_sub_ps(zero, velocity), _mm256_and_ps(aboveUpper, _mm256_cmp_ps(velocity, zero, _CMP_GT_OQ)));
+    next = _mm256_add_ps(position, _mm256_mul_ps(velocity, dt));
+    position = _mm256_blendv_ps(position, _mm256_sub_ps(position, _mm256_sub_ps(next, upper)), _mm256_and_ps(aboveUpper, _mm256_cmp_ps(next, upper, _CMP_GT_OQ)));
+    return _mm256_or_ps(belowLower, aboveUpper);
+}
+
+AVX2_TARGET static void boxAVX2(const ParticleKernelArrays &a, Vector3 boxMin, Vector3 boxMax, size_t begin, size_t end) {
+    const __m256 dt = _mm256_set1_ps(DT);
+    const __m256 minX = _mm256_set1_ps(boxMin.x), minY = _mm256_set1_ps(boxMin.y), minZ = _mm256_set1_ps(boxMin.z);
+    const __m256 maxX = _mm256_set1_ps(boxMax.x), maxY = _mm256_set1_ps(boxMax.y), maxZ = _mm256_set1_ps(boxMax.z);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(a.x + i);
+        __m256 y = _mm256_loadu_ps(a.y + i);
+        __m256 z = _mm256_loadu_ps(a.z + i);
+        __m256 pastX = _mm256_loadu_ps(a.pastX + i);
+        __m256 pastY = _mm256_loadu_ps(a.pastY + i);
+        __m256 pastZ = _mm256_loadu_ps(a.pastZ + i);
+        __m256 velocityX = _mm256_sub_ps(x, pastX);
+        __m256 velocityY = _mm256_sub_ps(y, pastY);
+        __m256 velocityZ = _mm256_sub_ps(z, pastZ);
+        __m256 radius = _mm256_loadu_ps(a.radius + i);
+
+        __m256 collided = reflectAxisAVX2(x, velocityX, _mm256_add_ps(minX, radius), _mm256_sub_ps(maxX, radius));
+        collided = _mm256_or_ps(collided, reflectAxisAVX2(y, velocityY, _mm256_add_ps(minY, radius), _mm256_sub_ps(maxY, radius)));
+        collided = _mm256_or_ps(collided, reflectAxisAVX2(z, velocityZ, _mm256_add_ps(minZ, radius), _mm256_sub_ps(maxZ, radius)));
+
+        if (_mm256_movemask_ps(collided) == 0) continue;
+        _mm256_storeu_ps(a.x + i, x);
+        _mm256_storeu_ps(a.y + i, y);
+        _mm256_storeu_ps(a.z + i, z);
+        _mm256_storeu_ps(a.pastX + i, _mm256_blendv_ps(pastX, _mm256_sub_ps(x, _mm256_mul_ps(velocityX, dt)), collided));
+        _mm256_storeu_ps(a.pastY + i, _mm256_blendv_ps(pastY, _mm256_sub_ps(y, _mm256_mul_ps(velocityY, dt)), collided));
+        _mm256_storeu_ps(a.pastZ + i, _mm256_blendv_ps(pastZ, _mm256_sub_ps(z, _mm256_mul_ps(velocityZ, dt)), collided));
+    }
+    boxScalar(a, boxMin, boxMax, i, end);
+}
+
+#endif // DIFFUSION_X86
+
+// Dispatch
+//--------------------------------------------------------------------------------------
+
+SimdLevel detectSimdLevel() {
+#if defined(DIFFUSION_X86)
+#if defined(_MSC_VER)
+    int cpuInfo[4];
+    __cpuid(cpuInfo, 0);
+    int highestLeaf = cpuInfo[0];
+    __cpuid(cpuInfo, 1);
+    bool osSavesYmm = (cpuInfo[2] & (1 << 27)) && (cpuInfo[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+    bool sse2 = (cpuInfo[3] & (1 << 26)) != 0;
+    if (highestLeaf >= 7 && osSavesYmm) {
+        __cpuidex(cpuInfo, 7, 0);
+        if (cpuInfo[1] & (1 << 5)) return SimdLevel::AVX2;
+    }
+    return sse2 ? SimdLevel::SSE2 : SimdLevel::Scalar;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+    return SimdLevel::Scalar;
+#endif
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+static SimdLevel &currentSimdLevel() {
+    static SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+SimdLevel getSimdLevel() {
+    return currentSimdLevel();
+}
+
+void setSimdLevel(SimdLevel level) {
+    SimdLevel supported = detectSimdLevel();
+    currentSimdLevel() = (int)level > (int)supported ? supported : level;
+}
+
+const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+void integrateKernel(const ParticleKernelArrays &arrays, Vector3 accelerationStep, size_t begin, size_t end) {
+    switch (getSimdLevel()) {
+#if defined(DIFFUSION_X86)
+        case SimdLevel::AVX2: integrateAVX2(arrays, accelerationStep, begin, end); return;
+        case SimdLevel::SSE2: integrateSSE2(arrays, accelerationStep, begin, end); return;
+#endif
+        default: integrateScalar(arrays, accelerationStep, begin, end); return;
+    }
+}
+
+void wallKernel(const ParticleKernelArrays &arrays, const WallPlane *planes, int planeCount, size_t begin, size_t end) {
+    switch (getSimdLevel()) {
+#if defined(DIFFUSION_X86)
+        case SimdLevel::AVX2: wallAVX2(arrays, planes, planeCount, begin, end); return;
+        case SimdLevel::SSE2: wallSSE2(arrays, planes, planeCount, begin, end); return;
+#endif
+        default: wallScalar(arrays, planes, planeCount, begin, end); return;
+    }
+}
+
+void boxKernel(const ParticleKernelArrays &arrays, Vector3 boxMin, Vector3 boxMax, size_t begin, size_t end) {
+    switch (getSimdLevel()) {
+#if defined(DIFFUSION_X86)
+        case SimdLevel::AVX2: boxAVX2(arrays, boxMin, boxMax, begin, end); return;
+        case SimdLevel::SSE2: boxSSE2(arrays, boxMin, boxMax, begin, end); return;
+#endif
+        default: boxScalar(arrays, boxMin, boxMax, begin, end); return;
+    }
+}
+
+void periodicKernel(const ParticleKernelArrays &arrays, Vector3 boxMin, Vector3 boxMax, size_t begin, size_t end) {
+    // Only the few particles that crossed a face do any work, so there is no vector version
+    periodicScalar(arrays, boxMin, boxMax, begin, end);
+}
@@ -0,0 +1,51 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+#include "raymath.h"
+
+// Vectorized per-particle kernels, picked at runtime from the best instruction set the CPU supports.
+// Every level does the same arithmetic in the same order (no FMA), so results are identical across levels.
+
+enum class SimdLevel {
+    Scalar,
+    SSE2,  // 4 particles per instruction
+    AVX2   // 8 particles per instruction
+};
+
+SimdLevel detectSimdLevel();
+SimdLevel getSimdLevel();
+// Forces a lower level, e.g. for benchmarking. Levels the CPU does not support are clamped to detectSimdLevel().
+void setSimdLevel(SimdLevel level);
+const char *simdLevelName(SimdLevel level);
+
+// Raw pointers into the structure-of-arrays particle storage
+struct ParticleKernelArrays {
+    float *x;
+    float *y;
+    float *z;
+    float *pastX;
+    float *pastY;
+    float *pastZ;
+    const float *radius;
+};
+
+// Plane n.p = offset with n the unit normal pointing into the room
+struct WallPlane {
+    Vector3 normal;
+    float offset;
+};
+
+// Position Verlet update for particles [begin, end)
+void integrateKernel(const ParticleKernelArrays &arrays, Vector3 accelerationStep, size_t begin, size_t end);
+
+// Reflects particles [begin, end) that touch any of the planes and pushes them back out of the wall
+void wallKernel(const ParticleKernelArrays &arrays, const WallPlane *planes, int planeCount, size_t begin, size_t end);
+
+// Same as wallKernel for the six walls of the box [boxMin, boxMax], with min/max compares instead of dot products
+void boxKernel(const ParticleKernelArrays &arrays, Vector3 boxMin, Vector3 boxMax, size_t begin, size_t end);
+
+// Moves particles [begin, end) that left the periodic box [boxMin, boxMax) back in through the opposite face
+void periodicKernel(const ParticleKernelArrays &arrays, Vector3 boxMin, Vector3 boxMax, size_t begin, size_t end);
+
+#endif // SIMD_KERNELS_H
@@ -0,0 +1,238 @@
+#include "Simulation.h"
+#include <stdexcept>
+#include "Generator.h"
+
+Simulation::Simulation(Vector3 _roomDimensions, std::vector<Wall> _room, std::vector<Ball3d> _balls) :
+    Simulation(_roomDimensions, std::move(_room), particleSystemFromBalls(_balls))
+{}
+
+Simulation::Simulation(Vector3 _roomDimensions, std::vector<Wall> _room, ParticleSystem _particles) :
+    roomDimensions(_roomDimensions),
+    room(std::move(_room)),
+    boundary(boundaryFromWalls(room)),
+    particles(std::move(_particles)),
+    grid(gridForRoom(roomDimensions, fineGridRadius(particles), GridStorage::Automatic, particles.count))
+{
+    particles.assignSpecies();
+    buildCoarseLevels();
+}
+
+void Simulation::step() {
+    ThreadPool *pool = threadPool.get();
+    DIFFUSION_INSTRUMENT(stats = StepStats();)
+    {
+        DIFFUSION_TIME_PHASE(stats, PhaseGridRebuild);
+        bool reorder = reorderEvery > 0 && stepCount % reorderEvery == 0;
+        if (reorder) {
+            reorderParticles(particles, grid, pool);
+            neighbours.valid = false;
+        }
+        if (neighbours.skin <= 0.0f) {
+            rebuildGrid(grid, coarseLevels, particles, pool);
+        } else {
+            float displacement = 0.0f;
+            if (neighbours.usable(particles)) {
+                displacement = largestDisplacementSinceBuild(neighbours, particles, grid.periodicLength(), pool);
+            }
+            bool rebuild = !neighbours.usable(particles) || 2.0f * displacement >= neighbours.skin;
+            if (rebuild) {
+                rebuildGrid(grid, coarseLevels, particles, pool);
+                buildNeighbourList(neighbours, grid, particles, pool);
+            } else {
+                rebuildCoarseLevels(coarseLevels, particles);
+            }
+            DIFFUSION_INSTRUMENT(
+                stats.neighbourDisplacement = displacement;
+                stats.neighbourRebuild = rebuild;
+                stats.neighbourPairs = (long long)neighbours.partners.size();
+            )
+        }
+    }
+    DIFFUSION_INSTRUMENT(recordGridOccupancy();)
+
+    DIFFUSION_INSTRUMENT(auto collisionStart = std::chrono::steady_clock::now();)
+    // A lone particle, like a tracer in a Langevin bath, has nothing to collide with
+    CollisionCounters counters;
+    if (particles.count > 1) {
+        counters = neighbours.skin > 0.0f ? handleParticleCollisions(particles, grid, neighbours, coarseLevels, pool)
+                                          : handleParticleCollisions(particles, grid, coarseLevels, pool);
+    }
+    DIFFUSION_INSTRUMENT(
+        // Broad and narrow phase are interleaved, so the pass is split in proportion to the time spent in each
+        double collisionSeconds = secondsSince(collisionStart);
+        // The narrow time is extrapolated from samples, so it can come out above the whole pass
+        double narrowShare = counters.passSeconds > 0.0 ? std::min(1.0, counters.narrowSeconds / counters.passSeconds) : 0.0;
+        stats.phaseSeconds[PhaseNarrow] = collisionSeconds * narrowShare;
+        stats.phaseSeconds[PhaseBroad] = collisionSeconds - stats.phaseSeconds[PhaseNarrow];
+        stats.collisions = counters;
+    )
+
+    {
+        DIFFUSION_TIME_PHASE(stats, PhaseWalls);
+        parallelForChunks(pool, particles.count, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+            boundary.apply(particles, begin, end);
+        });
+    }
+    particles.recordTrackedPositions();
+
+    {
+        DIFFUSION_TIME_PHASE(stats, PhaseIntegrate);
+        if (langevin.enabled()) {
+            applyLangevinBath(langevin, particles, random);
+        }
+        ParticleKernelArrays arrays = kernelArrays(particles);
+        Vector3 accelerationStep = Vector3Scale(particles.acceleration, DT * DT);
+        parallelForChunks(pool, particles.count, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+            integrateKernel(arrays, accelerationStep, begin, end);
+        });
+    }
+    stepCount++;
+}
+
+void Simulation::recordGridOccupancy() {
+    int occupiedCount = (int)grid.occupiedCells.size();
+    // Always 0 for a hashed grid, which does not keep empty cells
+    stats.occupancy[0] = grid.numberCells() - occupiedCount;
+    for (int cell : grid.occupiedCells) {
+        int load = grid.cellCount[cell];
+        stats.occupancy[std::min(load, OCCUPANCY_BINS - 1)]++;
+        stats.maxCellLoad = std::max(stats.maxCellLoad, load);
+    }
+}
+
+void Simulation::setThreadCount(int threadCount) {
+    if (threadCount <= 1) {
+        threadPool.reset();
+    } else if (threadCount != this->threadCount()) {
+        threadPool = std::make_shared<ThreadPool>(threadCount);
+    }
+}
+
+int Simulation::threadCount() const {
+    return threadPool ? threadPool->threadCount() : 1;
+}
+
+void Simulation::makePeriodic() {
+    Vector3 boxMin = { -0.5f * roomDimensions.x, 0.0f, -0.5f * roomDimensions.z };
+    Vector3 boxMax = Vector3Add(boxMin, roomDimensions);
+    grid = periodicGrid(boxMin, boxMax, fineGridRadius(particles) + 0.5f * neighbours.skin, gridStorage, particles.count);
+    buildCoarseLevels();
+    boundary = periodicBoundary(boxMin, boxMax);
+    neighbours.valid = false;
+}
+
+void Simulation::useWalls(bool generalPlanes) {
+    bool wasPeriodic = boundary.type == BoundaryType::Periodic;
+    boundary = generalPlanes ? planeBoundary(room) : boundaryFromWalls(room);
+    if (wasPeriodic) {
+        remakeFineGrid(fineGridRadius(particles) + 0.5f * neighbours.skin);
+        buildCoarseLevels();
+        neighbours.valid = false;
+    }
+}
+
+void Simulation::setNeighbourSkin(float skin) {
+    if (skin < 0.0f) {
+        throw std::invalid_argument("neighbour list skin can't be negative");
+    }
+    remakeFineGrid(fineGridRadius(particles) + 0.5f * skin);
+    neighbours = NeighbourList();
+    neighbours.skin = skin;
+}
+
+void Simulation::setGridStorage(GridStorage storage) {
+    gridStorage = storage;
+    remakeFineGrid(fineGridRadius(particles) + 0.5f * neighbours.skin);
+    buildCoarseLevels();
+    neighbours.valid = false;
+}
+
+void Simulation::remakeFineGrid(float cellRadius) {
+    if (boundary.type == BoundaryType::Periodic) {
+        grid = periodicGrid(boundary.boxMin, boundary.boxMax, cellRadius, gridStorage, particles.count);
+    } else {
+        grid = gridForRoom(roomDimensions, cellRadius, gridStorage, particles.count);
+    }
+}
+
+void Simulation::buildCoarseLevels() {
+    GridStorage storage = gridStorage;
+    size_t numberBalls = particles.count;
+    if (grid.periodic) {
+        Vector3 boxMin = grid.startingPosition;
+        Vector3 boxMax = Vector3Add(boxMin, grid.periodicLength());
+        coarseLevels = coarseGridLevels(particles, [boxMin, boxMax, storage, numberBalls](float maxRadius) {
+            return periodicGrid(boxMin, boxMax, maxRadius, storage, numberBalls);
+        });
+    } else {
+        Vector3 dimensions = roomDimensions;
+        coarseLevels = coarseGridLevels(particles, [dimensions, storage, numberBalls](float maxRadius) {
+            return gridForRoom(dimensions, maxRadius, storage, numberBalls);
+        });
+    }
+}
+
+bool isScenarioName(const std::string &name) {
+    return name == "brownian" || name == "gas" || name == "three";
+}
+
+// Scenario particles, the small ones are at the same temperature as the fixed speed balls they replaced
+const float SCENARIO_SMALL_RADIUS = 0.5f;
+const float SCENARIO_LARGE_RADIUS = 2.0f;
+const float GAS_TEMPERATURE = 0.03f;       // mass 1 at speed 0.3
+const float BROWNIAN_TEMPERATURE = 0.12f;  // mass 4 at speed 0.3
+
+static Ball3d brownianTracer(float roomSize) {
+    Ball3d largeBall = {{0.0f, 0.5f * roomSize, 0.0f}, {0.0f, 0.0f, 0.0f}};
+    largeBall.radius = SCENARIO_LARGE_RADIUS;
+    largeBall.color = { 230, 41, 55, 255 };  // raylib RED
+    largeBall.mass = 64;
+    largeBall.trackPositions = true;
+    return largeBall;
+}
+
+Simulation createScenario(const std::string &name, float roomSize, int numberBalls, uint64_t seed, ThreadPool *pool) {
+    Vector3 roomDimensions = { roomSize, roomSize, roomSize };
+    std::vector<Wall> room = cubeRoom(roomSize);
+
+    if (name == "three") {
+        return Simulation(roomDimensions, room, threeBallsBouncing());
+    }
+
+    GeneratorOptions options;
+    options.radius = SCENARIO_SMALL_RADIUS;
+    options.seed = seed;
+    if (name == "gas") {
+        options.count = numberBalls;
+        options.temperature = GAS_TEMPERATURE;
+        options.color = { 25, 25, 178, 255 };
+        options.colorJitter = 25;
+        return Simulation(roomDimensions, room, generateParticles(roomDimensions, options, {}, pool));
+    }
+
+    // The tracer is ball 0, with its path recorded
+    options.count = std::max(0, numberBalls - 1);
+    options.mass = 4.0f;
+    options.temperature = BROWNIAN_TEMPERATURE;
+    options.color = { 0, 121, 241, 255 };  // raylib BLUE
+    options.colorJitter = 10;
+    return Simulation(roomDimensions, room, generateParticles(roomDimensions, options, { brownianTracer(roomSize) }, pool));
+}
+
+Simulation createLangevinScenario(float roomSize, const LangevinBath &bath, uint64_t seed) {
+    Simulation simulation({ roomSize, roomSize, roomSize }, cubeRoom(roomSize), std::vector<Ball3d> { brownianTracer(roomSize) });
+    simulation.langevin = bath;
+    simulation.random.seed(seed);
+    return simulation;
+}
+
+float scenarioRoomSize(const std::string &name, int numberBalls, float packingFraction) {
+    if (name == "gas") {
+        return roomSizeForPackingFraction(numberBalls, SCENARIO_SMALL_RADIUS, packingFraction);
+    }
+    if (name == "brownian") {
+        return roomSizeForPackingFraction(std::max(0, numberBalls - 1), SCENARIO_SMALL_RADIUS, packingFraction,
+                                          { brownianTracer(0.0f) });
+    }
+    throw std::invalid_argument("scenario " + name + " has a fixed layout");
+}
@@ -0,0 +1,85 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "Objects.h"
+#include "Boundary.h"
+#include "CollisionGrid.h"
+#include "Langevin.h"
+#include "ParticleSystem.h"
+#include "ThreadPool.h"
+
+// A room, the balls in it and the grid used to find collisions, advanced one DT at a time.
+// This has no rendering or frame pacing so it can be driven by the viewer or the headless runner.
+struct Simulation {
+    Vector3 roomDimensions;
+    std::vector<Wall> room;
+    Boundary boundary;  // worked out from room, what the physics actually uses
+    ParticleSystem particles;
+    CollisionGrid grid;  // fine level, sized for the smallest particles
+    std::vector<GridLevel> coarseLevels;  // one per larger size class, empty unless radii differ by more than LEVEL_RADIUS_RATIO
+    long long stepCount = 0;
+    std::mt19937_64 random;  // for anything random during a run, saved with snapshots so restarts continue the sequence
+    std::shared_ptr<ThreadPool> threadPool;  // null runs everything on the calling thread
+    StepStats stats;  // timings and counters of the last step, all zero unless instrumentation is compiled in
+    // Steps between Morton reorders of the particles (reorderParticles), 0 keeps them in place.
+    // Reordering changes the order pairs are resolved in, so runs with different settings drift apart by rounding.
+    int reorderEvery = 0;
+    // Off while skin is 0, see setNeighbourSkin
+    NeighbourList neighbours;
+    // Storage of the grids made from now on, see setGridStorage
+    GridStorage gridStorage = GridStorage::Automatic;
+    // Implicit solvent acting on every movable particle, off unless friction is set. Draws from random, so it runs
+    // on one thread whatever the pool. Not saved with snapshots.
+    LangevinBath langevin;
+
+    void step();
+    void recordGridOccupancy();
+
+    // Results do not depend on the thread count
+    void setThreadCount(int threadCount);
+    int threadCount() const;
+
+    // Replaces the walls with a periodic box the size of the room, for bulk diffusion without wall effects.
+    // The room has to be a cube at least three diameters of the largest ball wide.
+    void makePeriodic();
+
+    // Goes back to the room's walls, as general planes or through boundaryFromWalls, remaking the grids to cover the
+    // room if they were periodic
+    void useWalls(bool generalPlanes);
+
+    // Switches to neighbour lists with the given skin, or back to a grid rebuild every step for 0. The fine grid is
+    // remade with cells 2 * radius + skin wide. Lists are rebuilt when a particle has moved half the skin and after
+    // every reorder. They change the order pairs are resolved in, so runs with and without them, or restarted from a
+    // snapshot (which does not hold the lists), drift apart by rounding.
+    void setNeighbourSkin(float skin);
+
+    // Remakes the grids with dense or hashed cells. Hashed grids only store occupied cells, for dilute balls in a
+    // huge room; they number cells differently, so runs drift apart from dense ones by rounding.
+    void setGridStorage(GridStorage storage);
+
+    // Works out coarseLevels from the particle radii to match grid (periodic or covering the room)
+    void buildCoarseLevels();
+
+    // Replaces grid with one for the boundary and gridStorage, with cells 2 * cellRadius wide
+    void remakeFineGrid(float cellRadius);
+
+    Simulation(Vector3 _roomDimensions, std::vector<Wall> _room, std::vector<Ball3d> _balls);
+    Simulation(Vector3 _roomDimensions, std::vector<Wall> _room, ParticleSystem _particles);
+};
+
+// Scenarios that can be selected by name: "brownian", "gas" and "three"
+// numberBalls (exact, including the brownian tracer) and seed are ignored by "three".
+// The pool only speeds up generating the balls, which come out the same for a seed either way.
+Simulation createScenario(const std::string &name, float roomSize, int numberBalls, uint64_t seed = 1,
+                          ThreadPool *pool = nullptr);
+// The brownian scenario's tracer alone in its room, with bath standing in for the small balls it would collide
+// with. The tracer starts at rest in the same place; seed seeds the bath's noise.
+Simulation createLangevinScenario(float roomSize, const LangevinBath &bath, uint64_t seed = 1);
+// Room size at which numberBalls fill packingFraction of the volume, throws std::invalid_argument for "three"
+float scenarioRoomSize(const std::string &name, int numberBalls, float packingFraction);
+bool isScenarioName(const std::string &name);
+
+#endif // SIMULATION_H
@@ -0,0 +1,542 @@
+#include "SlabDecomposition.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define SLAB_PROCESSES 1
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+int SlabLayout::slabOfColumn(int column) const {
+    // upper_bound over the slab starts, ignoring the column count at the end
+    auto after = std::upper_bound(firstColumn.begin(), firstColumn.end() - 1, column);
+    return (int)(after - firstColumn.begin()) - 1;
+}
+
+// Furthest from a boundary that a ball too large for the columns can touch a ball across it: the sum of the two
+// largest radii, as no ball touches itself. 0 when every ball fits the columns.
+static float largeBallReach(const ParticleSystem &particles, float fineRadius) {
+    float largest = 0.0f;
+    float secondLargest = 0.0f;
+    for (size_t i = 0; i < particles.count; ++i) {
+        float radius = particles.radius[i];
+        if (radius > largest) {
+            secondLargest = largest;
+            largest = radius;
+        } else if (radius > secondLargest) {
+            secondLargest = radius;
+        }
+    }
+    return largest > fineRadius ? largest + secondLargest : 0.0f;
+}
+
+SlabLayout slabLayout(const Simulation &whole, int slabCount) {
+    if (slabCount < 1) {
+        throw std::invalid_argument("a decomposition needs at least one slab");
+    }
+    float fineRadius = fineGridRadius(whole.particles);
+    float columnWidth = std::max(2.0f * fineRadius, 1e-3f);
+    bool periodic = whole.boundary.type == BoundaryType::Periodic;
+    // Whole columns around a periodic box, so the last column meets the first
+    float length = periodic ? whole.boundary.boxMax.x - whole.boundary.boxMin.x : whole.roomDimensions.x;
+    int columnCount = std::max(1, (int)(periodic ? floorf(length / columnWidth) : ceilf(length / columnWidth)));
+    SlabLayout layout = {
+        CollisionGrid(periodic ? length / columnCount : columnWidth, columnCount, 1, 1,
+                      periodic ? whole.boundary.boxMin : whole.grid.startingPosition),
+        {},
+        fineRadius,
+        largeBallReach(whole.particles, fineRadius)
+    };
+    layout.columns.periodic = periodic;
+
+    // Enough columns that no ball takes part in the pairs at both boundaries of its slab
+    int haloColumns = std::max(1, (int)ceilf(layout.largeReach / columnWidth));
+    if (slabCount > 1 && columnCount < 2 * haloColumns * slabCount) {
+        throw std::invalid_argument("the room is only " + std::to_string(columnCount) + " columns wide, too few for "
+                                    + std::to_string(slabCount) + " slabs of " + std::to_string(2 * haloColumns));
+    }
+    for (int slab = 0; slab <= slabCount; ++slab) {
+        layout.firstColumn.push_back((int)((long long)slab * columnCount / slabCount));
+    }
+    return layout;
+}
+
+static SlabParticle slabParticleAt(const ParticleSystem &particles, size_t slot) {
+    SlabParticle particle;
+    particle.position[0] = particles.positionX[slot];
+    particle.position[1] = particles.positionY[slot];
+    particle.position[2] = particles.positionZ[slot];
+    particle.pastPosition[0] = particles.pastPositionX[slot];
+    particle.pastPosition[1] = particles.pastPositionY[slot];
+    particle.pastPosition[2] = particles.pastPositionZ[slot];
+    particle.radius = particles.radius[slot];
+    particle.inverseMass = particles.inverseMass[slot];
+    particle.id = particles.ids[slot];
+    particle.species = particles.species[slot];
+    return particle;
+}
+
+static void appendParticle(std::vector<unsigned char> &bytes, const SlabParticle &particle) {
+    const unsigned char *raw = reinterpret_cast<const unsigned char *>(&particle);
+    bytes.insert(bytes.end(), raw, raw + sizeof(SlabParticle));
+}
+
+// The particles in bytes from offset on, count of them or all that are there
+static void appendParticles(std::vector<SlabParticle> &particles, const std::vector<unsigned char> &bytes,
+                            size_t offset = 0, size_t count = SIZE_MAX) {
+    count = std::min(count, (bytes.size() - offset) / sizeof(SlabParticle));
+    size_t first = particles.size();
+    particles.resize(first + count);
+    if (count > 0) memcpy(&particles[first], bytes.data() + offset, count * sizeof(SlabParticle));
+}
+
+static void appendCount(std::vector<unsigned char> &bytes, uint64_t count) {
+    const unsigned char *raw = reinterpret_cast<const unsigned char *>(&count);
+    bytes.insert(bytes.end(), raw, raw + sizeof(uint64_t));
+}
+
+static uint64_t countAt(const std::vector<unsigned char> &bytes, size_t offset) {
+    uint64_t count;
+    memcpy(&count, bytes.data() + offset, sizeof(uint64_t));
+    return count;
+}
+
+static Vector3 positionOf(const SlabParticle &particle) {
+    return { particle.position[0], particle.position[1], particle.position[2] };
+}
+
+static void setSlot(ParticleSystem &particles, size_t slot, const SlabParticle &particle) {
+    particles.positionX[slot] = particle.position[0];
+    particles.positionY[slot] = particle.position[1];
+    particles.positionZ[slot] = particle.position[2];
+    particles.pastPositionX[slot] = particle.pastPosition[0];
+    particles.pastPositionY[slot] = particle.pastPosition[1];
+    particles.pastPositionZ[slot] = particle.pastPosition[2];
+    particles.radius[slot] = particle.radius;
+    particles.inverseMass[slot] = particle.inverseMass;
+    particles.ids[slot] = particle.id;
+    particles.species[slot] = particle.species;
+}
+
+// Sets particles.count, reallocating the arrays only when there are more balls than they have room for, with some
+// to spare as the number in a slab goes up and down from step to step. Returns true when it did, which empties the
+// species table.
+static bool setBallCount(ParticleSystem &particles, size_t count) {
+    bool grow = count > particles.radius.size;
+    if (grow) particles.resize(count + count / 8);
+    particles.count = count;
+    return grow;
+}
+
+SlabDomain::SlabDomain(const Simulation &whole, const SlabLayout &_layout, SlabTransport &_transport) :
+    local(whole.roomDimensions, whole.room, ParticleSystem()),
+    layout(_layout),
+    transport(_transport),
+    speciesTable(whole.particles.speciesTable),
+    contactRadius(layout.fineRadius),
+    // The balls at a boundary are all within the halo of it, x being their offset from the boundary
+    contacts(slabOfGrid(whole.grid, -halo(), halo())),
+    roomPeriodicLength(whole.grid.periodicLength())
+{
+    local.boundary = whole.boundary;
+    local.gridStorage = whole.gridStorage;
+    if (transport.slabCount() > 1) {
+        // Grids over the slab's own columns and the halo around them rather than the whole room. Balls pushed
+        // further out end up in the border cells for the step before they are handed over.
+        int slab = transport.slab();
+        float columnsStart = layout.columns.startingPosition.x;
+        float xBegin = columnsStart + layout.firstColumn[slab] * layout.columns.cellSize - halo();
+        float xEnd = columnsStart + layout.firstColumn[slab + 1] * layout.columns.cellSize + halo();
+        local.grid = slabOfGrid(whole.grid, xBegin, xEnd);
+        for (const GridLevel &level : whole.coarseLevels) {
+            local.coarseLevels.push_back({ level.minRadius, level.maxRadius, slabOfGrid(level.grid, xBegin, xEnd), {} });
+        }
+    } else {
+        // A single slab is the whole room, wrapping onto itself when periodic
+        local.grid = whole.grid;
+        local.coarseLevels = whole.coarseLevels;
+    }
+    local.particles.acceleration = whole.particles.acceleration;
+    local.stepCount = whole.stepCount;
+
+    for (size_t slot = 0; slot < whole.particles.count; ++slot) {
+        SlabParticle particle = slabParticleAt(whole.particles, slot);
+        if (layout.slabOfColumn(columnOf(particle)) == transport.slab()) {
+            owned.push_back(particle);
+        }
+    }
+}
+
+int SlabDomain::columnOf(const SlabParticle &particle) const {
+    int x, y, z;
+    layout.columns.cellCoordinatesOf(positionOf(particle), x, y, z);
+    return x;
+}
+
+float SlabDomain::halo() const {
+    return std::max(layout.largeReach, layout.columns.cellSize);
+}
+
+float SlabDomain::offsetFromBoundary(float x, int side) const {
+    // Both slabs at a boundary place it at the start of the upper one's first column, and so work out the same
+    // offsets; around a periodic box that is column 0 for the last slab's upper boundary too
+    int slab = transport.slab();
+    int column = side == SLAB_BELOW ? layout.firstColumn[slab] : layout.firstColumn[slab + 1] % layout.columns.numberCellsX;
+    float offset = x - (layout.columns.startingPosition.x + column * layout.columns.cellSize);
+    float length = roomPeriodicLength.x;
+    if (length > 0.0f && fabsf(offset) > 0.5f * length) offset -= copysignf(length, offset);
+    return offset;
+}
+
+std::vector<int> SlabDomain::edgeBalls(int side) const {
+    int slab = transport.slab();
+    int column = side == SLAB_BELOW ? layout.firstColumn[slab] : layout.firstColumn[slab + 1] - 1;
+    int cell = layout.columns.cellAt(column, 0, 0);
+    return std::vector<int>(layout.columns.sortedBallIndices.begin() + layout.columns.cellStart[cell],
+                            layout.columns.sortedBallIndices.begin() + layout.columns.cellStart[cell + 1]);
+}
+
+std::vector<int> SlabDomain::boundarySet(int side, const std::vector<int> &large,
+                                         const std::vector<SlabParticle> &neighbourLarge) const {
+    // Every ball in the edge column, which covers the pairs of balls that fit the columns
+    std::vector<int> balls = edgeBalls(side);
+    // Large balls close enough to touch something across the boundary
+    for (int ball : large) {
+        if (fabsf(offsetFromBoundary(owned[ball].position[0], side)) < layout.largeReach) balls.push_back(ball);
+    }
+    // And whatever touches one of the neighbour's large balls, looked up in the columns it overlaps
+    for (const SlabParticle &other : neighbourLarge) {
+        float reach = other.radius + contactRadius;
+        Vector3 position = positionOf(other);
+        Vector3 extent = { reach, reach, reach };
+        layout.columns.forEachBallInBox(Vector3Subtract(position, extent), Vector3Add(position, extent), [&](int ball) {
+            Vector3 separation = Vector3Subtract(positionOf(owned[ball]), position);
+            if (roomPeriodicLength.x > 0.0f) {
+                separation.x -= roomPeriodicLength.x * roundf(separation.x / roomPeriodicLength.x);
+                separation.y -= roomPeriodicLength.y * roundf(separation.y / roomPeriodicLength.y);
+                separation.z -= roomPeriodicLength.z * roundf(separation.z / roomPeriodicLength.z);
+            }
+            if (fabsf(separation.x) < reach && fabsf(separation.y) < reach && fabsf(separation.z) < reach) {
+                balls.push_back(ball);
+            }
+        });
+    }
+    std::sort(balls.begin(), balls.end());
+    balls.erase(std::unique(balls.begin(), balls.end()), balls.end());
+    return balls;
+}
+
+void SlabDomain::step() {
+    int slab = transport.slab();
+    std::vector<unsigned char> outgoing[2], incoming[2];
+
+    // Balls that moved out of the slab's columns go to the slab they moved into, at most one over. Around a
+    // periodic box with two slabs both sides lead to the same slab, so the side is the boundary the ball is at.
+    std::vector<SlabParticle> leaving[2];
+    // Large balls of the neighbours that can touch this slab's balls, starting with those this slab hands over
+    std::vector<SlabParticle> neighbourLarge[2];
+    std::vector<int> large;  // indices into owned
+    size_t kept = 0;
+    for (const SlabParticle &particle : owned) {
+        int destination = layout.slabOfColumn(columnOf(particle));
+        if (destination == slab) {
+            if (particle.radius > contactRadius) large.push_back((int)kept);
+            owned[kept++] = particle;
+            continue;
+        }
+        float x = particle.position[0];
+        int side = fabsf(offsetFromBoundary(x, SLAB_BELOW)) < fabsf(offsetFromBoundary(x, SLAB_ABOVE)) ? SLAB_BELOW : SLAB_ABOVE;
+        if (destination != transport.neighbour(side)) {
+            throw std::runtime_error("ball " + std::to_string(particle.id) + " crossed more than one slab in a step");
+        }
+        leaving[side].push_back(particle);
+        if (particle.radius > contactRadius) neighbourLarge[side].push_back(particle);
+    }
+    owned.resize(kept);
+
+    // Each message is the number of balls handed over, those balls, then copies of the large balls this slab keeps
+    // near that boundary
+    for (int side = 0; side < 2; ++side) {
+        if (transport.neighbour(side) < 0) continue;
+        appendCount(outgoing[side], leaving[side].size());
+        for (const SlabParticle &particle : leaving[side]) appendParticle(outgoing[side], particle);
+        for (int ball : large) {
+            if (fabsf(offsetFromBoundary(owned[ball].position[0], side)) < layout.largeReach) {
+                appendParticle(outgoing[side], owned[ball]);
+            }
+        }
+    }
+    transport.exchange(outgoing, incoming);
+    for (int side = 0; side < 2; ++side) {
+        if (incoming[side].empty()) continue;
+        size_t arriving = (size_t)countAt(incoming[side], 0);
+        size_t first = owned.size();
+        appendParticles(owned, incoming[side], sizeof(uint64_t), arriving);
+        for (size_t ball = first; ball < owned.size(); ++ball) {
+            if (owned[ball].radius > contactRadius) large.push_back((int)ball);
+        }
+        appendParticles(neighbourLarge[side], incoming[side], sizeof(uint64_t) + arriving * sizeof(SlabParticle));
+    }
+
+    // Copies of the balls at each boundary for the neighbour on that side
+    layout.columns.rebuild((int)owned.size(), [this](int i) { return positionOf(owned[i]); });
+    std::vector<int> mine[2];
+    for (int side = 0; side < 2; ++side) {
+        outgoing[side].clear();
+        if (transport.neighbour(side) < 0) continue;
+        mine[side] = boundarySet(side, large, neighbourLarge[side]);
+        for (int ball : mine[side]) {
+            appendParticle(outgoing[side], owned[ball]);
+        }
+    }
+    transport.exchange(outgoing, incoming);
+    ghosts = 0;
+    for (int side = 0; side < 2; ++side) {
+        std::vector<SlabParticle> sideGhosts;
+        appendParticles(sideGhosts, incoming[side]);
+        ghosts += sideGhosts.size();
+        if (!sideGhosts.empty()) resolveBoundary(side, mine[side], sideGhosts);
+    }
+
+    // The balls brought their species along, so the whole system's table still fits
+    ParticleSystem &particles = local.particles;
+    if (setBallCount(particles, owned.size())) particles.speciesTable = speciesTable;
+    for (size_t slot = 0; slot < owned.size(); ++slot) {
+        setSlot(particles, slot, owned[slot]);
+    }
+    local.step();
+    for (size_t slot = 0; slot < owned.size(); ++slot) {
+        owned[slot] = slabParticleAt(particles, slot);
+    }
+}
+
+void SlabDomain::resolveBoundary(int side, const std::vector<int> &mine, const std::vector<SlabParticle> &sideGhosts) {
+    // The neighbour has the same balls from both sides of the boundary, as ghosts where this slab has its own
+    // balls, and resolves the same pairs in the same order: by the id of the ball below, then above
+    size_t ownCount = mine.size();
+    setBallCount(boundaryBalls, ownCount + sideGhosts.size());
+    for (size_t slot = 0; slot < boundaryBalls.count; ++slot) {
+        setSlot(boundaryBalls, slot, slot < ownCount ? owned[mine[slot]] : sideGhosts[slot - ownCount]);
+    }
+
+    struct BoundaryPair {
+        int below, above;  // slots in boundaryBalls
+        int32_t belowId, aboveId;
+    };
+    std::vector<BoundaryPair> pairs;
+    auto candidate = [&](int i, int j) {
+        bool ownI = (size_t)i < ownCount;
+        if (ownI == ((size_t)j < ownCount)) return;  // both on the same side, left to that slab's own step
+        int own = ownI ? i : j;
+        int theirs = ownI ? j : i;
+        int below = side == SLAB_BELOW ? theirs : own;
+        int above = side == SLAB_BELOW ? own : theirs;
+        pairs.push_back({ below, above, boundaryBalls.ids[below], boundaryBalls.ids[above] });
+    };
+    // Small balls through the fine grid, the few larger than its cells by looking up the cells they overlap
+    std::vector<int> small, large;
+    for (size_t slot = 0; slot < boundaryBalls.count; ++slot) {
+        (boundaryBalls.radius[slot] <= contactRadius ? small : large).push_back((int)slot);
+    }
+    auto contactPosition = [&](int slot) {
+        Vector3 position = boundaryBalls.position(slot);
+        return Vector3{ offsetFromBoundary(position.x, side), position.y, position.z };
+    };
+    contacts.rebuild((int)small.size(), [&](int i) { return contactPosition(small[i]); });
+    contacts.forEachNeighbourPair([&](int a, int b) { candidate(small[a], small[b]); });
+    for (size_t a = 0; a < large.size(); ++a) {
+        Vector3 position = contactPosition(large[a]);
+        float reach = boundaryBalls.radius[large[a]] + contactRadius;
+        Vector3 extent = { reach, reach, reach };
+        contacts.forEachBallInBox(Vector3Subtract(position, extent), Vector3Add(position, extent),
+                                  [&](int b) { candidate(large[a], small[b]); });
+        for (size_t b = a + 1; b < large.size(); ++b) {
+            candidate(large[a], large[b]);
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const BoundaryPair &a, const BoundaryPair &b) {
+        return a.belowId != b.belowId ? a.belowId < b.belowId : a.aboveId < b.aboveId;
+    });
+    for (const BoundaryPair &pair : pairs) {
+        handleParticleCollision(boundaryBalls, pair.below, pair.above, roomPeriodicLength);
+    }
+
+    for (size_t slot = 0; slot < ownCount; ++slot) {
+        owned[mine[slot]] = slabParticleAt(boundaryBalls, slot);
+    }
+}
+
+std::vector<SlabParticle> SlabDomain::gather() {
+    int slab = transport.slab();
+    std::vector<SlabParticle> collected = owned;
+    // Passed down a slab at a time, starting from the top one, so every exchange is between neighbours
+    for (int sender = transport.slabCount() - 1; sender >= 1; --sender) {
+        std::vector<unsigned char> outgoing[2], incoming[2];
+        if (slab == sender) {
+            for (const SlabParticle &particle : collected) appendParticle(outgoing[SLAB_BELOW], particle);
+            collected.clear();
+        }
+        transport.exchange(outgoing, incoming);
+        if (slab == sender - 1) {
+            appendParticles(collected, incoming[SLAB_ABOVE]);
+        }
+    }
+    std::sort(collected.begin(), collected.end(), [](const SlabParticle &a, const SlabParticle &b) { return a.id < b.id; });
+    return collected;
+}
+
+#ifdef __linux__
+// CPUs of a NUMA node from its sysfs cpulist, e.g. "0-15,32-47"
+static bool readNodeCpus(int node, cpu_set_t &cpus) {
+    std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr) return false;
+    CPU_ZERO(&cpus);
+    int first, last;
+    while (fscanf(file, "%d", &first) == 1) {
+        last = first;
+        int separator = fgetc(file);
+        if (separator == '-') {
+            if (fscanf(file, "%d", &last) != 1) break;
+            separator = fgetc(file);
+        }
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &cpus);
+        if (separator != ',') break;
+    }
+    fclose(file);
+    return CPU_COUNT(&cpus) > 0;
+}
+
+// Keeps this process and the threads it starts on the CPUs of one NUMA node, so each slab's memory stays local.
+// Does nothing on machines with a single node.
+static void pinToNumaNode(int slab) {
+    cpu_set_t cpus;
+    int nodes = 0;
+    while (readNodeCpus(nodes, cpus)) nodes++;
+    if (nodes < 2 || !readNodeCpus(slab % nodes, cpus)) return;
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+#else
+static void pinToNumaNode(int) {}
+#endif
+
+// Everything one slab does in a run: steps, then hands its balls to slab 0
+static std::vector<SlabParticle> runSlab(const Simulation &whole, const SlabLayout &layout, SharedMemoryRings &rings,
+                                         int slab, long long steps, const SlabRunOptions &options,
+                                         std::function<bool()> peersAlive) {
+    if (options.pinToNodes) pinToNumaNode(slab);
+    SharedMemoryTransport transport(rings, slab, std::move(peersAlive));
+    try {
+        SlabDomain domain(whole, layout, transport);
+        domain.local.setThreadCount(options.threadsPerSlab);
+        for (long long step = 0; step < steps; ++step) {
+            domain.step();
+        }
+        return domain.gather();
+    } catch (...) {
+        transport.abort();
+        throw;
+    }
+}
+
+void runSlabDecomposed(Simulation &whole, long long steps, const SlabRunOptions &options) {
+#ifdef SLAB_PROCESSES
+    SlabLayout layout = slabLayout(whole, options.slabs);
+    SharedMemoryRings rings(options.slabs, whole.boundary.type == BoundaryType::Periodic, options.ringBytes);
+
+    // Nothing buffered may be written twice by the children
+    std::cout.flush();
+    fflush(stdout);
+    pid_t parent = getpid();
+    std::vector<pid_t> children;
+    for (int slab = 1; slab < options.slabs; ++slab) {
+        pid_t child = fork();
+        if (child < 0) {
+            rings.aborted().store(1);
+            for (pid_t started : children) waitpid(started, nullptr, 0);
+            throw std::runtime_error("could not fork the process for slab " + std::to_string(slab));
+        }
+        if (child == 0) {
+            // The parent's worker threads don't exist in the child, so it must never touch its pool
+            int status = 0;
+            // An orphaned child is adopted by another process, so the parent has died if that changes
+            auto parentAlive = [parent]() { return getppid() == parent; };
+            try {
+                runSlab(whole, layout, rings, slab, steps, options, parentAlive);
+            } catch (const std::exception &e) {
+                std::cerr << "slab " << slab << ": " << e.what() << "\n";
+                status = 1;
+            }
+            _exit(status);
+        }
+        children.push_back(child);
+    }
+
+    // A child killed by a signal can't abort the run itself, so slab 0 reaps the children while it waits and
+    // aborts for them
+    std::vector<bool> reaped(children.size(), false);
+    size_t running = children.size();
+    bool childFailed = false;
+    auto reapChildren = [&]() {
+        for (size_t c = 0; c < children.size(); ++c) {
+            if (reaped[c]) continue;
+            int status = 0;
+            pid_t result = waitpid(children[c], &status, WNOHANG);
+            if (result == 0) continue;
+            reaped[c] = true;
+            running--;
+            if (result < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) childFailed = true;
+        }
+        return !childFailed;
+    };
+
+    std::vector<SlabParticle> gathered;
+    std::exception_ptr failure;
+    try {
+        gathered = runSlab(whole, layout, rings, 0, steps, options, reapChildren);
+    } catch (...) {
+        failure = std::current_exception();
+    }
+    // Children still exchanging among themselves wait on each other, so a failure now has to stop them too
+    while (running > 0) {
+        if (!reapChildren()) rings.aborted().store(1);
+        if (running > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (failure) std::rethrow_exception(failure);
+    if (childFailed) {
+        throw std::runtime_error("a slab process failed");
+    }
+    if (gathered.size() != whole.particles.count) {
+        throw std::runtime_error("the slabs came back with " + std::to_string(gathered.size()) + " of "
+                                 + std::to_string(whole.particles.count) + " balls");
+    }
+
+    ParticleSystem &particles = whole.particles;
+    for (const SlabParticle &particle : gathered) {
+        size_t slot = particles.slotOfId[particle.id];
+        particles.setPosition(slot, positionOf(particle));
+        particles.setPastPosition(slot, { particle.pastPosition[0], particle.pastPosition[1], particle.pastPosition[2] });
+    }
+    whole.stepCount += steps;
+    whole.neighbours.valid = false;
+#else
+    (void)whole;
+    (void)steps;
+    (void)options;
+    throw std::runtime_error("slab decomposed runs fork a process per slab, which this platform can't");
+#endif
+}
@@ -0,0 +1,100 @@
+#ifndef SLAB_DECOMPOSITION_H
+#define SLAB_DECOMPOSITION_H
+
+#include <cstdint>
+#include <vector>
+#include "CollisionGrid.h"
+#include "Simulation.h"
+#include "SlabTransport.h"
+
+// Domain decomposition of a room into slabs along x, each stepped by its own process with its own memory, for
+// rooms too big for the memory bandwidth of one socket. Before every step a slab hands the balls that moved out
+// of it to the slab they moved into, along with copies of its large balls near the boundary, then sends copies of
+// every ball that can touch a ball across a boundary to the neighbour there as ghosts. The pairs straddling a
+// boundary are resolved first, by both slabs from the same copies in the same order, so both come to the same
+// result for them without talking again; then each slab steps its own balls.
+// Runs differ from a single process only in the order collisions are resolved in.
+
+// A ball on its way between slabs. Colours and tracked paths stay with the whole system.
+struct SlabParticle {
+    float position[3];
+    float pastPosition[3];
+    float radius;
+    float inverseMass;
+    int32_t id;  // in the whole system
+    uint8_t species;  // in the whole system's species table
+};
+
+// Columns across the room at least one diameter of the balls in the fine grid wide, so those balls can only touch
+// balls in the same or a neighbouring column. The few larger balls take part in the pairs at a boundary from up to
+// largeReach away, along with the balls they touch on the other side. Slabs are runs of enough whole columns that
+// no ball is at two boundaries.
+struct SlabLayout {
+    CollisionGrid columns;  // one cell per column, wrapping like the room does
+    std::vector<int> firstColumn;  // of each slab, followed by the number of columns
+    float fineRadius;  // largest radius of the balls that fit the columns
+    float largeReach;  // sum of the two largest radii, 0 when every ball fits the columns
+
+    int slabCount() const { return (int)firstColumn.size() - 1; }
+    int slabOfColumn(int column) const;
+};
+
+// Throws std::invalid_argument if the room has too few columns for every slab to have enough
+SlabLayout slabLayout(const Simulation &whole, int slabCount);
+
+// One slab of a decomposed run, talking to the others through transport
+class SlabDomain {
+public:
+    // Takes the balls of whole in this slab's columns
+    SlabDomain(const Simulation &whole, const SlabLayout &_layout, SlabTransport &_transport);
+
+    // Every slab has to step together
+    void step();
+
+    // Collects the balls of every slab on slab 0 in id order, the other slabs get none. Every slab has to call it.
+    std::vector<SlabParticle> gather();
+
+    size_t ownedCount() const { return owned.size(); }
+    size_t ghostCount() const { return ghosts; }
+
+    // This slab's balls while stepping, with grids cut down to the slab and its halo
+    Simulation local;
+
+private:
+    int columnOf(const SlabParticle &particle) const;
+    // How far from a boundary a ball can take part in the pairs across it, at least a column
+    float halo() const;
+    // Signed distance along x from the boundary at side, to the nearest image around a periodic box
+    float offsetFromBoundary(float x, int side) const;
+    // Indices into owned of the balls in the column at side, as of the last rebuild of layout.columns
+    std::vector<int> edgeBalls(int side) const;
+    // Indices into owned of every ball that can touch a ball of the neighbour at side: the edge column, the large
+    // balls (indices into owned) near the boundary and the balls touching the neighbour's large balls near it
+    std::vector<int> boundarySet(int side, const std::vector<int> &large, const std::vector<SlabParticle> &neighbourLarge) const;
+    // Collides the boundary set mine of this slab with the ghosts from the neighbour at side
+    void resolveBoundary(int side, const std::vector<int> &mine, const std::vector<SlabParticle> &sideGhosts);
+
+    SlabLayout layout;
+    SlabTransport &transport;
+    std::vector<SlabParticle> owned;
+    size_t ghosts = 0;
+    SpeciesTable speciesTable;  // the whole system's, worked out once before the run
+    float contactRadius;  // of the balls that fit the cells of contacts
+    CollisionGrid contacts;  // for the pairs at a boundary, by offset from it along x
+    Vector3 roomPeriodicLength;  // of the whole room's grid
+    ParticleSystem boundaryBalls;
+};
+
+struct SlabRunOptions {
+    int slabs = 2;
+    int threadsPerSlab = 1;
+    bool pinToNodes = true;  // slab k to NUMA node k % nodes, Linux only
+    size_t ringBytes = (size_t)4 << 20;  // per direction between each pair of neighbouring slabs
+};
+
+// Steps whole steps times split into slabs over shared memory rings: slab 0 in this process and every other one
+// in a forked child, then writes the positions back into whole. Needs fork, so POSIX only; throws
+// std::runtime_error elsewhere or if any slab fails, std::invalid_argument for a layout that doesn't fit.
+void runSlabDecomposed(Simulation &whole, long long steps, const SlabRunOptions &options);
+
+#endif // SLAB_DECOMPOSITION_H
@@ -0,0 +1,191 @@
+#include "SlabTransport.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define SHARED_MEMORY_RINGS 1
+#include <sys/mman.h>
+#endif
+
+// Rounds of polling without progress before an exchange starts yielding the core
+const int EXCHANGE_SPIN_ROUNDS = 1000;
+
+// Yielding rounds between checks that the other slabs are still running
+const int EXCHANGE_LIVENESS_ROUNDS = 1000;
+
+// Space before the rings for the shared flags, one cache line
+const size_t RINGS_CONTROL_BYTES = 64;
+
+static size_t roundUpToCacheLine(size_t bytes) {
+    return (bytes + 63) / 64 * 64;
+}
+
+SharedMemoryRings::SharedMemoryRings(int slabCount, bool periodic, size_t ringBytes) :
+    slabs(slabCount),
+    wraps(periodic),
+    capacity(roundUpToCacheLine(std::max<size_t>(ringBytes, 64)))
+{
+    if (slabCount < 1) {
+        throw std::invalid_argument("a decomposition needs at least one slab");
+    }
+#ifdef SHARED_MEMORY_RINGS
+    mappingBytes = RINGS_CONTROL_BYTES + 2 * (size_t)slabs * (sizeof(Ring) + capacity);
+    void *memory = mmap(nullptr, mappingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("could not map " + std::to_string(mappingBytes) + " bytes of shared memory for the slab rings");
+    }
+    mapping = static_cast<unsigned char *>(memory);
+    new (mapping) std::atomic<int>(0);
+    for (int slab = 0; slab < slabs; ++slab) {
+        for (int side = 0; side < 2; ++side) {
+            Ring *shared = new (&ring(slab, side)) Ring;
+            shared->written.store(0);
+            shared->read.store(0);
+        }
+    }
+#else
+    throw std::runtime_error("shared memory slab rings need POSIX shared mappings, which this platform doesn't have");
+#endif
+}
+
+SharedMemoryRings::~SharedMemoryRings() {
+#ifdef SHARED_MEMORY_RINGS
+    if (mapping != nullptr) munmap(mapping, mappingBytes);
+#endif
+}
+
+int SharedMemoryRings::neighbour(int slab, int side) const {
+    // A single slab wraps onto itself through its own periodic grid, not through ghosts
+    if (slabs == 1) return -1;
+    int other = side == SLAB_BELOW ? slab - 1 : slab + 1;
+    if (other >= 0 && other < slabs) return other;
+    return wraps ? (other + slabs) % slabs : -1;
+}
+
+SharedMemoryRings::Ring &SharedMemoryRings::ring(int slab, int side) {
+    size_t index = 2 * (size_t)slab + side;
+    return *reinterpret_cast<Ring *>(mapping + RINGS_CONTROL_BYTES + index * (sizeof(Ring) + capacity));
+}
+
+unsigned char *SharedMemoryRings::ringData(int slab, int side) {
+    return reinterpret_cast<unsigned char *>(&ring(slab, side)) + sizeof(Ring);
+}
+
+std::atomic<int> &SharedMemoryRings::aborted() {
+    return *reinterpret_cast<std::atomic<int> *>(mapping);
+}
+
+// Copies as much of source as fits, returns how much did
+static size_t writeRing(SharedMemoryRings::Ring &ring, unsigned char *data, size_t capacity,
+                        const unsigned char *source, size_t bytes) {
+    uint64_t written = ring.written.load(std::memory_order_relaxed);
+    uint64_t space = capacity - (written - ring.read.load(std::memory_order_acquire));
+    size_t count = (size_t)std::min<uint64_t>(space, bytes);
+    if (count == 0) return 0;
+    size_t start = (size_t)(written % capacity);
+    size_t first = std::min(count, capacity - start);
+    memcpy(data + start, source, first);
+    memcpy(data, source + first, count - first);
+    ring.written.store(written + count, std::memory_order_release);
+    return count;
+}
+
+// Copies as much of what is waiting as target has room for, returns how much did
+static size_t readRing(SharedMemoryRings::Ring &ring, const unsigned char *data, size_t capacity,
+                       unsigned char *target, size_t bytes) {
+    uint64_t read = ring.read.load(std::memory_order_relaxed);
+    uint64_t waiting = ring.written.load(std::memory_order_acquire) - read;
+    size_t count = (size_t)std::min<uint64_t>(waiting, bytes);
+    if (count == 0) return 0;
+    size_t start = (size_t)(read % capacity);
+    size_t first = std::min(count, capacity - start);
+    memcpy(target, data + start, first);
+    memcpy(target + first, data, count - first);
+    ring.read.store(read + count, std::memory_order_release);
+    return count;
+}
+
+void SharedMemoryTransport::exchange(const std::vector<unsigned char> outgoing[2], std::vector<unsigned char> incoming[2]) {
+    // Each message is its length as 8 bytes followed by the payload, streamed through the ring so it can be any size
+    const size_t LENGTH_BYTES = sizeof(uint64_t);
+    uint64_t outgoingLength[2];
+    unsigned char incomingLength[2][LENGTH_BYTES];
+    size_t sent[2] = { 0, 0 };
+    size_t received[2] = { 0, 0 };
+    bool sending[2], receiving[2];
+    for (int side = 0; side < 2; ++side) {
+        outgoingLength[side] = outgoing[side].size();
+        incoming[side].clear();
+        sending[side] = receiving[side] = neighbour(side) >= 0;
+    }
+
+    size_t capacity = rings.ringBytes();
+    int idleRounds = 0;
+    while (sending[0] || sending[1] || receiving[0] || receiving[1]) {
+        bool progress = false;
+        for (int side = 0; side < 2; ++side) {
+            if (sending[side]) {
+                SharedMemoryRings::Ring &ring = rings.ring(slabIndex, side);
+                unsigned char *data = rings.ringData(slabIndex, side);
+                size_t before = sent[side];
+                if (sent[side] < LENGTH_BYTES) {
+                    const unsigned char *length = reinterpret_cast<const unsigned char *>(&outgoingLength[side]);
+                    sent[side] += writeRing(ring, data, capacity, length + sent[side], LENGTH_BYTES - sent[side]);
+                }
+                if (sent[side] >= LENGTH_BYTES) {
+                    size_t done = sent[side] - LENGTH_BYTES;
+                    sent[side] += writeRing(ring, data, capacity, outgoing[side].data() + done, outgoing[side].size() - done);
+                }
+                progress = progress || sent[side] != before;
+                sending[side] = sent[side] < LENGTH_BYTES + outgoing[side].size();
+            }
+            if (receiving[side]) {
+                // The neighbour on this side sends to us through its ring on the opposite side
+                int other = neighbour(side);
+                SharedMemoryRings::Ring &ring = rings.ring(other, 1 - side);
+                const unsigned char *data = rings.ringData(other, 1 - side);
+                size_t before = received[side];
+                if (received[side] < LENGTH_BYTES) {
+                    received[side] += readRing(ring, data, capacity, incomingLength[side] + received[side],
+                                               LENGTH_BYTES - received[side]);
+                    if (received[side] == LENGTH_BYTES) {
+                        uint64_t length;
+                        memcpy(&length, incomingLength[side], LENGTH_BYTES);
+                        incoming[side].resize((size_t)length);
+                    }
+                }
+                if (received[side] >= LENGTH_BYTES) {
+                    size_t done = received[side] - LENGTH_BYTES;
+                    received[side] += readRing(ring, data, capacity, incoming[side].data() + done, incoming[side].size() - done);
+                }
+                progress = progress || received[side] != before;
+                receiving[side] = received[side] < LENGTH_BYTES || received[side] < LENGTH_BYTES + incoming[side].size();
+            }
+        }
+        if (progress) {
+            idleRounds = 0;
+            continue;
+        }
+        if (rings.aborted().load(std::memory_order_relaxed) != 0) {
+            throw std::runtime_error("slab " + std::to_string(slabIndex) + " gave up waiting, another slab failed");
+        }
+        if (++idleRounds > EXCHANGE_SPIN_ROUNDS) {
+            std::this_thread::yield();
+        }
+        if (idleRounds > EXCHANGE_SPIN_ROUNDS + EXCHANGE_LIVENESS_ROUNDS) {
+            idleRounds = EXCHANGE_SPIN_ROUNDS;
+            if (peersAlive && !peersAlive()) {
+                abort();
+                throw std::runtime_error("slab " + std::to_string(slabIndex) + " gave up waiting, another slab died");
+            }
+        }
+    }
+}
+
+void SharedMemoryTransport::abort() {
+    rings.aborted().store(1);
+}
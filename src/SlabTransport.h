@@ -0,0 +1,89 @@
+#ifndef SLAB_TRANSPORT_H
+#define SLAB_TRANSPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Sides of a slab along the decomposed axis
+const int SLAB_BELOW = 0;
+const int SLAB_ABOVE = 1;
+
+// Carries byte messages between the slabs of a decomposed run, each slab only talking to the slabs on either side.
+// Everything goes through exchange(), in which every slab sends one message to each neighbour and receives one
+// from each, so an implementation can overlap the two directions however suits it and no pair of slabs can end up
+// waiting on each other. Other transports (sockets, MPI) only need to implement this.
+class SlabTransport {
+public:
+    virtual ~SlabTransport() = default;
+
+    virtual int slab() const = 0;
+    virtual int slabCount() const = 0;
+    // Slab on that side, -1 at the ends of a room that doesn't wrap
+    virtual int neighbour(int side) const = 0;
+
+    // Sends outgoing[side] to the neighbour on that side and fills incoming[side] with what it sent this slab.
+    // Sides without a neighbour send nothing and receive an empty message. Every slab has to call it the same
+    // number of times. Throws std::runtime_error if the exchange can't complete, e.g. another slab failed.
+    virtual void exchange(const std::vector<unsigned char> outgoing[2], std::vector<unsigned char> incoming[2]) = 0;
+
+    // Makes every blocked or later exchange() throw, in this and the other slabs, after an error
+    virtual void abort() = 0;
+};
+
+// Single producer, single consumer byte rings for every neighbouring pair of slabs in one shared anonymous mapping.
+// Made before the slab processes are forked so each inherits the mapping; no network or files involved.
+// Not available on Windows or the web, where the constructor throws std::runtime_error.
+class SharedMemoryRings {
+public:
+    SharedMemoryRings(int slabCount, bool periodic, size_t ringBytes);
+    ~SharedMemoryRings();
+    SharedMemoryRings(const SharedMemoryRings &) = delete;
+    SharedMemoryRings &operator=(const SharedMemoryRings &) = delete;
+
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> written;  // bytes ever written, only advanced by the sending slab
+        alignas(64) std::atomic<uint64_t> read;     // bytes ever read, only advanced by the receiving slab
+    };
+
+    int slabCount() const { return slabs; }
+    bool periodic() const { return wraps; }
+    size_t ringBytes() const { return capacity; }
+    int neighbour(int slab, int side) const;
+    // Ring carrying what slab sends to its neighbour on side
+    Ring &ring(int slab, int side);
+    unsigned char *ringData(int slab, int side);
+    std::atomic<int> &aborted();
+
+private:
+    int slabs;
+    bool wraps;
+    size_t capacity;
+    size_t mappingBytes = 0;
+    unsigned char *mapping = nullptr;
+};
+
+// One slab's end of a set of SharedMemoryRings. Waits by spinning and then yielding, as the slabs are meant to
+// have a core each.
+// A slab killed by a signal never gets to abort, so while it waits an exchange also calls peersAlive now and then,
+// if given, and aborts once that returns false.
+class SharedMemoryTransport : public SlabTransport {
+public:
+    SharedMemoryTransport(SharedMemoryRings &_rings, int _slab, std::function<bool()> _peersAlive = nullptr) :
+        rings(_rings), slabIndex(_slab), peersAlive(std::move(_peersAlive)) {}
+
+    int slab() const override { return slabIndex; }
+    int slabCount() const override { return rings.slabCount(); }
+    int neighbour(int side) const override { return rings.neighbour(slabIndex, side); }
+    void exchange(const std::vector<unsigned char> outgoing[2], std::vector<unsigned char> incoming[2]) override;
+    void abort() override;
+
+private:
+    SharedMemoryRings &rings;
+    int slabIndex;
+    std::function<bool()> peersAlive;
+};
+
+#endif // SLAB_TRANSPORT_H
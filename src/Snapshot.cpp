@@ -0,0 +1,380 @@
+#include "Snapshot.h"
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SNAPSHOT_MAGIC[8] = { '3', 'D', 'S', 'N', 'A', 'P', 0, 0 };
+
+// positionX/Y/Z, pastPositionX/Y/Z, radius, inverseMass
+const int SNAPSHOT_ARRAY_COUNT = 8;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint64_t particleCount;
+    int64_t stepCount;
+    float roomDimensions[3];
+    float acceleration[3];
+    uint32_t boundaryType;
+    float boxMin[3];
+    float boxMax[3];
+    float cellSize;
+    int32_t numberCells[3];
+    float gridStart[3];
+    uint32_t gridPeriodic;
+    uint32_t gridHashed;  // was padding before, so older version 2 files have 0
+    uint64_t arrayOffset[SNAPSHOT_ARRAY_COUNT];
+    uint64_t colorsOffset;
+    uint64_t idsOffset;
+    uint64_t wallsOffset;
+    uint64_t trackedOffset;
+    uint64_t randomOffset;
+    uint32_t wallCount;
+    uint32_t trackedCount;
+    uint64_t trackedBytes;
+    uint64_t randomBytes;
+};
+static_assert(std::is_trivially_copyable<SnapshotHeader>::value, "the header is written as raw bytes");
+
+struct SnapshotWall {
+    float centerPosition[3];
+    float xAxisRotation;
+    float yAxisRotation;
+    float size[2];
+    unsigned char wallColor[4];
+};
+
+template <typename Particles>
+static auto particleArray(Particles &particles, int index) -> decltype(&particles.positionX) {
+    decltype(&particles.positionX) arrays[SNAPSHOT_ARRAY_COUNT] = {
+        &particles.positionX, &particles.positionY, &particles.positionZ,
+        &particles.pastPositionX, &particles.pastPositionY, &particles.pastPositionZ,
+        &particles.radius, &particles.inverseMass
+    };
+    return arrays[index];
+}
+
+// Saving
+//--------------------------------------------------------------------------------------
+
+// Appends sections to a file, each starting on a PARTICLE_ALIGNMENT boundary
+struct SectionWriter {
+    FILE *file;
+    uint64_t offset = 0;
+    bool good = true;
+
+    void write(const void *data, size_t bytes) {
+        if (bytes > 0 && fwrite(data, 1, bytes, file) != bytes) good = false;
+        offset += bytes;
+    }
+
+    uint64_t beginSection() {
+        static const char zeros[PARTICLE_ALIGNMENT] = {};
+        write(zeros, (PARTICLE_ALIGNMENT - offset % PARTICLE_ALIGNMENT) % PARTICLE_ALIGNMENT);
+        return offset;
+    }
+};
+
+void saveSnapshot(const Simulation &simulation, const std::string &path) {
+    const ParticleSystem &particles = simulation.particles;
+    const CollisionGrid &grid = simulation.grid;
+    const Boundary &boundary = simulation.boundary;
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerBytes = sizeof(SnapshotHeader);
+    header.particleCount = particles.count;
+    header.stepCount = simulation.stepCount;
+    header.roomDimensions[0] = simulation.roomDimensions.x;
+    header.roomDimensions[1] = simulation.roomDimensions.y;
+    header.roomDimensions[2] = simulation.roomDimensions.z;
+    header.acceleration[0] = particles.acceleration.x;
+    header.acceleration[1] = particles.acceleration.y;
+    header.acceleration[2] = particles.acceleration.z;
+    header.boundaryType = (uint32_t)boundary.type;
+    header.boxMin[0] = boundary.boxMin.x;
+    header.boxMin[1] = boundary.boxMin.y;
+    header.boxMin[2] = boundary.boxMin.z;
+    header.boxMax[0] = boundary.boxMax.x;
+    header.boxMax[1] = boundary.boxMax.y;
+    header.boxMax[2] = boundary.boxMax.z;
+    header.cellSize = grid.cellSize;
+    header.numberCells[0] = grid.numberCellsX;
+    header.numberCells[1] = grid.numberCellsY;
+    header.numberCells[2] = grid.numberCellsZ;
+    header.gridStart[0] = grid.startingPosition.x;
+    header.gridStart[1] = grid.startingPosition.y;
+    header.gridStart[2] = grid.startingPosition.z;
+    header.gridPeriodic = grid.periodic ? 1 : 0;
+    header.gridHashed = grid.hashed ? 1 : 0;
+    header.wallCount = (uint32_t)simulation.room.size();
+    header.trackedCount = (uint32_t)particles.cold.trackedParticles.size();
+
+    std::string temporaryPath = path + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("could not open " + temporaryPath + " for writing");
+    }
+    SectionWriter writer = { file };
+    writer.write(&header, sizeof(header));  // rewritten with the offsets at the end
+
+    // Arrays are padded to the same capacity as AlignedArray so vector loads past the last particle stay in the mapping
+    std::vector<float> padding(AlignedArray<float>::paddedCapacity(particles.count) - particles.count, 0.0f);
+    for (int a = 0; a < SNAPSHOT_ARRAY_COUNT; ++a) {
+        header.arrayOffset[a] = writer.beginSection();
+        writer.write(particleArray(particles, a)->data, particles.count * sizeof(float));
+        writer.write(padding.data(), padding.size() * sizeof(float));
+    }
+
+    header.colorsOffset = writer.beginSection();
+    writer.write(particles.cold.colors.data(), particles.count * sizeof(Color));
+
+    header.idsOffset = writer.beginSection();
+    writer.write(particles.ids.data(), particles.count * sizeof(int32_t));
+
+    header.wallsOffset = writer.beginSection();
+    for (const Wall &wall : simulation.room) {
+        SnapshotWall saved = {
+            { wall.centerPosition.x, wall.centerPosition.y, wall.centerPosition.z },
+            wall.xAxisRotation, wall.yAxisRotation,
+            { wall.size.x, wall.size.y },
+            { wall.wallColor.r, wall.wallColor.g, wall.wallColor.b, wall.wallColor.a }
+        };
+        writer.write(&saved, sizeof(saved));
+    }
+
+    // Per tracked particle: int32 id, float last velocity[3], uint32 point count, float points[3 * count]
+    header.trackedOffset = writer.beginSection();
+    for (size_t t = 0; t < particles.cold.trackedParticles.size(); ++t) {
+        int32_t index = particles.cold.trackedParticles[t];
+        Vector3 lastVelocity = particles.cold.trackedLastVelocity[t];
+        const RingBuffer<Vector3> &path = particles.cold.trackedPositions[t];
+        uint32_t pointCount = (uint32_t)path.size();
+        writer.write(&index, sizeof(index));
+        writer.write(&lastVelocity, sizeof(lastVelocity));
+        writer.write(&pointCount, sizeof(pointCount));
+        for (size_t p = 0; p < path.size(); ++p) {
+            writer.write(&path[p], sizeof(Vector3));
+        }
+    }
+    header.trackedBytes = writer.offset - header.trackedOffset;
+
+    // The standard library's text form of the engine state, the only portable way to get at it
+    std::ostringstream randomState;
+    randomState << simulation.random;
+    std::string randomText = randomState.str();
+    header.randomOffset = writer.beginSection();
+    header.randomBytes = randomText.size();
+    writer.write(randomText.data(), randomText.size());
+
+    bool good = writer.good && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    good = fclose(file) == 0 && good;
+    if (!good) {
+        std::remove(temporaryPath.c_str());
+        throw std::runtime_error("could not write " + temporaryPath);
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::remove(temporaryPath.c_str());
+        throw std::runtime_error("could not replace " + path + ": " + error.message());
+    }
+}
+
+// Loading
+//--------------------------------------------------------------------------------------
+
+// Maps the whole file copy-on-write. The mapping is released when the last shared_ptr to it goes.
+static std::shared_ptr<void> mapFile(const std::string &path, size_t &fileSize) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) return nullptr;
+    void *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == nullptr) return nullptr;
+    fileSize = (size_t)size.QuadPart;
+    return std::shared_ptr<void>(view, [](void *pointer) { UnmapViewOfFile(pointer); });
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) return nullptr;
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        close(file);
+        return nullptr;
+    }
+    size_t size = (size_t)status.st_size;
+    void *view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);  // the mapping keeps the file open
+    if (view == MAP_FAILED) return nullptr;
+    fileSize = size;
+    return std::shared_ptr<void>(view, [size](void *pointer) { munmap(pointer, size); });
+#endif
+}
+
+static void checkSection(uint64_t offset, uint64_t bytes, size_t fileSize, const std::string &path) {
+    if (offset > fileSize || bytes > fileSize - offset) {
+        throw std::runtime_error(path + " is truncated");
+    }
+}
+
+Simulation loadSnapshot(const std::string &path) {
+    size_t fileSize = 0;
+    std::shared_ptr<void> mapping = mapFile(path, fileSize);
+    if (!mapping) {
+        throw std::runtime_error("could not map " + path);
+    }
+    const unsigned char *base = static_cast<const unsigned char *>(mapping.get());
+
+    SnapshotHeader header;
+    if (fileSize < sizeof(header)) {
+        throw std::runtime_error(path + " is not a snapshot");
+    }
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is not a snapshot");
+    }
+    if (header.version != SNAPSHOT_VERSION || header.headerBytes != sizeof(SnapshotHeader)) {
+        throw std::runtime_error(path + " is snapshot version " + std::to_string(header.version)
+                                 + ", expected " + std::to_string(SNAPSHOT_VERSION));
+    }
+
+    size_t count = (size_t)header.particleCount;
+    ParticleSystem particles;
+    particles.count = count;
+    uint64_t arrayBytes = AlignedArray<float>::paddedCapacity(count) * sizeof(float);
+    for (int a = 0; a < SNAPSHOT_ARRAY_COUNT; ++a) {
+        checkSection(header.arrayOffset[a], arrayBytes, fileSize, path);
+        if (header.arrayOffset[a] % PARTICLE_ALIGNMENT != 0) {
+            throw std::runtime_error(path + " has a misaligned particle array");
+        }
+        AlignedArray<float> &array = *particleArray(particles, a);
+        array.data = reinterpret_cast<float *>(const_cast<unsigned char *>(base) + header.arrayOffset[a]);
+        array.size = count;
+        array.storage = mapping;
+    }
+#if defined(_WIN32)
+    // Windows can't replace a file while a view of it is mapped, so saving over the snapshot that was just loaded
+    // (F9 then F5 in the viewer) would fail to rename. The arrays are copied out instead and the mapping goes once
+    // loading is done.
+    for (int a = 0; a < SNAPSHOT_ARRAY_COUNT; ++a) {
+        AlignedArray<float> &array = *particleArray(particles, a);
+        array = AlignedArray<float>(array);
+    }
+#endif
+    particles.acceleration = { header.acceleration[0], header.acceleration[1], header.acceleration[2] };
+
+    checkSection(header.colorsOffset, count * sizeof(Color), fileSize, path);
+    const Color *colors = reinterpret_cast<const Color *>(base + header.colorsOffset);
+    particles.cold.colors.assign(colors, colors + count);
+
+    checkSection(header.idsOffset, count * sizeof(int32_t), fileSize, path);
+    const int32_t *ids = reinterpret_cast<const int32_t *>(base + header.idsOffset);
+    particles.ids.assign(ids, ids + count);
+    particles.slotOfId.assign(count, -1);
+    for (size_t slot = 0; slot < count; ++slot) {
+        if (ids[slot] < 0 || (size_t)ids[slot] >= count || particles.slotOfId[ids[slot]] != -1) {
+            throw std::runtime_error(path + " has a corrupt particle id table");
+        }
+        particles.slotOfId[ids[slot]] = (int)slot;
+    }
+
+    std::vector<Wall> room;
+    checkSection(header.wallsOffset, (uint64_t)header.wallCount * sizeof(SnapshotWall), fileSize, path);
+    for (uint32_t w = 0; w < header.wallCount; ++w) {
+        SnapshotWall saved;
+        memcpy(&saved, base + header.wallsOffset + w * sizeof(SnapshotWall), sizeof(saved));
+        Wall wall = { { saved.centerPosition[0], saved.centerPosition[1], saved.centerPosition[2] },
+                      saved.xAxisRotation, saved.yAxisRotation };
+        wall.size = { saved.size[0], saved.size[1] };
+        wall.wallColor = { saved.wallColor[0], saved.wallColor[1], saved.wallColor[2], saved.wallColor[3] };
+        room.push_back(wall);
+    }
+
+    checkSection(header.trackedOffset, header.trackedBytes, fileSize, path);
+    const unsigned char *cursor = base + header.trackedOffset;
+    const unsigned char *trackedEnd = cursor + header.trackedBytes;
+    for (uint32_t t = 0; t < header.trackedCount; ++t) {
+        int32_t index;
+        Vector3 lastVelocity;
+        uint32_t pointCount;
+        if ((size_t)(trackedEnd - cursor) < sizeof(index) + sizeof(lastVelocity) + sizeof(pointCount)) {
+            throw std::runtime_error(path + " has a truncated tracked particle list");
+        }
+        memcpy(&index, cursor, sizeof(index));
+        memcpy(&lastVelocity, cursor + sizeof(index), sizeof(lastVelocity));
+        memcpy(&pointCount, cursor + sizeof(index) + sizeof(lastVelocity), sizeof(pointCount));
+        cursor += sizeof(index) + sizeof(lastVelocity) + sizeof(pointCount);
+        if ((size_t)(trackedEnd - cursor) / sizeof(Vector3) < pointCount || index < 0 || (size_t)index >= count) {
+            throw std::runtime_error(path + " has a corrupt tracked particle list");
+        }
+        RingBuffer<Vector3> trackedPath(TRACKED_PATH_CAPACITY);
+        for (uint32_t p = 0; p < pointCount; ++p, cursor += sizeof(Vector3)) {
+            Vector3 point;
+            memcpy(&point, cursor, sizeof(point));
+            trackedPath.push(point);
+        }
+        particles.cold.trackedParticles.push_back(index);
+        particles.cold.trackedLastVelocity.push_back(lastVelocity);
+        particles.cold.trackedPositions.push_back(std::move(trackedPath));
+    }
+
+    Vector3 roomDimensions = { header.roomDimensions[0], header.roomDimensions[1], header.roomDimensions[2] };
+    Simulation simulation(roomDimensions, room, std::move(particles));
+    simulation.stepCount = header.stepCount;
+
+    Vector3 boxMin = { header.boxMin[0], header.boxMin[1], header.boxMin[2] };
+    Vector3 boxMax = { header.boxMax[0], header.boxMax[1], header.boxMax[2] };
+    switch ((BoundaryType)header.boundaryType) {
+        case BoundaryType::Planes: simulation.boundary = planeBoundary(simulation.room); break;
+        case BoundaryType::AxisAlignedBox: simulation.boundary = boundaryFromWalls(simulation.room); break;
+        case BoundaryType::Periodic: simulation.boundary = periodicBoundary(boxMin, boxMax); break;
+        default: throw std::runtime_error(path + " has an unknown boundary type");
+    }
+
+    if (header.cellSize <= 0.0f || header.numberCells[0] < 1 || header.numberCells[1] < 1 || header.numberCells[2] < 1) {
+        throw std::runtime_error(path + " has an invalid grid");
+    }
+    simulation.grid = CollisionGrid(header.cellSize, header.numberCells[0], header.numberCells[1], header.numberCells[2],
+                                    { header.gridStart[0], header.gridStart[1], header.gridStart[2] },
+                                    header.gridHashed != 0);
+    simulation.grid.periodic = header.gridPeriodic != 0;
+    simulation.gridStorage = header.gridHashed != 0 ? GridStorage::Hashed : GridStorage::Dense;
+    try {
+        simulation.buildCoarseLevels();
+    } catch (const std::invalid_argument &error) {
+        throw std::runtime_error(path + " has an invalid grid: " + error.what());
+    }
+
+    checkSection(header.randomOffset, header.randomBytes, fileSize, path);
+    std::istringstream randomState(std::string(reinterpret_cast<const char *>(base + header.randomOffset), (size_t)header.randomBytes));
+    randomState >> simulation.random;
+    if (randomState.fail()) {
+        throw std::runtime_error(path + " has a corrupt random number generator state");
+    }
+    return simulation;
+}
@@ -0,0 +1,25 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include "Simulation.h"
+
+// Checkpoint files holding everything needed to carry on a run: particle state, walls, boundary, grid
+// parameters, the simulation's random number generator and the step count.
+//
+// The file starts with a fixed header giving the offset of every section. Each particle array is stored
+// 64-byte aligned and padded like AlignedArray, so loading maps the file copy-on-write and points the
+// particle arrays straight into the mapping. Nothing is read or copied until it is touched, and writes go to
+// private pages, never back to the file. On Windows, where a mapped file can't be replaced, the arrays are copied
+// out while loading so the same path can be saved over. Byte order is the machine's own.
+const unsigned int SNAPSHOT_VERSION = 2;  // 2 added the slot to particle id table
+
+// Writes to path + ".tmp" then renames it over path, so an interrupted save never leaves a broken snapshot.
+// Throws std::runtime_error if the file can't be written.
+void saveSnapshot(const Simulation &simulation, const std::string &path);
+
+// Throws std::runtime_error if the file can't be read or is not a snapshot of this version.
+// The loaded simulation runs single threaded, like a new one.
+Simulation loadSnapshot(const std::string &path);
+
+#endif // SNAPSHOT_H
@@ -1,4 +1,5 @@
 #include "Objects.h"
+#include <algorithm>
 
 // Functions for different starting states (rooms and ball configurations)
 
@@ -35,7 +36,7 @@ std::vector<Ball3d> threeBallsBouncing() {
     Ball3d ball2 { Vector3 { 2.0f, 5.0f, 0.0f }, Vector3 { -0.02f, -0.3f, 0.0f } };
     balls.push_back(ball2);
     Ball3d ball3 { { 0.0f, 1.5f, 1.5f }, { 0.001f, 0.001f, -0.01f } };
-    ball3.color = RED;
+    ball3.color = { 230, 41, 55, 255 };  // raylib RED
     ball3.mass = 10;
     balls.push_back(ball3);
     return balls;
@@ -44,6 +45,12 @@ std::vector<Ball3d> threeBallsBouncing() {
 // Return vector containing largeBall and copies of smallBall to fill the room
 // smallBall copies will have their velocity vector randomly rotated and color slightly randomized
 std::vector<Ball3d> brownianMotion(Vector3 roomDimensions, Ball3d &smallBall, Ball3d &largeBall, int nSmallBalls) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    return brownianMotion(roomDimensions, smallBall, largeBall, nSmallBalls, gen);
+}
+
+std::vector<Ball3d> brownianMotion(Vector3 roomDimensions, Ball3d &smallBall, Ball3d &largeBall, int nSmallBalls, std::mt19937 &gen) {
     std::vector<Ball3d> balls;
 
     balls.push_back(largeBall);
@@ -56,8 +63,6 @@ std::vector<Ball3d> brownianMotion(Vector3 roomDimensions, Ball3d &smallBall, Ba
     int ballsPerRow = std::cbrt(nSmallBalls);
 
     // Random number generator for velocity direction and color modification
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
     std::uniform_int_distribution<int> redDist(-10, 10);
     std::uniform_int_distribution<int> greenDist(-10, 10);
@@ -88,7 +93,12 @@ std::vector<Ball3d> brownianMotion(Vector3 roomDimensions, Ball3d &smallBall, Ba
                 // Create the small ball copy
                 Ball3d ball {ballPosition, ballVelocity};
                 ball.radius = smallBall.radius;
-                ball.color = smallBall.color;
+                ball.color = {
+                    static_cast<unsigned char>(std::clamp(smallBall.color.r + redDist(gen), 0, 255)),
+                    static_cast<unsigned char>(std::clamp(smallBall.color.g + greenDist(gen), 0, 255)),
+                    static_cast<unsigned char>(std::clamp(smallBall.color.b + blueDist(gen), 0, 255)),
+                    smallBall.color.a
+                };
                 ball.mass = smallBall.mass;
 
                 balls.push_back(ball);
@@ -100,6 +110,12 @@ std::vector<Ball3d> brownianMotion(Vector3 roomDimensions, Ball3d &smallBall, Ba
 }
 
 std::vector<Ball3d> generateBalls(Vector3 roomDimensions, float ballRadius, float velocityMagnitude, int numBalls) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    return generateBalls(roomDimensions, ballRadius, velocityMagnitude, numBalls, gen);
+}
+
+std::vector<Ball3d> generateBalls(Vector3 roomDimensions, float ballRadius, float velocityMagnitude, int numBalls, std::mt19937 &gen) {
     std::vector<Ball3d> balls;
 
     // Calculate spacing between balls
@@ -110,8 +126,6 @@ std::vector<Ball3d> generateBalls(Vector3 roomDimensions, float ballRadius, floa
     int ballsPerRow = std::cbrt(numBalls);
 
     // Random number generator for velocity direction
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
     std::uniform_int_distribution<int> redDist(0, 50);
     std::uniform_int_distribution<int> greenDist(0, 50);
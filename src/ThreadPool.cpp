@@ -0,0 +1,68 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threadCount) {
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::runTasks() {
+    int task;
+    while ((task = nextTask.fetch_add(1)) < currentTaskCount) {
+        (*currentTask)(task);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    long long seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeWorkers.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+
+        runTasks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0) {
+            workersFinished.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int taskCount, const std::function<void(int)> &task) {
+    if (workers.empty() || taskCount <= 1) {
+        for (int i = 0; i < taskCount; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentTask = &task;
+        currentTaskCount = taskCount;
+        nextTask = 0;
+        busyWorkers = (int)workers.size();
+        generation++;
+    }
+    wakeWorkers.notify_all();
+
+    runTasks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    workersFinished.wait(lock, [&] { return busyWorkers == 0; });
+}
@@ -0,0 +1,65 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for fork-join loops. The calling thread takes part in every loop,
+// so a pool of threadCount threads starts threadCount - 1 workers.
+// Tasks are handed out one index at a time from a shared counter, so faster threads take more of them.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int threadCount() const {
+        return (int)workers.size() + 1;
+    }
+
+    // Calls task(i) for every i in [0, taskCount) and returns once all of them have finished
+    void parallelFor(int taskCount, const std::function<void(int)> &task);
+
+private:
+    void workerLoop();
+    void runTasks();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable workersFinished;
+    const std::function<void(int)> *currentTask = nullptr;
+    int currentTaskCount = 0;
+    std::atomic<int> nextTask{0};
+    int busyWorkers = 0;
+    long long generation = 0;
+    bool stopping = false;
+};
+
+// Runs task serially when there is no pool
+inline void parallelFor(ThreadPool *pool, int taskCount, const std::function<void(int)> &task) {
+    if (pool != nullptr) {
+        pool->parallelFor(taskCount, task);
+        return;
+    }
+    for (int i = 0; i < taskCount; ++i) {
+        task(i);
+    }
+}
+
+// Splits [0, count) into chunks of chunkSize and calls task(begin, end) for each of them
+inline void parallelForChunks(ThreadPool *pool, size_t count, size_t chunkSize, const std::function<void(size_t, size_t)> &task) {
+    int numberChunks = (int)((count + chunkSize - 1) / chunkSize);
+    parallelFor(pool, numberChunks, [&](int chunk) {
+        size_t begin = chunk * chunkSize;
+        size_t end = begin + chunkSize < count ? begin + chunkSize : count;
+        task(begin, end);
+    });
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,245 @@
+#include "TrajectoryWriter.h"
+#include <cmath>
+#include <cstring>
+
+static const char TRAJECTORY_MAGIC[8] = { '3', 'D', 'T', 'R', 'A', 'J', 0, 0 };
+
+TrajectoryWriter::TrajectoryWriter(const std::string &path, const ParticleSystem &particles, std::vector<int> particleIds,
+                                   TrajectoryWriterOptions _options) :
+    ids(std::move(particleIds)),
+    options(_options)
+{
+    if (ids.empty()) {
+        for (size_t i = 0; i < particles.count; ++i) {
+            ids.push_back((int)i);
+        }
+    }
+    if (options.framesPerChunk < 1) options.framesPerChunk = 1;
+    if (options.maxPendingChunks < 1) options.maxPendingChunks = 1;
+
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return;
+
+    unsigned int flags = options.deltaEncoding ? TRAJECTORY_DELTA : 0;
+    unsigned int numberParticles = (unsigned int)ids.size();
+    bool written = fwrite(TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC), 1, file) == 1
+        && fwrite(&TRAJECTORY_VERSION, sizeof(TRAJECTORY_VERSION), 1, file) == 1
+        && fwrite(&flags, sizeof(flags), 1, file) == 1
+        && fwrite(&numberParticles, sizeof(numberParticles), 1, file) == 1
+        && fwrite(&options.quantum, sizeof(options.quantum), 1, file) == 1
+        && fwrite(ids.data(), sizeof(int), ids.size(), file) == ids.size();
+    if (!written) {
+        fclose(file);
+        file = nullptr;
+        return;
+    }
+    writer = std::thread(&TrajectoryWriter::writeLoop, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+bool TrajectoryWriter::isGood() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !failed;
+}
+
+void TrajectoryWriter::record(long long step, const ParticleSystem &particles) {
+    if (file == nullptr) return;
+
+    size_t n = ids.size();
+    size_t offset = current.positions.size();
+    current.steps.push_back(step);
+    current.positions.resize(offset + 3 * n);
+    float *x = &current.positions[offset];
+    for (size_t k = 0; k < n; ++k) {
+        int i = particles.slotOfId[ids[k]];
+        x[k] = particles.positionX[i];
+        x[n + k] = particles.positionY[i];
+        x[2 * n + k] = particles.positionZ[i];
+    }
+
+    if ((int)current.steps.size() >= options.framesPerChunk) {
+        submitCurrentChunk();
+    }
+}
+
+void TrajectoryWriter::submitCurrentChunk() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return (int)pending.size() < options.maxPendingChunks || failed; });
+    if (failed) {
+        current.steps.clear();
+        current.positions.clear();
+        return;
+    }
+    pending.push_back(std::move(current));
+    if (!spare.empty()) {
+        current = std::move(spare.back());
+        spare.pop_back();
+    } else {
+        current = Chunk();
+    }
+    current.steps.clear();
+    current.positions.clear();
+    changed.notify_all();
+}
+
+void TrajectoryWriter::close() {
+    if (file == nullptr) return;
+    if (!current.steps.empty()) {
+        submitCurrentChunk();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+    fclose(file);
+    file = nullptr;
+}
+
+void TrajectoryWriter::writeLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this] { return !pending.empty() || stopping; });
+        if (pending.empty()) return;
+
+        Chunk chunk = std::move(pending.front());
+        pending.pop_front();
+        bool skip = failed;
+        lock.unlock();
+        if (!skip) writeChunk(chunk);
+        lock.lock();
+
+        if ((int)spare.size() < options.maxPendingChunks) {
+            spare.push_back(std::move(chunk));
+        }
+        changed.notify_all();
+    }
+}
+
+static void appendBytes(std::vector<unsigned char> &bytes, const void *data, size_t size) {
+    const unsigned char *begin = static_cast<const unsigned char *>(data);
+    bytes.insert(bytes.end(), begin, begin + size);
+}
+
+static void appendVarint(std::vector<unsigned char> &bytes, unsigned long long value) {
+    while (value >= 0x80) {
+        bytes.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((unsigned char)value);
+}
+
+void TrajectoryWriter::writeChunk(const Chunk &chunk) {
+    size_t valuesPerFrame = 3 * ids.size();
+    encoded.clear();
+    std::vector<long long> previous;
+    if (options.deltaEncoding) previous.assign(valuesPerFrame, 0);
+
+    for (size_t frame = 0; frame < chunk.steps.size(); ++frame) {
+        appendBytes(encoded, &chunk.steps[frame], sizeof(long long));
+        const float *values = &chunk.positions[frame * valuesPerFrame];
+        if (!options.deltaEncoding) {
+            appendBytes(encoded, values, valuesPerFrame * sizeof(float));
+            continue;
+        }
+        for (size_t v = 0; v < valuesPerFrame; ++v) {
+            long long quantized = llround((double)values[v] / options.quantum);
+            long long delta = quantized - previous[v];
+            previous[v] = quantized;
+            appendVarint(encoded, ((unsigned long long)delta << 1) ^ (unsigned long long)(delta >> 63));
+        }
+    }
+
+    unsigned int frameCount = (unsigned int)chunk.steps.size();
+    unsigned int payloadBytes = (unsigned int)encoded.size();
+    bool written = fwrite(&frameCount, sizeof(frameCount), 1, file) == 1
+        && fwrite(&payloadBytes, sizeof(payloadBytes), 1, file) == 1
+        && fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    if (!written) {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = true;
+    }
+}
+
+static bool readVarint(const unsigned char *&cursor, const unsigned char *end, unsigned long long &value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && cursor < end; shift += 7) {
+        unsigned char byte = *cursor++;
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+bool readTrajectory(const std::string &path, TrajectoryData &data) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) return false;
+
+    char magic[8];
+    unsigned int version, flags, numberParticles;
+    float quantum;
+    bool valid = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, TRAJECTORY_MAGIC, sizeof(magic)) == 0
+        && fread(&version, sizeof(version), 1, file) == 1 && version == TRAJECTORY_VERSION
+        && fread(&flags, sizeof(flags), 1, file) == 1
+        && fread(&numberParticles, sizeof(numberParticles), 1, file) == 1
+        && fread(&quantum, sizeof(quantum), 1, file) == 1;
+    if (valid) {
+        data.ids.resize(numberParticles);
+        valid = fread(data.ids.data(), sizeof(int), numberParticles, file) == numberParticles;
+    }
+    data.steps.clear();
+    data.positions.clear();
+
+    size_t valuesPerFrame = 3 * (size_t)numberParticles;
+    std::vector<unsigned char> payload;
+    std::vector<long long> previous;
+    unsigned int frameCount, payloadBytes;
+    while (valid && fread(&frameCount, sizeof(frameCount), 1, file) == 1) {
+        valid = fread(&payloadBytes, sizeof(payloadBytes), 1, file) == 1;
+        payload.resize(payloadBytes);
+        valid = valid && fread(payload.data(), 1, payloadBytes, file) == payloadBytes;
+        const unsigned char *cursor = payload.data();
+        const unsigned char *end = cursor + payload.size();
+        previous.assign(valuesPerFrame, 0);
+
+        for (unsigned int frame = 0; valid && frame < frameCount; ++frame) {
+            long long step;
+            if ((size_t)(end - cursor) < sizeof(step)) {
+                valid = false;
+                break;
+            }
+            memcpy(&step, cursor, sizeof(step));
+            cursor += sizeof(step);
+            data.steps.push_back(step);
+
+            size_t offset = data.positions.size();
+            data.positions.resize(offset + valuesPerFrame);
+            float *values = &data.positions[offset];
+            if ((flags & TRAJECTORY_DELTA) == 0) {
+                if ((size_t)(end - cursor) < valuesPerFrame * sizeof(float)) {
+                    valid = false;
+                    break;
+                }
+                memcpy(values, cursor, valuesPerFrame * sizeof(float));
+                cursor += valuesPerFrame * sizeof(float);
+                continue;
+            }
+            for (size_t v = 0; v < valuesPerFrame; ++v) {
+                unsigned long long zigzag;
+                if (!readVarint(cursor, end, zigzag)) {
+                    valid = false;
+                    break;
+                }
+                long long delta = (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+                previous[v] += delta;
+                values[v] = (float)(previous[v] * (double)quantum);
+            }
+        }
+    }
+    fclose(file);
+    return valid;
+}
@@ -0,0 +1,89 @@
+#ifndef TRAJECTORY_WRITER_H
+#define TRAJECTORY_WRITER_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ParticleSystem.h"
+
+// Binary trajectory file, native byte order:
+//   header: "3DTRAJ\0\0", uint32 version, uint32 flags, uint32 particle count n, float quantum, uint32 ids[n]
+//   then chunks: uint32 frame count, uint32 payload bytes, payload
+// A raw payload has, per frame, an int64 step followed by float x[n], y[n], z[n].
+// With TRAJECTORY_DELTA each coordinate is instead rounded to a multiple of quantum and stored as the zigzag
+// varint of its difference from the previous frame (from 0 for a chunk's first frame), so chunks decode on their own.
+const unsigned int TRAJECTORY_VERSION = 1;
+const unsigned int TRAJECTORY_DELTA = 1;
+
+struct TrajectoryWriterOptions {
+    int framesPerChunk = 64;
+    bool deltaEncoding = false;
+    float quantum = 1e-4f;     // position resolution with delta encoding
+    int maxPendingChunks = 8;  // record() waits for the writer thread beyond this, which bounds memory
+};
+
+// Streams particle positions to a file. record() only copies the positions, chunks are encoded and written
+// on a background thread.
+class TrajectoryWriter {
+public:
+    // particleIds are the ids (ParticleSystem::ids) of the particles to write, all of them if empty
+    TrajectoryWriter(const std::string &path, const ParticleSystem &particles, std::vector<int> particleIds = {},
+                     TrajectoryWriterOptions options = {});
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter &) = delete;
+    TrajectoryWriter &operator=(const TrajectoryWriter &) = delete;
+
+    bool isOpen() const { return file != nullptr; }
+    // False once a write has failed, later frames are dropped
+    bool isGood() const;
+
+    void record(long long step, const ParticleSystem &particles);
+    // Writes the last partial chunk and waits for the file to be complete
+    void close();
+
+private:
+    struct Chunk {
+        std::vector<long long> steps;
+        std::vector<float> positions;  // x[n], y[n], z[n] per frame
+    };
+
+    void writeLoop();
+    void writeChunk(const Chunk &chunk);
+    void submitCurrentChunk();
+
+    FILE *file = nullptr;
+    std::vector<int> ids;
+    TrajectoryWriterOptions options;
+    Chunk current;
+    std::vector<unsigned char> encoded;  // only touched by the writer thread
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Chunk> pending;
+    std::vector<Chunk> spare;  // written chunks kept to reuse their memory
+    bool stopping = false;
+    bool failed = false;
+    std::thread writer;
+};
+
+// Whole trajectory file read back into memory, mostly for analysis and checking files
+struct TrajectoryData {
+    std::vector<int> ids;
+    std::vector<long long> steps;
+    std::vector<float> positions;  // x[n], y[n], z[n] per frame
+
+    size_t frameCount() const { return steps.size(); }
+    Vector3 position(size_t frame, size_t particle) const {
+        const float *x = &positions[frame * 3 * ids.size()];
+        return { x[particle], x[ids.size() + particle], x[2 * ids.size() + particle] };
+    }
+};
+
+bool readTrajectory(const std::string &path, TrajectoryData &data);
+
+#endif // TRAJECTORY_WRITER_H
@@ -0,0 +1,42 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock-free handoff of the latest value from one writer thread to one reader thread.
+// The writer fills writeBuffer() and publishes it; the reader picks up the newest published value with update()
+// and reads it in place. Of the three buffers one belongs to each side and the third sits in the middle, swapped
+// in with an atomic exchange, so neither side ever waits for the other and values the reader was too slow to
+// pick up are simply overwritten.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer side
+    T &writeBuffer() {
+        return buffers[writeIndex];
+    }
+    void publish() {
+        writeIndex = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader side. Returns true if a value was published since the last call, which readBuffer() now holds.
+    bool update() {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    const T &readBuffer() const {
+        return buffers[readIndex];
+    }
+
+private:
+    static constexpr int INDEX_MASK = 3;
+    static constexpr int FRESH = 4;  // set in middle while it holds a value the reader has not taken
+
+    T buffers[3];
+    std::atomic<int> middle{1};
+    int writeIndex = 0;
+    int readIndex = 2;
+};
+
+#endif // TRIPLE_BUFFER_H
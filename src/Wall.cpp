@@ -11,33 +11,19 @@ void Wall::set_yAxisRotation(float newYRotation) {
 }
 
 // unit vector normal to wall plane
-Vector3 Wall::normalVector() {
+Vector3 Wall::normalVector() const {
     // calculation relies on normal vector initially lying along y-axis, then performing appropriate rotations
     return {sinf(yAxisRotationRadians) * sinf(xAxisRotationRadians), cosf(xAxisRotationRadians), cosf(yAxisRotationRadians) * sinf(xAxisRotationRadians)};
 }
 
 // unit vector lying in the wall plane
-Vector3 Wall::inplaneVector() {
+Vector3 Wall::inplaneVector() const {
     // calculation relies on vector initially lying along z-axis, then performing appropriate rotations
     return {sinf(yAxisRotationRadians) * cosf(xAxisRotationRadians), -1.0f*sinf(xAxisRotationRadians), cosf(yAxisRotationRadians) * cosf(xAxisRotationRadians)};
 }
 
-float Wall::distanceToWall(Vector3 point) {
-    float displacementAlongNormal = -1.0f * Vector3DotProduct(normalVector(), centerPosition);
-    return abs(Vector3DotProduct(normalVector(), point) + displacementAlongNormal) / Vector3Length(normalVector());
+float Wall::distanceToWall(Vector3 point) const {
+    // normalVector() is a unit vector, so there is no need to divide by its length
+    Vector3 normal = normalVector();
+    return fabsf(Vector3DotProduct(normal, Vector3Subtract(point, centerPosition)));
 }
-
-void Wall::draw() {
-    rlPushMatrix();
-    rlTranslatef(centerPosition.x, centerPosition.y, centerPosition.z);
-    rlRotatef(yAxisRotation, 0.0f, 1.0f, 0.0f);
-    rlRotatef(xAxisRotation, 1.0f, 0.0f, 0.0f);
-    // Draw wireframe like borders to make adjacent walls easier to see
-    DrawLine3D( { -size.x / 2, 0.0f, size.y / 2 }, { size.x / 2, 0.0f, size.y / 2 }, BLACK );
-    DrawLine3D( { -size.x / 2, 0.0f, -size.y / 2 }, { size.x / 2, 0.0f, -size.y / 2 }, BLACK );
-    DrawLine3D( { size.x / 2, 0.0f, -size.y / 2 }, { size.x / 2, 0.0f, size.y / 2 }, BLACK );
-    DrawLine3D( { -size.x / 2, 0.0f, -size.y / 2 }, { -size.x / 2, 0.0f, size.y / 2 }, BLACK );
-    DrawPlane( { 0.0f, 0.0f, 0.0f }, size, wallColor );
-    rlPopMatrix();
-
-}
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Simulation.h"
+
+// Times the parts of a step across particle count, packing fraction and small/large radius ratio,
+// and writes the results as JSON for tracking regressions.
+//
+// Each configuration is a cubic room filled by the seeded generateBalls, sized so the balls (radius 0.5) make up
+// the requested packing fraction. With a radius ratio other than 1, balls on a coarser sublattice are made large
+// (radius 0.5 * ratio, mass ratio^3) and the small balls they would overlap are removed, so the actual count and
+// packing fraction are reported alongside the requested ones.
+
+static void printUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --counts LIST      particle counts, rounded to whole cubes (default 1000,10000,100000,1000000)\n"
+              << "  --packing LIST     packing fractions (default 0.05,0.2)\n"
+              << "  --ratios LIST      large/small radius ratios (default 1,4)\n"
+              << "  --repeats N        timed repeats of each operation, the median is reported (default 20)\n"
+              << "  --warmup N         full steps before timing (default 10)\n"
+              << "  --seed N           seed for the generators (default 1)\n"
+              << "  --threads N        worker threads (default 1)\n"
+              << "  --simd LEVEL       limit the kernels to scalar, sse2 or avx2 (default: best supported)\n"
+              << "  --output FILE      write the JSON there instead of to stdout\n";
+}
+
+static std::vector<double> parseList(const char *text) {
+    std::vector<double> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) values.push_back(atof(item.c_str()));
+    }
+    return values;
+}
+
+struct BenchmarkConfiguration {
+    long long requestedParticles;
+    double packingFraction;
+    double radiusRatio;
+};
+
+const float SMALL_RADIUS = 0.5f;
+const float BALL_SPEED = 0.3f;
+
+static double packingFractionOf(const std::vector<Ball3d> &balls, float roomSize) {
+    double volume = 0.0;
+    for (const Ball3d &ball : balls) {
+        volume += 4.0 / 3.0 * PI * ball.radius * ball.radius * ball.radius;
+    }
+    return volume / ((double)roomSize * roomSize * roomSize);
+}
+
+static double packingFractionOf(const Simulation &simulation) {
+    double volume = 0.0;
+    for (size_t i = 0; i < simulation.particles.count; ++i) {
+        double radius = simulation.particles.radius[i];
+        volume += 4.0 / 3.0 * PI * radius * radius * radius;
+    }
+    Vector3 room = simulation.roomDimensions;
+    return volume / ((double)room.x * room.y * room.z);
+}
+
+// Lattice of perRow^3 balls in a room of the given size, or nothing if the small balls don't fit
+static std::vector<Ball3d> latticeBalls(int perRow, float roomSize, double radiusRatio, unsigned int seed) {
+    float largeRadius = SMALL_RADIUS * (float)radiusRatio;
+    float largestRadius = std::max(largeRadius, SMALL_RADIUS);
+    float spacing = (roomSize - 2.0f * largestRadius) / perRow;
+    if (spacing < 2.0f * SMALL_RADIUS || roomSize < 4.0f * largestRadius) {
+        return {};
+    }
+
+    std::mt19937 generator(seed);
+    Vector3 roomDimensions = { roomSize, roomSize, roomSize };
+    std::vector<Ball3d> lattice = generateBalls(roomDimensions, largestRadius, BALL_SPEED, perRow * perRow * perRow, generator);
+    if (radiusRatio == 1.0) {
+        return lattice;
+    }
+
+    // generateBalls fills the lattice x-major, so ball (i, j, k) is at index (i * perRow + j) * perRow + k
+    int largeEvery = (int)ceilf(2.0f * largestRadius / spacing);
+    int reach = (int)ceilf((largeRadius + SMALL_RADIUS) / spacing);
+    auto latticeIndex = [perRow](int i, int j, int k) { return ((size_t)i * perRow + j) * perRow + k; };
+    std::vector<char> kind(lattice.size(), 0);  // 0 small, 1 large, 2 removed
+    for (int i = 0; i < perRow; i += largeEvery) {
+        for (int j = 0; j < perRow; j += largeEvery) {
+            for (int k = 0; k < perRow; k += largeEvery) {
+                Vector3 center = lattice[latticeIndex(i, j, k)].position;
+                for (int di = -reach; di <= reach; ++di) {
+                    for (int dj = -reach; dj <= reach; ++dj) {
+                        for (int dk = -reach; dk <= reach; ++dk) {
+                            int ni = i + di, nj = j + dj, nk = k + dk;
+                            if (ni < 0 || nj < 0 || nk < 0 || ni >= perRow || nj >= perRow || nk >= perRow) continue;
+                            size_t neighbour = latticeIndex(ni, nj, nk);
+                            if (kind[neighbour] == 0
+                                && Vector3Distance(center, lattice[neighbour].position) < largeRadius + SMALL_RADIUS) {
+                                kind[neighbour] = 2;
+                            }
+                        }
+                    }
+                }
+                kind[latticeIndex(i, j, k)] = 1;
+            }
+        }
+    }
+
+    std::vector<Ball3d> balls;
+    for (size_t b = 0; b < lattice.size(); ++b) {
+        if (kind[b] == 2) continue;
+        Ball3d ball = lattice[b];
+        ball.radius = kind[b] == 1 ? largeRadius : SMALL_RADIUS;
+        ball.mass = kind[b] == 1 ? std::max(1, (int)lround(pow(radiusRatio, 3.0))) : 1;
+        balls.push_back(ball);
+    }
+    return balls;
+}
+
+// Builds the configuration, or returns false if the balls don't fit on the lattice at that packing fraction.
+// Which small balls make way for large ones depends on the room size, so the size is refined a few times.
+static bool buildSimulation(const BenchmarkConfiguration &configuration, unsigned int seed,
+                            std::unique_ptr<Simulation> &simulation, float &roomSize) {
+    int perRow = std::max(1, (int)lround(cbrt((double)configuration.requestedParticles)));
+    double smallVolume = 4.0 / 3.0 * PI * SMALL_RADIUS * SMALL_RADIUS * SMALL_RADIUS;
+    roomSize = (float)cbrt((double)perRow * perRow * perRow * smallVolume / configuration.packingFraction);
+
+    std::vector<Ball3d> balls;
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        balls = latticeBalls(perRow, roomSize, configuration.radiusRatio, seed);
+        if (balls.empty()) return false;
+        double ratio = packingFractionOf(balls, roomSize) / configuration.packingFraction;
+        if (fabs(ratio - 1.0) < 0.01) break;
+        roomSize *= (float)cbrt(ratio);
+    }
+    simulation = std::make_unique<Simulation>(Vector3 { roomSize, roomSize, roomSize }, cubeRoom(roomSize), balls);
+    return true;
+}
+
+template <typename Operation>
+static double medianSeconds(int repeats, Operation operation) {
+    std::vector<double> seconds;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        operation();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        seconds.push_back(elapsed.count());
+    }
+    std::sort(seconds.begin(), seconds.end());
+    return seconds[seconds.size() / 2];
+}
+
+static void writeTiming(std::ostream &out, const char *name, double seconds, size_t count, bool last) {
+    out << "        \"" << name << "\": { \"medianSeconds\": " << seconds
+        << ", \"nsPerParticle\": " << (count > 0 ? seconds * 1e9 / count : 0.0) << " }" << (last ? "\n" : ",\n");
+}
+
+int main(int argc, char **argv) {
+    std::vector<double> counts = { 1000, 10000, 100000, 1000000 };
+    std::vector<double> packingFractions = { 0.05, 0.2 };
+    std::vector<double> radiusRatios = { 1, 4 };
+    int repeats = 20;
+    int warmup = 10;
+    unsigned int seed = 1;
+    int threadCount = 1;
+    std::string outputPath;
+
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--counts") == 0 && hasValue) {
+            counts = parseList(argv[++i]);
+        } else if (strcmp(argv[i], "--packing") == 0 && hasValue) {
+            packingFractions = parseList(argv[++i]);
+        } else if (strcmp(argv[i], "--ratios") == 0 && hasValue) {
+            radiusRatios = parseList(argv[++i]);
+        } else if (strcmp(argv[i], "--repeats") == 0 && hasValue) {
+            repeats = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--warmup") == 0 && hasValue) {
+            warmup = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--simd") == 0 && hasValue) {
+            std::string level = argv[++i];
+            setSimdLevel(level == "scalar" ? SimdLevel::Scalar : level == "sse2" ? SimdLevel::SSE2 : SimdLevel::AVX2);
+        } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            outputPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!outputPath.empty()) {
+        file.open(outputPath);
+        if (!file) {
+            std::cerr << "Could not open " << outputPath << "\n";
+            return 1;
+        }
+    }
+    std::ostream &out = outputPath.empty() ? std::cout : file;
+
+    out << "{\n  \"benchmark\": \"3Diffusion\",\n  \"version\": 1,\n  \"seed\": " << seed
+        << ",\n  \"simd\": \"" << simdLevelName(getSimdLevel()) << "\",\n  \"threads\": " << std::max(1, threadCount)
+        << ",\n  \"repeats\": " << repeats << ",\n  \"warmupSteps\": " << warmup << ",\n  \"results\": [";
+
+    bool first = true;
+    for (double count : counts) {
+        for (double packingFraction : packingFractions) {
+            for (double radiusRatio : radiusRatios) {
+                BenchmarkConfiguration configuration = { (long long)count, packingFraction, radiusRatio };
+                std::unique_ptr<Simulation> simulation;
+                float roomSize = 0.0f;
+                bool built = packingFraction > 0.0 && radiusRatio > 0.0
+                    && buildSimulation(configuration, seed, simulation, roomSize);
+
+                out << (first ? "\n" : ",\n") << "    {\n"
+                    << "      \"requestedParticles\": " << configuration.requestedParticles
+                    << ",\n      \"packingFraction\": " << packingFraction
+                    << ",\n      \"radiusRatio\": " << radiusRatio << ",\n";
+                first = false;
+                if (!built) {
+                    std::cerr << "skipping " << (long long)count << " particles, packing " << packingFraction
+                              << ", ratio " << radiusRatio << ": does not fit the starting lattice\n";
+                    out << "      \"skipped\": \"does not fit the starting lattice\"\n    }";
+                    continue;
+                }
+                std::cerr << "timing " << simulation->particles.count << " particles, packing " << packingFraction
+                          << ", ratio " << radiusRatio << "\n";
+
+                simulation->setThreadCount(threadCount);
+                for (int s = 0; s < warmup; ++s) {
+                    simulation->step();
+                }
+
+                // The parts of Simulation::step timed one by one, in the same order
+                Simulation &sim = *simulation;
+                ThreadPool *pool = sim.threadPool.get();
+                size_t n = sim.particles.count;
+                std::vector<double> rebuildTimes, collisionTimes, wallTimes, integrateTimes;
+                for (int r = 0; r < repeats; ++r) {
+                    rebuildTimes.push_back(medianSeconds(1, [&] { rebuildGrid(sim.grid, sim.coarseLevels, sim.particles, pool); }));
+                    collisionTimes.push_back(medianSeconds(1, [&] { handleParticleCollisions(sim.particles, sim.grid, sim.coarseLevels, pool); }));
+                    wallTimes.push_back(medianSeconds(1, [&] {
+                        parallelForChunks(pool, n, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+                            sim.boundary.apply(sim.particles, begin, end);
+                        });
+                    }));
+                    integrateTimes.push_back(medianSeconds(1, [&] {
+                        parallelForChunks(pool, n, PARTICLE_CHUNK_SIZE, [&](size_t begin, size_t end) {
+                            updatePositions(sim.particles, begin, end);
+                        });
+                    }));
+                }
+                double stepTime = medianSeconds(repeats, [&] { sim.step(); });
+                auto median = [](std::vector<double> &values) {
+                    std::sort(values.begin(), values.end());
+                    return values[values.size() / 2];
+                };
+
+                out << "      \"particles\": " << n
+                    << ",\n      \"actualPackingFraction\": " << packingFractionOf(sim)
+                    << ",\n      \"roomSize\": " << roomSize
+                    << ",\n      \"gridCells\": " << sim.grid.numberCells()
+                    << ",\n      \"timings\": {\n";
+                writeTiming(out, "gridRebuild", median(rebuildTimes), n, false);
+                writeTiming(out, "handleBallCollision", median(collisionTimes), n, false);
+                writeTiming(out, "handleWallCollision", median(wallTimes), n, false);
+                writeTiming(out, "updatePosition", median(integrateTimes), n, false);
+                writeTiming(out, "step", stepTime, n, true);
+                out << "      }\n    }";
+            }
+        }
+    }
+    out << "\n  ]\n}\n";
+    return 0;
+}
@@ -0,0 +1,629 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "Simulation.h"
+#include "EventDriven.h"
+#include "TrajectoryWriter.h"
+#include "Snapshot.h"
+#include "Analysis.h"
+#include "Ensemble.h"
+#include "SlabDecomposition.h"
+
+// Runs a scenario for a fixed number of steps as fast as possible, without a window or frame pacing.
+
+static void printUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --scenario NAME    brownian (default), gas or three\n"
+              << "  --steps N          number of DT steps to run (default 1000)\n"
+              << "  --engine NAME      step (fixed DT, default) or edmd (event driven hard spheres between walls, without\n"
+              << "                     acceleration or --stats)\n"
+              << "  --balls N          number of balls in the scenario (default 300)\n"
+              << "  --room SIZE        side length of the cubic room (default 20)\n"
+              << "  --packing F        size the room so the balls fill this fraction of it, instead of --room\n"
+              << "  --seed N           seed for the scenario's positions, velocities and colours (default 1)\n"
+              << "  --boundary NAME    box (default for the cubic room), planes (general walls) or periodic\n"
+              << "  --report-every N   print the first ball's position every N steps (default 0, off)\n"
+              << "  --load FILE        start from a snapshot instead of a scenario\n"
+              << "  --save FILE        write a snapshot at the end of the run\n"
+              << "  --checkpoint-every N  also write the --save snapshot every N steps (default 0, off)\n"
+              << "  --compare FILE     fail unless the run ends with the balls of the snapshot FILE, where they are in it\n"
+              << "  --compare-distance D  allow the balls to be a mean distance D from where they are in FILE (default 0)\n"
+              << "  --compare-energy E  allow the kinetic energy to differ from FILE's by a fraction E (default 0)\n"
+              << "  --stats FILE       write per-step timings and counters (needs DIFFUSION_INSTRUMENTATION)\n"
+              << "  --stats-format F   csv (default) or json, one object per line\n"
+              << "  --stats-every N    steps between stats records (default 1)\n"
+              << "  --trajectory FILE  stream every ball's position to a binary trajectory file\n"
+              << "  --trajectory-every N  steps between trajectory frames (default 1)\n"
+              << "  --trajectory-delta delta encode the trajectory, positions rounded to 1e-4\n"
+              << "  --analysis FILE    estimate the tracked balls' diffusion coefficients and the bath temperature\n"
+              << "                     every step, print them and write the full report as JSON\n"
+              << "  --analysis-thread  run the estimators on a background thread\n"
+              << "  --ensemble N       run N replicas seeded --seed, --seed + 1, ... spread over the threads and print\n"
+              << "                     the tracked balls' diffusion coefficients with standard errors, --analysis\n"
+              << "                     writes the ensemble report\n"
+              << "  --langevin N       fit a Langevin bath to the tracer's VACF in N explicit brownian replicas, then run\n"
+              << "                     the tracer alone in that bath instead of the scenario\n"
+              << "  --calibration-steps N  steps of each --langevin replica (default 2000)\n"
+              << "  --slabs N          split the room into N slabs along x, each stepped by its own process with\n"
+              << "                     --threads threads, pinned to the NUMA nodes in turn (default 1, off)\n"
+              << "  --reorder-every N  sort the balls into Morton order of their grid cells every N steps (default 0, off)\n"
+              << "  --neighbour-skin S reuse Verlet neighbour lists of pairs within r1 + r2 + S until a ball has moved\n"
+              << "                     S / 2 (default 0, rebuild the grid every step)\n"
+              << "  --grid NAME        dense, hashed (only occupied cells, for dilute balls in huge rooms) or auto (default)\n"
+              << "  --threads N        worker threads for the step, results do not depend on it (default 1)\n"
+              << "  --simd LEVEL       limit the kernels to scalar, sse2 or avx2 (default: best supported)\n";
+}
+
+static const char *boundaryTypeName(BoundaryType type) {
+    switch (type) {
+        case BoundaryType::AxisAlignedBox: return "box";
+        case BoundaryType::Periodic: return "periodic";
+        default: return "planes";
+    }
+}
+
+// Boundary of the replicas an ensemble runs, which start from a scenario's box room
+static BoundaryType replicaBoundary(const std::string &name) {
+    if (name.empty() || name == "box") return BoundaryType::AxisAlignedBox;
+    if (name == "planes") return BoundaryType::Planes;
+    if (name == "periodic") return BoundaryType::Periodic;
+    throw std::invalid_argument("Unknown boundary: " + name);
+}
+
+static void writeSeries(std::ostream &out, const std::vector<double> &values) {
+    out << "[";
+    for (size_t i = 0; i < values.size(); ++i) {
+        out << (i > 0 ? ", " : "") << values[i];
+    }
+    out << "]";
+}
+
+static bool writeAnalysis(const AnalysisReport &report, const std::string &path) {
+    std::ofstream out(path);
+    out.precision(9);
+    out << "{\n  \"samples\": " << report.samples
+        << ",\n  \"temperature\": " << report.temperature
+        << ",\n  \"meanTemperature\": " << report.meanTemperature
+        << ",\n  \"speedBinWidth\": " << report.speedBinWidth
+        << ",\n  \"speedHistogram\": [";
+    for (size_t i = 0; i < report.speedHistogram.size(); ++i) {
+        out << (i > 0 ? ", " : "") << report.speedHistogram[i];
+    }
+    out << "],\n  \"tracked\": [";
+    for (size_t t = 0; t < report.tracked.size(); ++t) {
+        const TrackedAnalysis &tracked = report.tracked[t];
+        out << (t > 0 ? "," : "") << "\n    {\"particle\": " << tracked.particle
+            << ", \"diffusionFromMsd\": " << tracked.diffusionFromMsd
+            << ", \"diffusionFromVacf\": " << tracked.diffusionFromVacf << ",\n     \"lags\": ";
+        writeSeries(out, tracked.lags);
+        out << ",\n     \"meanSquaredDisplacement\": ";
+        writeSeries(out, tracked.meanSquaredDisplacement);
+        out << ",\n     \"vacfLags\": ";
+        writeSeries(out, tracked.vacfLags);
+        out << ",\n     \"velocityAutocorrelation\": ";
+        writeSeries(out, tracked.velocityAutocorrelation);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.good();
+}
+
+static void writeEstimates(std::ostream &out, const std::vector<EnsembleEstimate> &estimates) {
+    out << "[";
+    for (size_t i = 0; i < estimates.size(); ++i) {
+        out << (i > 0 ? ", " : "") << "[" << estimates[i].mean << ", " << estimates[i].standardError << "]";
+    }
+    out << "]";
+}
+
+// Series of [mean, standard error] pairs
+static bool writeEnsemble(const EnsembleReport &report, const std::string &path) {
+    std::ofstream out(path);
+    out.precision(9);
+    out << "{\n  \"replicas\": " << report.replicas
+        << ",\n  \"samples\": " << report.samples
+        << ",\n  \"diffusionFromMsd\": [" << report.diffusionFromMsd.mean << ", " << report.diffusionFromMsd.standardError
+        << "],\n  \"diffusionFromVacf\": [" << report.diffusionFromVacf.mean << ", "
+        << report.diffusionFromVacf.standardError
+        << "],\n  \"meanTemperature\": [" << report.meanTemperature.mean << ", " << report.meanTemperature.standardError
+        << "],\n  \"lags\": ";
+    writeSeries(out, report.lags);
+    out << ",\n  \"meanSquaredDisplacement\": ";
+    writeEstimates(out, report.meanSquaredDisplacement);
+    out << ",\n  \"vacfLags\": ";
+    writeSeries(out, report.vacfLags);
+    out << ",\n  \"velocityAutocorrelation\": ";
+    writeEstimates(out, report.velocityAutocorrelation);
+    out << ",\n  \"replicaDiffusionFromMsd\": [";
+    bool first = true;
+    for (const AnalysisReport &replica : report.replicaReports) {
+        for (const TrackedAnalysis &tracked : replica.tracked) {
+            out << (first ? "" : ", ") << tracked.diffusionFromMsd;
+            first = false;
+        }
+    }
+    out << "]\n}\n";
+    return out.good();
+}
+
+static int runEnsembleMode(const EnsembleOptions &options, ThreadPool *pool, const std::string &analysisPath) {
+    std::cout << "ensemble of " << options.replicas << " " << options.scenario << " replicas, " << options.numberBalls
+              << " balls, " << options.steps << " steps, seeds " << options.firstSeed << " to "
+              << options.firstSeed + options.replicas - 1 << ", " << (pool ? pool->threadCount() : 1) << " threads\n";
+    auto startTime = std::chrono::steady_clock::now();
+    EnsembleReport report;
+    try {
+        report = runEnsemble(options, pool);
+    } catch (const std::exception &error) {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    double totalSteps = (double)options.steps * options.replicas;
+    std::cout << "elapsed " << elapsed.count() << " s, "
+              << (elapsed.count() > 0.0 ? totalSteps / elapsed.count() : 0.0) << " replica steps/s\n"
+              << "bath temperature " << report.meanTemperature.mean << " +- " << report.meanTemperature.standardError << "\n"
+              << report.samples << " tracked balls, D from MSD " << report.diffusionFromMsd.mean << " +- "
+              << report.diffusionFromMsd.standardError << ", from VACF " << report.diffusionFromVacf.mean << " +- "
+              << report.diffusionFromVacf.standardError << "\n";
+    if (!analysisPath.empty() && !writeEnsemble(report, analysisPath)) {
+        std::cerr << "Writing " << analysisPath << " failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+static double kineticEnergy(const ParticleSystem &particles) {
+    double energy = 0.0;
+    for (size_t slot = 0; slot < particles.count; ++slot) {
+        if (particles.inverseMass[slot] <= 0.0f) continue;
+        Vector3 velocity = particles.getVelocity(slot);
+        energy += 0.5 * Vector3DotProduct(velocity, velocity) / particles.inverseMass[slot];
+    }
+    return energy;
+}
+
+// Matches the balls with those of the snapshot at path by id. Resolving pairs in another order sends a few balls
+// far apart within steps, so settings that do that are compared by the mean distance rather than the largest.
+static bool compareWithSnapshot(const Simulation &simulation, const std::string &path, double distanceTolerance,
+                                double energyTolerance) {
+    Simulation reference = loadSnapshot(path);
+    const ParticleSystem &particles = simulation.particles;
+    const ParticleSystem &expected = reference.particles;
+    if (particles.count != expected.count) {
+        std::cerr << path << " has " << expected.count << " balls, the run " << particles.count << "\n";
+        return false;
+    }
+    Vector3 periodicLength = reference.boundary.periodicLength();
+    double distanceSum = 0.0;
+    double largestDistance = 0.0;
+    for (size_t id = 0; id < particles.count; ++id) {
+        Vector3 offset = Vector3Subtract(particles.position(particles.slotOfId[id]), expected.position(expected.slotOfId[id]));
+        // Around a periodic box a ball may have been wrapped in one run and not yet in the other
+        if (periodicLength.x > 0.0f) {
+            offset.x -= periodicLength.x * roundf(offset.x / periodicLength.x);
+            offset.y -= periodicLength.y * roundf(offset.y / periodicLength.y);
+            offset.z -= periodicLength.z * roundf(offset.z / periodicLength.z);
+        }
+        double distance = Vector3Length(offset);
+        distanceSum += distance;
+        largestDistance = std::max(largestDistance, distance);
+    }
+    double meanDistance = particles.count > 0 ? distanceSum / particles.count : 0.0;
+    double energy = kineticEnergy(particles);
+    double expectedEnergy = kineticEnergy(expected);
+    std::cout << "compared with " << path << ": mean distance " << meanDistance << ", largest " << largestDistance
+              << ", kinetic energy " << energy << " against " << expectedEnergy << "\n";
+    return meanDistance <= distanceTolerance && fabs(energy - expectedEnergy) <= energyTolerance * fabs(expectedEnergy);
+}
+
+static bool save(const Simulation &simulation, const std::string &path) {
+    try {
+        saveSnapshot(simulation, path);
+        return true;
+    } catch (const std::runtime_error &error) {
+        std::cerr << error.what() << "\n";
+        return false;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string scenario = "brownian";
+    std::string engine = "step";
+    long long steps = 1000;
+    int numberBalls = 300;
+    float roomSize = 20.0f;
+    float packingFraction = 0.0f;
+    uint64_t seed = 1;
+    long long reportEvery = 0;
+    int threadCount = 1;
+    int reorderEvery = 0;
+    float neighbourSkin = 0.0f;
+    std::string gridStorage;  // keep the scenario's or snapshot's
+    std::string boundary;  // keep the scenario's or snapshot's
+    std::string loadPath;
+    std::string savePath;
+    long long checkpointEvery = 0;
+    std::string comparePath;
+    double compareDistance = 0.0;
+    double compareEnergy = 0.0;
+    std::string statsPath;
+    std::string statsFormat = "csv";
+    long long statsEvery = 1;
+    std::string trajectoryPath;
+    long long trajectoryEvery = 1;
+    TrajectoryWriterOptions trajectoryOptions;
+    std::string analysisPath;
+    AnalysisOptions analysisOptions;
+    int ensembleReplicas = 0;
+    int langevinReplicas = 0;
+    long long calibrationSteps = 2000;
+    int slabs = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--scenario") == 0 && hasValue) {
+            scenario = argv[++i];
+        } else if (strcmp(argv[i], "--engine") == 0 && hasValue) {
+            engine = argv[++i];
+        } else if (strcmp(argv[i], "--steps") == 0 && hasValue) {
+            steps = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--balls") == 0 && hasValue) {
+            numberBalls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--room") == 0 && hasValue) {
+            roomSize = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--packing") == 0 && hasValue) {
+            packingFraction = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--boundary") == 0 && hasValue) {
+            boundary = argv[++i];
+        } else if (strcmp(argv[i], "--report-every") == 0 && hasValue) {
+            reportEvery = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--load") == 0 && hasValue) {
+            loadPath = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && hasValue) {
+            savePath = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && hasValue) {
+            checkpointEvery = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--compare") == 0 && hasValue) {
+            comparePath = argv[++i];
+        } else if (strcmp(argv[i], "--compare-distance") == 0 && hasValue) {
+            compareDistance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--compare-energy") == 0 && hasValue) {
+            compareEnergy = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0 && hasValue) {
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "--stats-format") == 0 && hasValue) {
+            statsFormat = argv[++i];
+        } else if (strcmp(argv[i], "--stats-every") == 0 && hasValue) {
+            statsEvery = std::max(1LL, atoll(argv[++i]));
+        } else if (strcmp(argv[i], "--trajectory") == 0 && hasValue) {
+            trajectoryPath = argv[++i];
+        } else if (strcmp(argv[i], "--trajectory-every") == 0 && hasValue) {
+            trajectoryEvery = std::max(1LL, atoll(argv[++i]));
+        } else if (strcmp(argv[i], "--trajectory-delta") == 0) {
+            trajectoryOptions.deltaEncoding = true;
+        } else if (strcmp(argv[i], "--analysis") == 0 && hasValue) {
+            analysisPath = argv[++i];
+        } else if (strcmp(argv[i], "--analysis-thread") == 0) {
+            analysisOptions.background = true;
+        } else if (strcmp(argv[i], "--ensemble") == 0 && hasValue) {
+            ensembleReplicas = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--langevin") == 0 && hasValue) {
+            langevinReplicas = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--calibration-steps") == 0 && hasValue) {
+            calibrationSteps = std::max(1LL, atoll(argv[++i]));
+        } else if (strcmp(argv[i], "--slabs") == 0 && hasValue) {
+            slabs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reorder-every") == 0 && hasValue) {
+            reorderEvery = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--neighbour-skin") == 0 && hasValue) {
+            neighbourSkin = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--grid") == 0 && hasValue) {
+            gridStorage = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--simd") == 0 && hasValue) {
+            std::string level = argv[++i];
+            setSimdLevel(level == "scalar" ? SimdLevel::Scalar : level == "sse2" ? SimdLevel::SSE2 : SimdLevel::AVX2);
+        } else {
+            printUsage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (!isScenarioName(scenario)) {
+        std::cerr << "Unknown scenario: " << scenario << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (engine != "step" && engine != "edmd") {
+        std::cerr << "Unknown engine: " << engine << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!boundary.empty() && boundary != "box" && boundary != "planes" && boundary != "periodic") {
+        std::cerr << "Unknown boundary: " << boundary << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!gridStorage.empty() && gridStorage != "dense" && gridStorage != "hashed" && gridStorage != "auto") {
+        std::cerr << "Unknown grid: " << gridStorage << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (engine == "edmd" && !statsPath.empty()) {
+        std::cerr << "--stats times the phases of a step, which the event driven engine doesn't have\n";
+        return 1;
+    }
+
+    if (checkpointEvery > 0 && savePath.empty()) {
+        std::cerr << "--checkpoint-every needs --save\n";
+        return 1;
+    }
+
+    if (slabs > 1 && (engine != "step" || ensembleReplicas > 0 || langevinReplicas > 0 || !statsPath.empty()
+                      || !trajectoryPath.empty() || !analysisPath.empty() || reportEvery > 0 || checkpointEvery > 0
+                      || reorderEvery > 0 || neighbourSkin != 0.0f)) {
+        std::cerr << "--slabs only runs the step engine, without --ensemble, --langevin, --stats, --trajectory, --analysis,\n"
+                  << "--report-every, --checkpoint-every, --reorder-every or --neighbour-skin\n";
+        return 1;
+    }
+
+    // Each slab process starts its own workers
+    std::shared_ptr<ThreadPool> threadPool;
+    if (threadCount > 1 && slabs <= 1) {
+        threadPool = std::make_shared<ThreadPool>(threadCount);
+    }
+
+    if (langevinReplicas > 0 && (scenario != "brownian" || engine != "step" || !loadPath.empty() || ensembleReplicas > 0)) {
+        std::cerr << "--langevin needs the brownian scenario and the step engine, without --load or --ensemble\n";
+        return 1;
+    }
+
+    if (ensembleReplicas > 0) {
+        if (engine != "step" || !loadPath.empty() || !savePath.empty() || !comparePath.empty() || !statsPath.empty()
+            || !trajectoryPath.empty()) {
+            std::cerr << "--ensemble can't be combined with --engine edmd, --load, --save, --compare, --stats or --trajectory\n";
+            return 1;
+        }
+        EnsembleOptions ensemble;
+        ensemble.scenario = scenario;
+        ensemble.numberBalls = numberBalls;
+        ensemble.replicas = ensembleReplicas;
+        ensemble.firstSeed = seed;
+        ensemble.steps = steps;
+        ensemble.neighbourSkin = neighbourSkin;
+        ensemble.reorderEvery = reorderEvery;
+        ensemble.analysis = analysisOptions;
+        try {
+            ensemble.boundary = replicaBoundary(boundary);
+            ensemble.roomSize = packingFraction > 0.0f ? scenarioRoomSize(scenario, numberBalls, packingFraction) : roomSize;
+        } catch (const std::exception &error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+        return runEnsembleMode(ensemble, threadPool.get(), analysisPath);
+    }
+
+    std::unique_ptr<Simulation> started;
+    auto setUpStart = std::chrono::steady_clock::now();
+    try {
+        if (packingFraction > 0.0f && loadPath.empty()) {
+            roomSize = scenarioRoomSize(scenario, numberBalls, packingFraction);
+        }
+        if (langevinReplicas > 0) {
+            Simulation surrogate = createLangevinScenario(roomSize, LangevinBath(), seed);
+            EnsembleOptions calibrationRuns;
+            calibrationRuns.roomSize = roomSize;
+            calibrationRuns.numberBalls = numberBalls;
+            calibrationRuns.replicas = langevinReplicas;
+            calibrationRuns.firstSeed = seed;
+            calibrationRuns.steps = calibrationSteps;
+            calibrationRuns.boundary = replicaBoundary(boundary);
+            calibrationRuns.neighbourSkin = neighbourSkin;
+            calibrationRuns.analysis = analysisOptions;
+            EnsembleReport explicitRuns = runEnsemble(calibrationRuns, threadPool.get());
+            std::vector<double> vacf;
+            for (const EnsembleEstimate &estimate : explicitRuns.velocityAutocorrelation) {
+                vacf.push_back(estimate.mean);
+            }
+            LangevinCalibration calibration = calibrateLangevin(explicitRuns.vacfLags, vacf,
+                                                                1.0f / surrogate.particles.inverseMass[0]);
+            surrogate.langevin = calibration.bath;
+            analysisOptions.removeDrift = false;
+            std::cout << "Langevin bath from " << langevinReplicas << " explicit replicas of " << calibrationSteps
+                      << " steps: temperature " << calibration.bath.temperature << ", friction "
+                      << calibration.bath.friction << " per unit time, D " << calibration.diffusion << " (from MSD "
+                      << explicitRuns.diffusionFromMsd.mean << " +- " << explicitRuns.diffusionFromMsd.standardError << ")\n";
+            started = std::make_unique<Simulation>(std::move(surrogate));
+        } else {
+            started = std::make_unique<Simulation>(loadPath.empty() ? createScenario(scenario, roomSize, numberBalls, seed, threadPool.get())
+                                                                    : loadSnapshot(loadPath));
+        }
+        if (boundary == "box" || boundary == "planes") {
+            started->useWalls(boundary == "planes");
+        } else if (boundary == "periodic") {
+            started->makePeriodic();
+        }
+        if (!gridStorage.empty()) {
+            started->setGridStorage(gridStorage == "dense" ? GridStorage::Dense
+                                    : gridStorage == "hashed" ? GridStorage::Hashed : GridStorage::Automatic);
+        }
+        if (neighbourSkin != 0.0f) {
+            started->setNeighbourSkin(neighbourSkin);
+        }
+    } catch (const std::exception &error) {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+    std::chrono::duration<double> setUpTime = std::chrono::steady_clock::now() - setUpStart;
+    Simulation &simulation = *started;
+    simulation.threadPool = threadPool;
+    simulation.reorderEvery = reorderEvery;
+    std::cout << (langevinReplicas > 0 ? "Langevin surrogate of " + scenario
+                  : loadPath.empty() ? "scenario " + scenario : "snapshot " + loadPath + " at step "
+                  + std::to_string(simulation.stepCount)) << ", " << simulation.particles.count << " balls, "
+              << steps << " steps, " << boundaryTypeName(simulation.boundary.type) << " boundary, "
+              << simdLevelName(getSimdLevel()) << " kernels, "
+              << (slabs > 1 ? std::to_string(slabs) + " slabs of " + std::to_string(std::max(1, threadCount))
+                              : std::to_string(simulation.threadCount())) << " threads, "
+              << (simulation.grid.hashed ? "hashed" : "dense") << " grid\n"
+              << "room " << simulation.roomDimensions.x << ", set up in " << setUpTime.count() << " s\n";
+
+    std::ofstream statsFile;
+    if (!statsPath.empty()) {
+        if (!instrumentationEnabled()) {
+            std::cerr << "--stats needs a build with DIFFUSION_INSTRUMENTATION on\n";
+            return 1;
+        }
+        if (statsFormat != "csv" && statsFormat != "json") {
+            std::cerr << "Unknown stats format: " << statsFormat << "\n";
+            return 1;
+        }
+        statsFile.open(statsPath);
+        if (!statsFile) {
+            std::cerr << "Could not open " << statsPath << "\n";
+            return 1;
+        }
+        if (statsFormat == "csv") writeStatsCsvHeader(statsFile);
+    }
+
+    std::unique_ptr<TrajectoryWriter> trajectory;
+    if (!trajectoryPath.empty()) {
+        trajectory = std::make_unique<TrajectoryWriter>(trajectoryPath, simulation.particles, std::vector<int>(), trajectoryOptions);
+        if (!trajectory->isOpen()) {
+            std::cerr << "Could not open " << trajectoryPath << "\n";
+            return 1;
+        }
+    }
+
+    std::unique_ptr<StreamingAnalysis> analysis;
+    if (!analysisPath.empty()) {
+        analysis = std::make_unique<StreamingAnalysis>(simulation.particles, simulation.grid.periodicLength(), analysisOptions);
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    if (engine == "edmd") {
+        if (simulation.boundary.type == BoundaryType::Periodic) {
+            std::cerr << "The event driven engine only supports walls\n";
+            return 1;
+        }
+        // Runs the same span of simulated time, one DT per "step"
+        std::unique_ptr<EventDrivenSimulation> made;
+        try {
+            made = std::make_unique<EventDrivenSimulation>(simulation.particles, simulation.room, simulation.roomDimensions);
+        } catch (const std::exception &error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+        EventDrivenSimulation &eventDriven = *made;
+        for (long long i = 1; i <= steps; ++i) {
+            eventDriven.advance(DT);
+            bool recordTrajectory = trajectory && i % trajectoryEvery == 0;
+            if (recordTrajectory || analysis) {
+                eventDriven.writeTo(simulation.particles);
+            }
+            if (recordTrajectory) {
+                trajectory->record(i, simulation.particles);
+            }
+            if (analysis) {
+                analysis->sample(simulation.particles);
+            }
+            if (reportEvery > 0 && i % reportEvery == 0) {
+                Vector3 position = eventDriven.positionAt(simulation.particles.slotOfId[0], eventDriven.currentTime);
+                std::cout << i << " " << position.x << " " << position.y << " " << position.z << "\n";
+            }
+        }
+        std::cout << eventDriven.particleCollisions << " particle collisions, " << eventDriven.wallCollisions
+                  << " wall collisions, " << eventDriven.cellCrossings << " cell crossings\n";
+        eventDriven.writeTo(simulation.particles);
+        simulation.stepCount += steps;
+    } else if (slabs > 1) {
+        SlabRunOptions slabOptions;
+        slabOptions.slabs = slabs;
+        slabOptions.threadsPerSlab = threadCount;
+        try {
+            runSlabDecomposed(simulation, steps, slabOptions);
+        } catch (const std::exception &error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    } else {
+        for (long long i = 0; i < steps; ++i) {
+            simulation.step();
+            if (statsFile.is_open() && simulation.stepCount % statsEvery == 0) {
+                if (statsFormat == "csv") {
+                    writeStatsCsv(statsFile, simulation.stepCount, simulation.stats);
+                } else {
+                    writeStatsJson(statsFile, simulation.stepCount, simulation.stats);
+                }
+            }
+            if (trajectory && simulation.stepCount % trajectoryEvery == 0) {
+                trajectory->record(simulation.stepCount, simulation.particles);
+            }
+            if (analysis) {
+                analysis->sample(simulation.particles);
+            }
+            if (reportEvery > 0 && simulation.stepCount % reportEvery == 0) {
+                Vector3 position = simulation.particles.position(simulation.particles.slotOfId[0]);
+                std::cout << simulation.stepCount << " " << position.x << " " << position.y << " " << position.z << "\n";
+            }
+            if (checkpointEvery > 0 && simulation.stepCount % checkpointEvery == 0 && !save(simulation, savePath)) {
+                return 1;
+            }
+        }
+    }
+    if (trajectory) {
+        trajectory->close();
+        if (!trajectory->isGood()) {
+            std::cerr << "Writing " << trajectoryPath << " failed\n";
+        }
+    }
+    AnalysisReport analysisReport;
+    if (analysis) {
+        analysisReport = analysis->report();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+    std::cout << "elapsed " << elapsed.count() << " s, "
+              << (elapsed.count() > 0.0 ? steps / elapsed.count() : 0.0) << " steps/s\n";
+    if (analysis) {
+        std::cout << "bath temperature " << analysisReport.temperature << " (mean " << analysisReport.meanTemperature << ")\n";
+        for (const TrackedAnalysis &tracked : analysisReport.tracked) {
+            std::cout << "ball " << tracked.particle << " D from MSD " << tracked.diffusionFromMsd
+                      << ", from VACF " << tracked.diffusionFromVacf << "\n";
+        }
+        if (!writeAnalysis(analysisReport, analysisPath)) {
+            std::cerr << "Writing " << analysisPath << " failed\n";
+            return 1;
+        }
+    }
+    if (!savePath.empty() && !save(simulation, savePath)) {
+        return 1;
+    }
+    if (!comparePath.empty()) {
+        try {
+            if (!compareWithSnapshot(simulation, comparePath, compareDistance, compareEnergy)) {
+                std::cerr << "The run doesn't match " << comparePath << "\n";
+                return 1;
+            }
+        } catch (const std::exception &error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "Drawing.h"
+#include "rlgl.h"
+#include <cstdio>
+
+void drawParticles(const RenderFrame &frame) {
+    for (size_t i = 0; i < frame.positions.size(); ++i) {
+        DrawSphere(frame.positions[i], frame.radii[i], frame.colors[i]);
+    }
+}
+
+void drawTrackedPaths(const RenderFrame &frame) {
+    for (const std::vector<Vector3> &path : frame.trackedPaths) {
+        for (size_t i = 0; i + 1 < path.size(); ++i) {
+            DrawLine3D(path[i], path[i + 1], BLACK);
+        }
+    }
+}
+
+void drawWall(const Wall &wall) {
+    Vector2 size = wall.size;
+    rlPushMatrix();
+    rlTranslatef(wall.centerPosition.x, wall.centerPosition.y, wall.centerPosition.z);
+    rlRotatef(wall.yAxisRotation, 0.0f, 1.0f, 0.0f);
+    rlRotatef(wall.xAxisRotation, 1.0f, 0.0f, 0.0f);
+    // Draw wireframe like borders to make adjacent walls easier to see
+    DrawLine3D( { -size.x / 2, 0.0f, size.y / 2 }, { size.x / 2, 0.0f, size.y / 2 }, BLACK );
+    DrawLine3D( { -size.x / 2, 0.0f, -size.y / 2 }, { size.x / 2, 0.0f, -size.y / 2 }, BLACK );
+    DrawLine3D( { size.x / 2, 0.0f, -size.y / 2 }, { size.x / 2, 0.0f, size.y / 2 }, BLACK );
+    DrawLine3D( { -size.x / 2, 0.0f, -size.y / 2 }, { -size.x / 2, 0.0f, size.y / 2 }, BLACK );
+    DrawPlane( { 0.0f, 0.0f, 0.0f }, size, wall.wallColor );
+    rlPopMatrix();
+}
+
+void drawStepStats(const StepStats &stats, int x, int y) {
+    const int lineHeight = 20;
+    const int lines = PhaseCount + 6;
+    DrawRectangle(x, y, 260, lines * lineHeight + 10, Fade(SKYBLUE, 0.5f));
+    DrawRectangleLines(x, y, 260, lines * lineHeight + 10, BLUE);
+    x += 10;
+    y += 10;
+    if (!instrumentationEnabled()) {
+        DrawText("Built without DIFFUSION_INSTRUMENTATION", x, y, 10, DARKGRAY);
+        return;
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line), "Step: %.3f ms", stats.stepSeconds() * 1e3);
+    DrawText(line, x, y, 10, BLACK);
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        y += lineHeight;
+        snprintf(line, sizeof(line), "- %s: %.3f ms", stepPhaseName(phase), stats.phaseSeconds[phase] * 1e3);
+        DrawText(line, x + 10, y, 10, DARKGRAY);
+    }
+    const CollisionCounters &counters = stats.collisions;
+    y += lineHeight;
+    snprintf(line, sizeof(line), "Pair tests: %lld", counters.pairTests);
+    DrawText(line, x, y, 10, DARKGRAY);
+    y += lineHeight;
+    snprintf(line, sizeof(line), "Contacts: %lld, collisions: %lld", counters.contacts, counters.collisions);
+    DrawText(line, x, y, 10, DARKGRAY);
+    y += lineHeight;
+    snprintf(line, sizeof(line), "Overlap corrections: %lld", counters.overlapCorrections);
+    DrawText(line, x, y, 10, DARKGRAY);
+    y += lineHeight;
+    snprintf(line, sizeof(line), "Max balls in a cell: %d", stats.maxCellLoad);
+    DrawText(line, x, y, 10, DARKGRAY);
+    y += lineHeight;
+    snprintf(line, sizeof(line), "Cells with 0/1/2/3+: %d/%d/%d/%d", stats.occupancy[0], stats.occupancy[1],
+             stats.occupancy[2], [&stats] {
+                 int total = 0;
+                 for (int bin = 3; bin < OCCUPANCY_BINS; ++bin) total += stats.occupancy[bin];
+                 return total;
+             }());
+    DrawText(line, x, y, 10, DARKGRAY);
+}
@@ -0,0 +1,17 @@
+#ifndef DRAWING_H
+#define DRAWING_H
+
+#include "raylib.h"
+#include "Objects.h"
+#include "ParticleSystem.h"
+#include "SimulationThread.h"
+
+// raylib drawing for the physics objects, kept out of the physics library
+// One DrawSphere per particle, what SphereRenderer falls back to without instancing
+void drawParticles(const RenderFrame &frame);
+void drawTrackedPaths(const RenderFrame &frame);
+void drawWall(const Wall &wall);
+// Timings and counters of the last step as a text panel with its top left corner at (x, y)
+void drawStepStats(const StepStats &stats, int x, int y);
+
+#endif // DRAWING_H
@@ -0,0 +1,71 @@
+#include "InstancePacking.h"
+#include <cmath>
+#include "raymath.h"
+
+// raylib's near clipping distance (RL_CULL_DISTANCE_NEAR)
+const float CAMERA_NEAR_DISTANCE = 0.01f;
+
+SphereView sphereViewFor(const Camera3D &camera, int screenWidth, int screenHeight) {
+    SphereView view;
+    view.eye = camera.position;
+    view.forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+    view.right = Vector3Normalize(Vector3CrossProduct(view.forward, camera.up));
+    view.up = Vector3CrossProduct(view.right, view.forward);
+    view.perspective = camera.projection == CAMERA_PERSPECTIVE;
+    float aspect = (float)screenWidth / (float)screenHeight;
+    // Same projection as BeginMode3D: fovy is the vertical angle for perspective and the view height for orthographic
+    view.halfHeight = view.perspective ? tanf(0.5f * camera.fovy * DEG2RAD) : 0.5f * camera.fovy;
+    view.halfWidth = view.halfHeight * aspect;
+    view.pixelsPerUnit = 0.5f * screenHeight / view.halfHeight;
+    view.nearDistance = CAMERA_NEAR_DISTANCE;
+    return view;
+}
+
+size_t SphereBatches::size() const {
+    size_t total = 0;
+    for (const std::vector<SphereInstance> &batch : instances) {
+        total += batch.size();
+    }
+    return total;
+}
+
+SphereDetail sphereDetailFor(const SphereView &view, float radius, float depth) {
+    float pixels = radius * view.pixelsPerUnit;
+    if (view.perspective) {
+        // Close enough to be inside or almost inside the sphere, it covers the screen
+        if (depth <= radius) return SphereDetail::Fine;
+        pixels /= depth;
+    }
+    if (pixels >= FINE_SPHERE_PIXELS) return SphereDetail::Fine;
+    if (pixels >= MEDIUM_SPHERE_PIXELS) return SphereDetail::Medium;
+    if (pixels >= COARSE_SPHERE_PIXELS) return SphereDetail::Coarse;
+    return SphereDetail::Impostor;
+}
+
+void packSphereInstances(const RenderFrame &frame, const SphereView &view, SphereBatches &batches) {
+    for (std::vector<SphereInstance> &batch : batches.instances) {
+        batch.clear();
+    }
+    batches.culled = 0;
+
+    // A sphere is outside a side plane of the view when its centre is further out than radius, which for the
+    // slanted planes of a perspective view is radius / cos(half angle) measured across the view
+    float heightSlack = view.perspective ? sqrtf(1.0f + view.halfHeight * view.halfHeight) : 1.0f;
+    float widthSlack = view.perspective ? sqrtf(1.0f + view.halfWidth * view.halfWidth) : 1.0f;
+    for (size_t i = 0; i < frame.positions.size(); ++i) {
+        Vector3 position = frame.positions[i];
+        float radius = frame.radii[i];
+        Vector3 relative = Vector3Subtract(position, view.eye);
+        float depth = Vector3DotProduct(relative, view.forward);
+        float across = fabsf(Vector3DotProduct(relative, view.right));
+        float along = fabsf(Vector3DotProduct(relative, view.up));
+        float scale = view.perspective ? depth : 1.0f;
+        if (depth + radius < view.nearDistance || across > view.halfWidth * scale + radius * widthSlack
+            || along > view.halfHeight * scale + radius * heightSlack) {
+            batches.culled++;
+            continue;
+        }
+        batches.at(sphereDetailFor(view, radius, depth)).push_back({ position.x, position.y, position.z, radius,
+                                                                    frame.colors[i] });
+    }
+}
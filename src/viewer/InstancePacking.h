@@ -0,0 +1,60 @@
+#ifndef INSTANCE_PACKING_H
+#define INSTANCE_PACKING_H
+
+#include <vector>
+#include "raylib.h"
+#include "SimulationThread.h"
+
+// How finely a sphere is drawn, picked from how large it looks on screen
+enum class SphereDetail {
+    Fine,      // the 16 x 16 sphere DrawSphere uses
+    Medium,
+    Coarse,
+    Impostor   // a camera-facing quad cut to a disc in the fragment shader
+};
+const int SPHERE_DETAIL_LEVELS = 4;
+
+// Smallest on-screen radius in pixels for each mesh level, anything smaller is an impostor
+const float FINE_SPHERE_PIXELS = 24.0f;
+const float MEDIUM_SPHERE_PIXELS = 8.0f;
+const float COARSE_SPHERE_PIXELS = 3.0f;
+
+// One sphere as the instancing shaders read it: the centre and radius as one vec4 and the colour as four
+// normalised bytes, 20 bytes with no padding
+struct SphereInstance {
+    float x, y, z, radius;
+    Color color;
+};
+
+// What packing needs of the camera, worked out once per frame. Plain numbers, so it can be made up without a window.
+struct SphereView {
+    Vector3 eye;
+    Vector3 forward, right, up;  // orthonormal
+    bool perspective = true;
+    // Half the height and width of the view: at unit depth for perspective, everywhere for orthographic
+    float halfHeight = 1.0f;
+    float halfWidth = 1.0f;
+    float pixelsPerUnit = 1.0f;  // screen pixels per world unit, at unit depth for perspective
+    float nearDistance = 0.01f;
+};
+
+SphereView sphereViewFor(const Camera3D &camera, int screenWidth, int screenHeight);
+
+// The instances of one frame, one array per detail level, each uploaded as it is
+struct SphereBatches {
+    std::vector<SphereInstance> instances[SPHERE_DETAIL_LEVELS];
+    size_t culled = 0;  // outside the view
+
+    std::vector<SphereInstance> &at(SphereDetail detail) { return instances[(int)detail]; }
+    const std::vector<SphereInstance> &at(SphereDetail detail) const { return instances[(int)detail]; }
+    size_t size() const;
+};
+
+// Detail level for a sphere of this radius at this depth in front of the camera
+SphereDetail sphereDetailFor(const SphereView &view, float radius, float depth);
+
+// Sorts the particles of frame into batches by detail level, leaving out the ones outside the view.
+// Only touches memory, no GPU, and reuses the storage of batches from the last frame.
+void packSphereInstances(const RenderFrame &frame, const SphereView &view, SphereBatches &batches);
+
+#endif // INSTANCE_PACKING_H
@@ -0,0 +1,126 @@
+#include "SimulationThread.h"
+#include <iostream>
+
+// Steps run back to back to catch up after a slow one, beyond this the schedule restarts from now
+const int MAX_CATCH_UP_STEPS = 4;
+// How often a paused simulation looks for commands
+const std::chrono::milliseconds PAUSED_POLL_INTERVAL(10);
+
+void fillRenderFrame(const Simulation &simulation, RenderFrame &frame) {
+    const ParticleSystem &particles = simulation.particles;
+    frame.positions.resize(particles.count);
+    frame.radii.resize(particles.count);
+    frame.colors.resize(particles.count);
+    for (size_t i = 0; i < particles.count; ++i) {
+        frame.positions[i] = particles.position(i);
+        frame.radii[i] = particles.radius[i];
+        frame.colors[i] = particles.cold.colors[particles.ids[i]];
+    }
+
+    const std::vector<RingBuffer<Vector3>> &paths = particles.cold.trackedPositions;
+    frame.trackedPaths.resize(paths.size());
+    for (size_t t = 0; t < paths.size(); ++t) {
+        frame.trackedPaths[t].resize(paths[t].size());
+        for (size_t k = 0; k < paths[t].size(); ++k) {
+            frame.trackedPaths[t][k] = paths[t][k];
+        }
+    }
+
+    frame.room = simulation.room;
+    frame.stats = simulation.stats;
+    frame.stepCount = simulation.stepCount;
+}
+
+SimulationThread::SimulationThread(Simulation _simulation, std::chrono::duration<double> _stepInterval) :
+    simulation(std::move(_simulation)),
+    stepInterval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(_stepInterval)),
+    nextStep(std::chrono::steady_clock::now()),
+    rateStart(nextStep)
+{
+    // The first frame is there before the thread starts
+    publish();
+#ifndef __EMSCRIPTEN__
+    thread = std::thread([this] { run(); });
+#endif
+}
+
+SimulationThread::~SimulationThread() {
+    stopping.store(true);
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+const RenderFrame &SimulationThread::latestFrame() {
+#ifdef __EMSCRIPTEN__
+    advance();
+#endif
+    frames.update();
+    return frames.readBuffer();
+}
+
+void SimulationThread::post(std::function<void(Simulation &)> command) {
+    std::lock_guard<std::mutex> lock(commandMutex);
+    commands.push_back(std::move(command));
+}
+
+void SimulationThread::run() {
+    while (!stopping.load()) {
+        std::this_thread::sleep_until(advance());
+    }
+}
+
+std::chrono::steady_clock::time_point SimulationThread::advance() {
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        std::swap(commands, runningCommands);
+    }
+    bool changed = !runningCommands.empty();
+    for (const std::function<void(Simulation &)> &command : runningCommands) {
+        try {
+            command(simulation);
+        } catch (const std::exception &error) {
+            std::cerr << error.what() << "\n";
+        }
+    }
+    runningCommands.clear();
+
+    auto now = std::chrono::steady_clock::now();
+    if (pausedFlag.load()) {
+        nextStep = now;
+        if (changed) publish();
+        return now + PAUSED_POLL_INTERVAL;
+    }
+
+    int steps = 0;
+    if (unthrottledFlag.load()) {
+        simulation.step();
+        steps = 1;
+        nextStep = now;
+    } else {
+        for (; nextStep <= now && steps < MAX_CATCH_UP_STEPS; ++steps) {
+            simulation.step();
+            nextStep += stepInterval;
+        }
+        // Too far behind to catch up, drop the backlog instead of falling further behind
+        if (nextStep <= now) nextStep = now + stepInterval;
+    }
+
+    rateStepCount += steps;
+    std::chrono::duration<double> rateSeconds = now - rateStart;
+    if (rateSeconds.count() >= 1.0) {
+        stepsPerSecond = rateStepCount / rateSeconds.count();
+        rateStepCount = 0;
+        rateStart = now;
+    }
+
+    if (steps > 0 || changed) publish();
+    return nextStep;
+}
+
+void SimulationThread::publish() {
+    RenderFrame &frame = frames.writeBuffer();
+    fillRenderFrame(simulation, frame);
+    frame.stepsPerSecond = stepsPerSecond;
+    frames.publish();
+}
@@ -0,0 +1,80 @@
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Simulation.h"
+#include "TripleBuffer.h"
+
+// What the renderer needs of one simulation step, copied out so it can be drawn while the next steps run
+struct RenderFrame {
+    std::vector<Vector3> positions;
+    std::vector<float> radii;
+    std::vector<Color> colors;
+    std::vector<std::vector<Vector3>> trackedPaths;
+    std::vector<Wall> room;
+    StepStats stats;
+    long long stepCount = 0;
+    double stepsPerSecond = 0.0;  // measured over the last second
+};
+
+// Copies the state of simulation into frame, reusing its storage
+void fillRenderFrame(const Simulation &simulation, RenderFrame &frame);
+
+// Runs a simulation on its own thread, a step every stepInterval or as fast as it goes, and publishes a
+// RenderFrame after each step through a TripleBuffer. The render loop draws the latest frame at its own rate:
+// a slow step never stalls the window and vsync never holds back the physics.
+//
+// The simulation is only touched by its thread. Everything else, from saving to resetting, is posted to it as
+// a command and runs before the next step.
+// Web builds have no threads, so there the render loop drives the same stepping through latestFrame().
+class SimulationThread {
+public:
+    SimulationThread(Simulation simulation, std::chrono::duration<double> stepInterval);
+    ~SimulationThread();
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    // The newest published frame, never waits for the simulation
+    const RenderFrame &latestFrame();
+
+    void post(std::function<void(Simulation &)> command);
+
+    bool paused() const { return pausedFlag.load(); }
+    void setPaused(bool paused) { pausedFlag.store(paused); }
+    // Steps back to back instead of one per stepInterval
+    bool unthrottled() const { return unthrottledFlag.load(); }
+    void setUnthrottled(bool unthrottled) { unthrottledFlag.store(unthrottled); }
+
+private:
+    void run();
+    // Runs the posted commands and the steps that are due, returns when the next step is due
+    std::chrono::steady_clock::time_point advance();
+    void publish();
+
+    Simulation simulation;
+    std::chrono::steady_clock::duration stepInterval;
+    std::chrono::steady_clock::time_point nextStep;
+    TripleBuffer<RenderFrame> frames;
+
+    std::mutex commandMutex;
+    std::vector<std::function<void(Simulation &)>> commands;
+    std::vector<std::function<void(Simulation &)>> runningCommands;
+
+    std::atomic<bool> pausedFlag{false};
+    std::atomic<bool> unthrottledFlag{false};
+    std::atomic<bool> stopping{false};
+
+    // Steps per second, counted on the simulation thread
+    long long rateStepCount = 0;
+    std::chrono::steady_clock::time_point rateStart;
+    double stepsPerSecond = 0.0;
+
+    std::thread thread;
+};
+
+#endif // SIMULATION_THREAD_H
@@ -0,0 +1,200 @@
+#include "SphereRenderer.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "raymath.h"
+#include "rlgl.h"
+#include "Drawing.h"
+
+static_assert(sizeof(SphereInstance) == 5 * sizeof(float), "instances are uploaded as they are, without padding");
+
+// Rings and slices of the Fine, Medium and Coarse sphere meshes
+const int SPHERE_RINGS[SPHERE_DETAIL_LEVELS - 1] = { 16, 8, 4 };
+const int SPHERE_SLICES[SPHERE_DETAIL_LEVELS - 1] = { 16, 10, 6 };
+
+// The shaders are written once for GLSL 330 and GLSL ES 100 with these in front
+#ifdef __EMSCRIPTEN__
+const char *VERTEX_PREFIX = "#version 100\n#define ATTRIBUTE attribute\n#define VARYING varying\n";
+const char *FRAGMENT_PREFIX = "#version 100\nprecision mediump float;\n#define VARYING varying\n"
+                              "#define finalColor gl_FragColor\n";
+#else
+const char *VERTEX_PREFIX = "#version 330\n#define ATTRIBUTE in\n#define VARYING out\n";
+const char *FRAGMENT_PREFIX = "#version 330\n#define VARYING in\nout vec4 finalColor;\n";
+#endif
+
+// Unit sphere moved and scaled to each instance, flat coloured like DrawSphere
+const char *MESH_VERTEX_SHADER = R"(
+ATTRIBUTE vec3 vertexPosition;
+ATTRIBUTE vec4 instanceSphere;
+ATTRIBUTE vec4 instanceColor;
+uniform mat4 mvp;
+VARYING vec4 fragColor;
+void main() {
+    fragColor = instanceColor;
+    gl_Position = mvp * vec4(instanceSphere.xyz + instanceSphere.w * vertexPosition, 1.0);
+}
+)";
+const char *MESH_FRAGMENT_SHADER = R"(
+VARYING vec4 fragColor;
+void main() {
+    finalColor = fragColor;
+}
+)";
+
+// Quad facing the camera, as wide as the sphere, with the corners cut off to leave its outline
+const char *IMPOSTOR_VERTEX_SHADER = R"(
+ATTRIBUTE vec3 vertexPosition;
+ATTRIBUTE vec4 instanceSphere;
+ATTRIBUTE vec4 instanceColor;
+uniform mat4 modelview;
+uniform mat4 projection;
+VARYING vec4 fragColor;
+VARYING vec2 corner;
+void main() {
+    fragColor = instanceColor;
+    corner = vertexPosition.xy;
+    vec4 centre = modelview * vec4(instanceSphere.xyz, 1.0);
+    gl_Position = projection * (centre + vec4(instanceSphere.w * vertexPosition.xy, 0.0, 0.0));
+}
+)";
+const char *IMPOSTOR_FRAGMENT_SHADER = R"(
+VARYING vec4 fragColor;
+VARYING vec2 corner;
+void main() {
+    if (dot(corner, corner) > 1.0) discard;
+    finalColor = fragColor;
+}
+)";
+
+// Two triangles from (-1, -1) to (1, 1), wound to face the camera
+const float QUAD_CORNERS[] = {
+    -1.0f, -1.0f, 0.0f,   1.0f, -1.0f, 0.0f,   1.0f, 1.0f, 0.0f,
+    -1.0f, -1.0f, 0.0f,   1.0f, 1.0f, 0.0f,   -1.0f, 1.0f, 0.0f
+};
+const int QUAD_VERTICES = 6;
+
+static Shader loadInstancingShader(const char *vertexShader, const char *fragmentShader, int *attributes) {
+    std::string vertexCode = std::string(VERTEX_PREFIX) + vertexShader;
+    std::string fragmentCode = std::string(FRAGMENT_PREFIX) + fragmentShader;
+    Shader shader = LoadShaderFromMemory(vertexCode.c_str(), fragmentCode.c_str());
+    // raylib hands back its default shader if these fail to build, which has neither attribute
+    attributes[0] = GetShaderLocationAttrib(shader, "instanceSphere");
+    attributes[1] = GetShaderLocationAttrib(shader, "instanceColor");
+    return shader;
+}
+
+void SphereRenderer::load() {
+    meshShader = loadInstancingShader(MESH_VERTEX_SHADER, MESH_FRAGMENT_SHADER, meshAttributes);
+    meshMvp = GetShaderLocation(meshShader, "mvp");
+    impostorShader = loadInstancingShader(IMPOSTOR_VERTEX_SHADER, IMPOSTOR_FRAGMENT_SHADER, impostorAttributes);
+    impostorModelview = GetShaderLocation(impostorShader, "modelview");
+    impostorProjection = GetShaderLocation(impostorShader, "projection");
+
+    for (int level = 0; level < SPHERE_DETAIL_LEVELS - 1; ++level) {
+        meshes[level] = GenMeshSphere(1.0f, SPHERE_RINGS[level], SPHERE_SLICES[level]);
+    }
+
+    quadArray = rlLoadVertexArray();
+    if (quadArray != 0) {
+        rlEnableVertexArray(quadArray);
+        quadBuffer = rlLoadVertexBuffer(QUAD_CORNERS, sizeof(QUAD_CORNERS), false);
+        rlSetVertexAttribute(impostorShader.locs[SHADER_LOC_VERTEX_POSITION], 3, RL_FLOAT, false, 0, nullptr);
+        rlEnableVertexAttribute(impostorShader.locs[SHADER_LOC_VERTEX_POSITION]);
+        rlDisableVertexArray();
+    }
+
+    ready = quadArray != 0 && meshes[0].vaoId != 0 && meshMvp >= 0 && impostorModelview >= 0
+            && impostorProjection >= 0;
+    for (int a = 0; a < 2; ++a) {
+        ready = ready && meshAttributes[a] >= 0 && impostorAttributes[a] >= 0;
+    }
+    if (!ready) {
+        std::cerr << "Instanced drawing isn't available, drawing the particles one by one\n";
+    }
+}
+
+void SphereRenderer::unload() {
+    UnloadShader(meshShader);
+    UnloadShader(impostorShader);
+    for (Mesh &mesh : meshes) {
+        UnloadMesh(mesh);
+        mesh = {};
+    }
+    if (quadArray != 0) rlUnloadVertexArray(quadArray);
+    if (quadBuffer != 0) rlUnloadVertexBuffer(quadBuffer);
+    if (instanceBuffer != 0) rlUnloadVertexBuffer(instanceBuffer);
+    quadArray = quadBuffer = instanceBuffer = 0;
+    instanceCapacity = 0;
+    ready = false;
+}
+
+void SphereRenderer::reserveInstances(size_t count) {
+    if (count <= instanceCapacity) return;
+    instanceCapacity = std::max(count, 2 * instanceCapacity);
+    if (instanceBuffer != 0) rlUnloadVertexBuffer(instanceBuffer);
+    instanceBuffer = rlLoadVertexBuffer(nullptr, (int)(instanceCapacity * sizeof(SphereInstance)), true);
+}
+
+void SphereRenderer::bindInstances(unsigned int vertexArray, const int *attributes, size_t first) {
+    const int stride = (int)sizeof(SphereInstance);
+    uintptr_t offset = first * sizeof(SphereInstance);
+    rlEnableVertexArray(vertexArray);
+    rlEnableVertexBuffer(instanceBuffer);
+    rlSetVertexAttribute(attributes[0], 4, RL_FLOAT, false, stride, (const void *)offset);
+    rlSetVertexAttribute(attributes[1], 4, RL_UNSIGNED_BYTE, true, stride,
+                         (const void *)(offset + offsetof(SphereInstance, color)));
+    for (int a = 0; a < 2; ++a) {
+        rlSetVertexAttributeDivisor(attributes[a], 1);
+        rlEnableVertexAttribute(attributes[a]);
+    }
+}
+
+void SphereRenderer::draw(const RenderFrame &frame, const Camera3D &camera) {
+    if (!ready) {
+        drawParticles(frame);
+        return;
+    }
+    packSphereInstances(frame, sphereViewFor(camera, GetScreenWidth(), GetScreenHeight()), batches);
+    if (batches.size() == 0) return;
+
+    // All levels go into one buffer, one after the other
+    reserveInstances(batches.size());
+    size_t first[SPHERE_DETAIL_LEVELS];
+    size_t uploaded = 0;
+    for (int level = 0; level < SPHERE_DETAIL_LEVELS; ++level) {
+        const std::vector<SphereInstance> &batch = batches.instances[level];
+        first[level] = uploaded;
+        if (batch.empty()) continue;
+        rlUpdateVertexBuffer(instanceBuffer, batch.data(), (int)(batch.size() * sizeof(SphereInstance)),
+                             (int)(uploaded * sizeof(SphereInstance)));
+        uploaded += batch.size();
+    }
+
+    // Anything raylib has batched up so far is drawn before the spheres
+    rlDrawRenderBatchActive();
+    Matrix modelview = rlGetMatrixModelview();
+    Matrix projection = rlGetMatrixProjection();
+
+    rlEnableShader(meshShader.id);
+    rlSetUniformMatrix(meshMvp, MatrixMultiply(modelview, projection));
+    for (int level = 0; level < SPHERE_DETAIL_LEVELS - 1; ++level) {
+        size_t count = batches.instances[level].size();
+        if (count == 0) continue;
+        bindInstances(meshes[level].vaoId, meshAttributes, first[level]);
+        rlDrawVertexArrayInstanced(0, meshes[level].vertexCount, (int)count);
+    }
+
+    size_t impostors = batches.at(SphereDetail::Impostor).size();
+    if (impostors > 0) {
+        rlEnableShader(impostorShader.id);
+        rlSetUniformMatrix(impostorModelview, modelview);
+        rlSetUniformMatrix(impostorProjection, projection);
+        bindInstances(quadArray, impostorAttributes, first[(int)SphereDetail::Impostor]);
+        rlDrawVertexArrayInstanced(0, QUAD_VERTICES, (int)impostors);
+    }
+
+    rlDisableVertexArray();
+    rlDisableShader();
+}
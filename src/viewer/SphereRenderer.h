@@ -0,0 +1,47 @@
+#ifndef SPHERE_RENDERER_H
+#define SPHERE_RENDERER_H
+
+#include "raylib.h"
+#include "InstancePacking.h"
+#include "SimulationThread.h"
+
+// Draws the particles of a frame as instances of a shared unit sphere: the frame is packed by detail level, uploaded
+// into one instance buffer and drawn with one call per level, the smallest as impostor quads.
+// Needs the window, so load it after InitWindow and unload it before CloseWindow. Where the instancing shaders or
+// vertex arrays aren't available it falls back to drawParticles, one DrawSphere per particle.
+class SphereRenderer {
+public:
+    void load();
+    void unload();
+
+    // Between BeginMode3D and EndMode3D, with the camera given to BeginMode3D
+    void draw(const RenderFrame &frame, const Camera3D &camera);
+
+    bool instanced() const { return ready; }
+    // The instances drawn last frame, by detail level
+    const SphereBatches &lastBatches() const { return batches; }
+
+private:
+    void reserveInstances(size_t count);
+    // Points the instance attributes of vertexArray at the instances starting from first in the instance buffer
+    void bindInstances(unsigned int vertexArray, const int *attributes, size_t first);
+
+    Shader meshShader = {};
+    Shader impostorShader = {};
+    int meshAttributes[2] = { -1, -1 };      // instanceSphere, instanceColor
+    int impostorAttributes[2] = { -1, -1 };
+    int meshMvp = -1;
+    int impostorModelview = -1;
+    int impostorProjection = -1;
+
+    Mesh meshes[SPHERE_DETAIL_LEVELS - 1] = {};  // Fine, Medium and Coarse
+    unsigned int quadArray = 0;
+    unsigned int quadBuffer = 0;
+
+    unsigned int instanceBuffer = 0;
+    size_t instanceCapacity = 0;
+    SphereBatches batches;
+    bool ready = false;
+};
+
+#endif // SPHERE_RENDERER_H
@@ -0,0 +1,144 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include "raylib.h"
+#include "raymath.h"
+
+#include "Simulation.h"
+#include "Drawing.h"
+#include "SimulationThread.h"
+#include "SphereRenderer.h"
+#include "Snapshot.h"
+
+const double updateDelta = 1.0 / 30.0;  // step the simulation every 30th of a second unless unthrottled
+const char *snapshotPath = "3Diffusion.snapshot";  // F5 saves, F9 loads
+
+// TODO:
+// Add path tracking for large particle
+// Add pausing and resetting simulation
+
+
+int main() {
+
+    // Initialization
+    //--------------------------------------------------------------------------------------
+    const int screenWidth = 1280;
+    const int screenHeight = 720;
+    bool drawFrameRate = false;
+    bool drawStats = false;
+
+    InitWindow(screenWidth, screenHeight, "3Diffusion");
+
+    SphereRenderer spheres;
+    spheres.load();
+
+    // Define the camera to look into our 3d world
+    Camera3D camera = { 0 };
+    camera.position = Vector3 { 20.0f, 20.0f, 20.0f }; // Camera position
+    camera.target = Vector3 { 0.0f, 0.0f, 0.0f };      // Camera looking at point
+    camera.up = Vector3 { 0.0f, 1.0f, 0.0f };          // Camera up vector (rotation towards target)
+    camera.fovy = 90.0f;                                // Camera field-of-view Y
+    camera.projection = CAMERA_PERSPECTIVE;             // Camera projection type
+
+    float roomSize = 20.0f;
+    int numberBalls = 300;
+    uint64_t seed = 1;  // each reset starts from the next seed
+
+    // "gas" and "three" are the other available scenarios
+    SimulationThread simulation(createScenario("brownian", roomSize, numberBalls, seed), std::chrono::duration<double>(updateDelta));
+
+    DisableCursor();                    // Limit cursor to relative movement inside the window
+
+    SetTargetFPS(60);                   // Set our game to run at 60 frames-per-second
+    //--------------------------------------------------------------------------------------
+
+    // Main game loop
+    while (!WindowShouldClose())        // Detect window close button or ESC key
+    {
+        // Update
+        //----------------------------------------------------------------------------------
+        UpdateCamera(&camera, CAMERA_FREE);
+
+        // User inputs
+        //----------------------------------------------------------------------------------
+        if (IsKeyPressed('Z')) camera.target = Vector3 { 0.0f, 0.0f, 0.0f };
+        if (IsKeyPressed('X')) simulation.setPaused(!simulation.paused());
+        if (IsKeyPressed('U')) simulation.setUnthrottled(!simulation.unthrottled());
+        if (IsKeyPressed(KEY_F2)) drawFrameRate = !drawFrameRate;
+        if (IsKeyPressed(KEY_F3)) drawStats = !drawStats;
+
+        // reset the simulation
+        if (IsKeyPressed('R') && IsKeyDown(KEY_LEFT_ALT)) {
+            uint64_t resetSeed = ++seed;
+            simulation.post([roomSize, numberBalls, resetSeed](Simulation &running) {
+                running = createScenario("brownian", roomSize, numberBalls, resetSeed);
+            });
+        }
+
+        // quick save and load, on the simulation thread between steps (errors are printed there)
+        if (IsKeyPressed(KEY_F5)) simulation.post([](Simulation &running) { saveSnapshot(running, snapshotPath); });
+        if (IsKeyPressed(KEY_F9)) simulation.post([](Simulation &running) { running = loadSnapshot(snapshotPath); });
+
+        const RenderFrame &frame = simulation.latestFrame();
+
+        // Draw
+        //----------------------------------------------------------------------------------
+        BeginDrawing();
+
+            ClearBackground(RAYWHITE);
+
+            BeginMode3D(camera);
+     
+                spheres.draw(frame, camera);
+                for (const Wall &wall : frame.room) {
+                    drawWall(wall);
+                }
+                drawTrackedPaths(frame);
+
+                // Draw the origin (optional)
+                // DrawSphere({ 0.0f, 0.0f, 0.0f }, 0.1f, LIME);
+
+            EndMode3D();
+
+            DrawRectangle( 10, 10, 320, 173, Fade(SKYBLUE, 0.5f));
+            DrawRectangleLines( 10, 10, 320, 173, BLUE);
+
+            DrawText("Controls:", 20, 20, 10, BLACK);
+            DrawText("- WASD + SPACE to move around the camera", 40, 40, 10, DARKGRAY);
+            DrawText("- Mouse Wheel to Zoom in-out", 40, 60, 10, DARKGRAY);
+            DrawText("- Mouse Wheel Pressed to Pan", 40, 80, 10, DARKGRAY);
+            DrawText("- Z to zoom to (0, 0, 0)", 40, 100, 10, DARKGRAY);
+            DrawText("- X to pause/resume simulation", 40, 120, 10, DARKGRAY);
+            DrawText("- F5 to save a snapshot, F9 to load it", 40, 140, 10, DARKGRAY);
+            DrawText("- U to step as fast as possible instead of 30 times a second", 40, 160, 10, DARKGRAY);
+
+            if (drawStats) drawStepStats(frame.stats, 10, 193);
+
+            if (drawFrameRate) {
+                int fps = GetFPS();
+                std::string fpsString = std::to_string(fps);
+                DrawText(fpsString.c_str(), screenWidth - 100, 20, 50, LIME);
+                std::string stepRateString = std::to_string((int)frame.stepsPerSecond) + " steps/s";
+                DrawText(stepRateString.c_str(), screenWidth - 200, 80, 20, LIME);
+                if (spheres.instanced()) {
+                    const SphereBatches &batches = spheres.lastBatches();
+                    std::string drawnString = std::to_string(batches.size() - batches.at(SphereDetail::Impostor).size())
+                                              + " spheres, " + std::to_string(batches.at(SphereDetail::Impostor).size())
+                                              + " impostors, " + std::to_string(batches.culled) + " culled";
+                    DrawText(drawnString.c_str(), screenWidth - 300, 110, 10, LIME);
+                }
+            }
+
+        EndDrawing();
+        //----------------------------------------------------------------------------------
+    }
+
+    // De-Initialization
+    //--------------------------------------------------------------------------------------
+    spheres.unload();
+    CloseWindow();        // Close window and OpenGL context
+    //--------------------------------------------------------------------------------------
+
+    return 0;
+
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <iostream>
+#include "InstancePacking.h"
+
+// Checks of the viewer's CPU side instance packing, with views made up or worked out from a camera, so no window
+// or GPU is needed
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        failures++;
+    }
+}
+
+static bool near(float a, float b) {
+    return fabsf(a - b) <= 1e-4f * std::max(1.0f, fabsf(b));
+}
+
+static bool near(Vector3 a, Vector3 b) {
+    return near(a.x, b.x) && near(a.y, b.y) && near(a.z, b.z);
+}
+
+// 800 x 600, 10 units back from the origin along z looking at it
+static Camera3D testCamera(int projection, float fovy) {
+    Camera3D camera = {};
+    camera.position = { 0.0f, 0.0f, 10.0f };
+    camera.target = { 0.0f, 0.0f, 0.0f };
+    camera.up = { 0.0f, 1.0f, 0.0f };
+    camera.fovy = fovy;
+    camera.projection = projection;
+    return camera;
+}
+
+static void checkViews() {
+    SphereView view = sphereViewFor(testCamera(CAMERA_PERSPECTIVE, 90.0f), 800, 600);
+    check(view.perspective, "a perspective camera gives a perspective view");
+    check(near(view.forward, { 0.0f, 0.0f, -1.0f }), "forward points from the eye to the target");
+    check(near(view.right, { 1.0f, 0.0f, 0.0f }), "right is across the screen");
+    check(near(view.up, { 0.0f, 1.0f, 0.0f }), "up is the camera's up");
+    check(near(view.halfHeight, 1.0f), "half height at unit depth is tan(fovy / 2)");
+    check(near(view.halfWidth, 4.0f / 3.0f), "half width follows the aspect ratio");
+    check(near(view.pixelsPerUnit, 300.0f), "half the screen height covers the half height");
+
+    SphereView flat = sphereViewFor(testCamera(CAMERA_ORTHOGRAPHIC, 20.0f), 800, 600);
+    check(!flat.perspective, "an orthographic camera gives an orthographic view");
+    check(near(flat.halfHeight, 10.0f), "fovy is the height of an orthographic view");
+    check(near(flat.pixelsPerUnit, 30.0f), "the screen height covers the orthographic view height");
+}
+
+static void checkDetailLevels() {
+    SphereView view;
+    view.pixelsPerUnit = 240.0f;
+    // A unit sphere is 240 pixels across at unit depth, so the thresholds fall at depths 10, 30 and 80
+    check(sphereDetailFor(view, 1.0f, 10.0f) == SphereDetail::Fine, "24 pixels is fine");
+    check(sphereDetailFor(view, 1.0f, 10.5f) == SphereDetail::Medium, "just under 24 pixels is medium");
+    check(sphereDetailFor(view, 1.0f, 30.0f) == SphereDetail::Medium, "8 pixels is medium");
+    check(sphereDetailFor(view, 1.0f, 31.0f) == SphereDetail::Coarse, "just under 8 pixels is coarse");
+    check(sphereDetailFor(view, 1.0f, 80.0f) == SphereDetail::Coarse, "3 pixels is coarse");
+    check(sphereDetailFor(view, 1.0f, 81.0f) == SphereDetail::Impostor, "under 3 pixels is an impostor");
+    check(sphereDetailFor(view, 2.0f, 2.0f) == SphereDetail::Fine, "a sphere around the eye is fine");
+    check(sphereDetailFor(view, 2.0f, -1.0f) == SphereDetail::Fine, "a sphere the eye is in is fine");
+
+    SphereView flat;
+    flat.perspective = false;
+    flat.pixelsPerUnit = 10.0f;
+    check(sphereDetailFor(flat, 3.0f, 1000.0f) == SphereDetail::Fine, "orthographic detail doesn't fall with depth");
+    check(sphereDetailFor(flat, 1.0f, 0.1f) == SphereDetail::Medium, "orthographic detail follows the radius");
+    check(sphereDetailFor(flat, 0.5f, 1.0f) == SphereDetail::Coarse, "5 orthographic pixels is coarse");
+    check(sphereDetailFor(flat, 0.1f, 1.0f) == SphereDetail::Impostor, "1 orthographic pixel is an impostor");
+}
+
+static void addSphere(RenderFrame &frame, Vector3 position, float radius, unsigned char tag) {
+    frame.positions.push_back(position);
+    frame.radii.push_back(radius);
+    frame.colors.push_back({ tag, 0, 0, 255 });
+}
+
+static bool holdsTags(const std::vector<SphereInstance> &batch, std::initializer_list<int> tags) {
+    if (batch.size() != tags.size()) return false;
+    size_t i = 0;
+    for (int tag : tags) {
+        if (batch[i++].color.r != tag) return false;
+    }
+    return true;
+}
+
+static void checkCulling() {
+    // 90 degrees, so at depth 10 the view reaches 10 up and 13.33 across
+    SphereView view = sphereViewFor(testCamera(CAMERA_PERSPECTIVE, 90.0f), 800, 600);
+    RenderFrame frame;
+    addSphere(frame, { 0.0f, 0.0f, 5.0f }, 0.5f, 0);       // in the middle
+    addSphere(frame, { 0.0f, 0.0f, 20.0f }, 0.5f, 1);      // behind the eye
+    addSphere(frame, { 0.0f, 0.0f, 10.3f }, 0.5f, 2);      // around the eye
+    addSphere(frame, { 13.8f, 0.0f, 0.0f }, 0.5f, 3);      // centre outside the right plane, still touching it
+    addSphere(frame, { 14.5f, 0.0f, 0.0f }, 0.5f, 4);      // clear of the right plane
+    addSphere(frame, { 0.0f, -10.5f, 0.0f }, 0.5f, 5);     // centre below the bottom plane, still touching it
+    addSphere(frame, { 0.0f, -11.0f, 0.0f }, 0.5f, 6);     // clear of the bottom plane
+    addSphere(frame, { 0.0f, 0.0f, 10.2f }, 0.1f, 7);      // just behind the eye, past the near plane
+    SphereBatches batches;
+    packSphereInstances(frame, view, batches);
+    check(batches.culled == 4, "spheres behind the eye or clear of the side planes are culled");
+    check(batches.size() == 4, "every sphere is either packed or culled");
+    check(holdsTags(batches.at(SphereDetail::Fine), { 0, 2 }), "a near sphere and one around the eye are fine");
+    check(holdsTags(batches.at(SphereDetail::Medium), { 3, 5 }), "spheres touching the side planes are kept");
+
+    SphereBatches flatBatches;
+    SphereView flat = sphereViewFor(testCamera(CAMERA_ORTHOGRAPHIC, 20.0f), 800, 600);
+    RenderFrame flatFrame;
+    addSphere(flatFrame, { 13.0f, 0.0f, -100.0f }, 0.5f, 0);  // inside the 13.33 half width, however far
+    addSphere(flatFrame, { 14.0f, 0.0f, 0.0f }, 0.5f, 1);     // outside by more than its radius
+    addSphere(flatFrame, { 0.0f, 10.4f, 0.0f }, 0.5f, 2);     // outside by less than its radius
+    packSphereInstances(flatFrame, flat, flatBatches);
+    check(flatBatches.culled == 1, "orthographic side planes don't slant");
+    check(holdsTags(flatBatches.at(SphereDetail::Medium), { 0, 2 }), "orthographic spheres touching the view are kept");
+}
+
+static void checkBatchOrder() {
+    SphereView view;
+    view.eye = { 0.0f, 0.0f, 0.0f };
+    view.forward = { 0.0f, 0.0f, -1.0f };
+    view.right = { 1.0f, 0.0f, 0.0f };
+    view.up = { 0.0f, 1.0f, 0.0f };
+    view.halfHeight = view.halfWidth = 1.0f;
+    view.pixelsPerUnit = 240.0f;
+    // Depths for fine, medium, coarse and impostor spheres, mixed up in the frame
+    const float depths[] = { 5.0f, 50.0f, 20.0f, 200.0f, 6.0f, 21.0f, 51.0f, 201.0f };
+    RenderFrame frame;
+    for (int i = 0; i < 8; ++i) {
+        addSphere(frame, { 0.0f, 0.0f, -depths[i] }, 1.0f, (unsigned char)i);
+    }
+    SphereBatches batches;
+    packSphereInstances(frame, view, batches);
+    check(holdsTags(batches.at(SphereDetail::Fine), { 0, 4 }), "the fine batch keeps frame order");
+    check(holdsTags(batches.at(SphereDetail::Medium), { 2, 5 }), "the medium batch keeps frame order");
+    check(holdsTags(batches.at(SphereDetail::Coarse), { 1, 6 }), "the coarse batch keeps frame order");
+    check(holdsTags(batches.at(SphereDetail::Impostor), { 3, 7 }), "the impostor batch keeps frame order");
+    const SphereInstance &packed = batches.at(SphereDetail::Medium)[0];
+    check(packed.x == 0.0f && packed.y == 0.0f && packed.z == -20.0f && packed.radius == 1.0f,
+          "instances carry the centre and radius");
+
+    // The next frame starts from empty batches
+    RenderFrame next;
+    addSphere(next, { 0.0f, 0.0f, -50.0f }, 1.0f, 9);
+    addSphere(next, { 0.0f, 0.0f, 10.0f }, 1.0f, 10);
+    packSphereInstances(next, view, batches);
+    check(batches.size() == 1 && holdsTags(batches.at(SphereDetail::Coarse), { 9 }), "packing replaces the last frame");
+    check(batches.culled == 1, "the culled count is per frame");
+}
+
+int main() {
+    static_assert(sizeof(SphereInstance) == 20, "the shaders read 20 byte instances");
+    checkViews();
+    checkDetailLevels();
+    checkCulling();
+    checkBatchOrder();
+    if (failures > 0) {
+        std::cerr << failures << " instance packing checks failed\n";
+        return 1;
+    }
+    std::cout << "instance packing checks passed\n";
+    return 0;
+}